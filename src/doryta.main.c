@@ -1,6 +1,8 @@
 #include <ross.h>
 #include <doryta_config.h>
 #include "driver/neuron.h"
+#include "driver/synapse.h"
+#include "layout/master.h"
 #include "model-loaders/hardcoded/five_neurons.h"
 #include "model-loaders/hardcoded/gameoflife.h"
 #include "model-loaders/hardcoded/random_spikes.h"
@@ -8,6 +10,7 @@
 #include "model-loaders/regular_io/load_spikes.h"
 #include "probes/firing.h"
 #include "probes/stats.h"
+#include "probes/load.h"
 #include "probes/lif/voltage.h"
 #include "utils/io.h"
 #include "version.h"
@@ -38,6 +41,36 @@ tw_lptype doryta_lps[] = {
         .map      = (map_f)     NULL,
         .state_sz = sizeof(struct NeuronLP)},
 
+    { // SynapseLP - delivers spikes on behalf of neurons (multicast and relays)
+        .init     = (init_f)    driver_synapse_init,
+        .pre_run  = (pre_run_f) NULL,
+        .event    = (event_f)   driver_synapse_event,
+        .revent   = (revent_f)  driver_synapse_event_reverse,
+        .commit   = (commit_f)  driver_synapse_event_commit,
+        .final    = (final_f)   driver_synapse_final,
+        .map      = (map_f)     NULL,
+        .state_sz = sizeof(struct SynapseLP)},
+
+    { // Neuron LP - needy mode (specialized for LIF)
+        .init     = (init_f)    driver_neuron_init,
+        .pre_run  = (pre_run_f) driver_neuron_pre_run_needy,
+        .event    = (event_f)   driver_neuron_event_needy_lif,
+        .revent   = (revent_f)  driver_neuron_event_reverse_needy_lif,
+        .commit   = (commit_f)  driver_neuron_event_commit,
+        .final    = (final_f)   driver_neuron_final,
+        .map      = (map_f)     NULL,
+        .state_sz = sizeof(struct NeuronLP)},
+
+    { // Neuron LP - spike-driven mode (specialized for LIF)
+        .init     = (init_f)    driver_neuron_init,
+        .pre_run  = (pre_run_f) NULL,
+        .event    = (event_f)   driver_neuron_event_spike_driven_lif,
+        .revent   = (revent_f)  driver_neuron_event_reverse_spike_driven_lif,
+        .commit   = (commit_f)  driver_neuron_event_commit,
+        .final    = (final_f)   driver_neuron_final,
+        .map      = (map_f)     NULL,
+        .state_sz = sizeof(struct NeuronLP)},
+
     {0},
 };
 
@@ -46,26 +79,55 @@ tw_lptype doryta_lps[] = {
 // NOTE: bools cannot be of type bool because ROSS assumes all arguments to be
 // ints except for chars
 static unsigned int is_spike_driven = 0;
+static unsigned int is_spike_multicast = 0;
+static unsigned int is_procedural_conv2d = 0;
+static unsigned int is_dense_all2all = 0;
+static unsigned int is_compact_synapses = 0;
+static unsigned int is_tiled_placement = 0;
+static unsigned int is_accumulate_spikes = 0;
+static unsigned int use_generic_handlers = 0;
+static unsigned int is_skip_quiescent = 0;
 static unsigned int run_five_neuron_example = 0;
 static unsigned int gol = 0;
 static unsigned int is_firing_probe_active = 0;
 static unsigned int is_voltage_probe_active = 0;
 static unsigned int is_stats_probe_active = 0;
+static unsigned int is_load_probe_active = 0;
 static unsigned int probe_firing_output_neurons_only = 0;
 static unsigned int save_final_state_neurons = 0;
+static unsigned int is_scatter_model = 0;
+static unsigned int is_scatter_per_node = 0;
 // Ints
 static unsigned int gol_width = 20;
 static unsigned int probe_firing_buffer_size = 5000;
 static unsigned int probe_voltage_buffer_size = 5000;
 static unsigned int random_spike_uplimit = 0;
+static unsigned int relay_fanout = 0;
+static unsigned int relay_batch = 256;
 // Doubles
 static double random_spikes_prob = .2;
 static double random_spikes_time = -1;
+static double probe_load_interval = 1;
+static double prune_weights = -1;
+// Synapses removed by pruning (across all PEs, and in the PE with most)
+static uint64_t pruned_synapses_total = 0;
+static uint64_t pruned_synapses_max_pe = 0;
+// Synapses across all PEs: stored, in the compact store, generated and
+// going to another PE. And the memory taken by the compact store
+static uint64_t synapses_total[5] = {0};
+// Neurons in the PE with fewest and with most. And the load (as found in the
+// `load-stats` run) of the PE with least and with most
+static uint64_t neurons_min_pe = 0;
+static uint64_t neurons_max_pe = 0;
+static double load_min_pe = 0;
+static double load_max_pe = 0;
 // Strings
 // Yes, caping the size to 512 is UNSAFE but the only way to do it!!
 static char output_dir[512] = "output";
 static char model_path[512] = {'\0'};
+static char shards_path[512] = {'\0'};
 static char spikes_path[512] = {'\0'};
+static char stats_path[512] = {'\0'};
 
 
 /**
@@ -79,11 +141,27 @@ static void set_mapping_on_all_lps(map_f map) {
 }
 
 
+// Neuron type used to pick specialized handlers (set once the model is loaded)
+static enum NEURON_TYPE neuron_type = NEURON_TYPE_generic;
+
+
 // The LP type determines the mode in which the neuron runs
 static tw_lpid model_typemap(tw_lpid gid) {
-    (void) gid;
     // 0 - needy mode
     // 1 - spike-driven mode
+    // 2 - SynapseLP (multicast and relays)
+    // 3 - needy mode (LIF)
+    // 4 - spike-driven mode (LIF)
+    if (layout_master_gid_is_synapse_lp(gid)) {
+        return 2;
+    }
+    switch (neuron_type) {
+        case NEURON_TYPE_lif:
+            return is_spike_driven ? 4 : 3;
+        case NEURON_TYPE_lif_beta:
+        case NEURON_TYPE_generic:
+            break;
+    }
     return is_spike_driven ? 1 : 0;
 }
 
@@ -94,6 +172,47 @@ static tw_optdef const model_opts[] = {
     TWOPT_FLAG("spike-driven", is_spike_driven,
             "Activate spike-driven mode (it generally runs faster) but doesn't "
             "allow 'positive' leak"),
+    TWOPT_FLAG("skip-quiescent", is_skip_quiescent,
+            "Needy mode only. Neurons stop heartbeating once their state doesn't change "
+            "anymore (they are at rest) until they receive a spike"),
+    TWOPT_FLAG("accumulate-spikes", is_accumulate_spikes,
+            "Requires spike-multicast. SynapseLPs add up the spikes going to a neuron "
+            "in the same heartbeat and send a single spike, which the neuron "
+            "integrates at the next heartbeat. LIF and LifBeta neurons only. Spikes "
+            "might differ from a run without it (floating point rounding)"),
+    TWOPT_FLAG("generic-handlers", use_generic_handlers,
+            "Call neurons through function pointers instead of using the event "
+            "handlers specialized for the neuron type (slower, for comparison)"),
+    TWOPT_FLAG("spike-multicast", is_spike_multicast,
+            "A neuron sends one spike per PE it connects to (instead of one per "
+            "synapse). The spike is delivered to all synapses within the PE by a "
+            "SynapseLP"),
+    TWOPT_UINT("relay-fanout", relay_fanout,
+            "Neurons with more synapses than this number send their spikes to a relay "
+            "(a SynapseLP) which delivers them in batches. Zero disables relays"),
+    TWOPT_UINT("relay-batch", relay_batch,
+            "Maximum number of spikes a SynapseLP sends in a single event (zero means "
+            "no limit)"),
+    TWOPT_FLAG("procedural-conv2d", is_procedural_conv2d,
+            "Synapses of conv2d layers are not stored but generated (from the kernel) "
+            "every time a neuron fires. Incompatible with multicast and relays"),
+    TWOPT_FLAG("dense-all2all", is_dense_all2all,
+            "Synapses of all2all (fully connected) layers are stored as a weight matrix "
+            "(without GIDs). Incompatible with multicast and relays"),
+    TWOPT_FLAG("compact-synapses", is_compact_synapses,
+            "Synapses are stored as a structure of arrays (destinations grouped by PE, "
+            "weights and delays) once the model is loaded. Incompatible with multicast "
+            "and relays"),
+    TWOPT_DOUBLE("prune-weights", prune_weights,
+            "Synapses with a weight (in absolute value) not larger than this are removed "
+            "once the model is loaded (zero removes only zero weights). A negative value "
+            "disables pruning. Incompatible with multicast and relays"),
+    TWOPT_FLAG("tiled-placement", is_tiled_placement,
+            "Layers connected by conv2d synapses are placed in 2D tiles (one per PE), so "
+            "that matching tiles of consecutive layers land on the same PE"),
+    TWOPT_CHAR("load-stats", stats_path,
+            "Path to the output of a previous run with `--probe-stats`. Neurons are "
+            "assigned to PEs by their load in that run instead of by their number"),
     TWOPT_CHAR("output-dir", output_dir,
             "Path to store the output of a model execution"),
     TWOPT_FLAG("save-state", save_final_state_neurons,
@@ -101,6 +220,15 @@ static tw_optdef const model_opts[] = {
             "the final state will be that in which the neuron was after it received the last spike)"),
     TWOPT_GROUP("Doryta Models"),
     TWOPT_CHAR("load-model", model_path, "Load model from file"),
+    TWOPT_FLAG("scatter-model", is_scatter_model,
+            "Only PE 0 reads the model file, and sends each PE its neurons "
+            "(model formats 2 to 7)"),
+    TWOPT_FLAG("scatter-per-node", is_scatter_per_node,
+            "With scatter-model, one PE per node (instead of PE 0 only) reads the "
+            "model file, and sends each PE in its node its neurons"),
+    TWOPT_CHAR("load-shards", shards_path,
+            "Load the model from the shards written by `doryta-partition` (the "
+            "prefix of the shards)"),
     TWOPT_FLAG("five-example", run_five_neuron_example,
             "Run a simple 5 (or 7) neurons network example (useful to check "
             "the binary is working properly)"),
@@ -136,6 +264,11 @@ static tw_optdef const model_opts[] = {
     TWOPT_FLAG("probe-stats", is_stats_probe_active,
             "This probe records basic stats for each neuron (number of leak, "
             "integrate and fire operations)"),
+    TWOPT_FLAG("probe-load", is_load_probe_active,
+            "This probe records the number of events processed (and spikes sent) by the "
+            "neurons in each PE over time"),
+    TWOPT_DOUBLE("probe-load-interval", probe_load_interval,
+            "Length (in simulation time) of the windows the load probe records"),
     TWOPT_END(),
 };
 
@@ -144,9 +277,24 @@ void fprint_doryta_params(FILE * fp) {
     fprintf(fp, "Doryta version: " DORYTA_VERSION "-" GIT_VERSION "\n");
     fprintf(fp, "=============== Params passed to Doryta ===============\n");
     fprintf(fp, "spike-driven          = %s\n",   is_spike_driven ? "ON" : "OFF");
+    fprintf(fp, "skip-quiescent        = %s\n",   is_skip_quiescent ? "ON" : "OFF");
+    fprintf(fp, "accumulate-spikes     = %s\n",   is_accumulate_spikes ? "ON" : "OFF");
+    fprintf(fp, "generic-handlers      = %s\n",   use_generic_handlers ? "ON" : "OFF");
+    fprintf(fp, "spike-multicast       = %s\n",   is_spike_multicast ? "ON" : "OFF");
+    fprintf(fp, "relay-fanout          = %d\n",   relay_fanout);
+    fprintf(fp, "relay-batch           = %d\n",   relay_batch);
+    fprintf(fp, "procedural-conv2d     = %s\n",   is_procedural_conv2d ? "ON" : "OFF");
+    fprintf(fp, "dense-all2all         = %s\n",   is_dense_all2all ? "ON" : "OFF");
+    fprintf(fp, "compact-synapses      = %s\n",   is_compact_synapses ? "ON" : "OFF");
+    fprintf(fp, "prune-weights         = %f\n",   prune_weights);
+    fprintf(fp, "tiled-placement       = %s\n",   is_tiled_placement ? "ON" : "OFF");
+    fprintf(fp, "load-stats            = '%s'\n", stats_path);
     fprintf(fp, "output-dir            = '%s'\n", output_dir);
     fprintf(fp, "save-state            = %s\n",   save_final_state_neurons ? "ON" : "OFF");
     fprintf(fp, "load-model            = '%s'\n", model_path);
+    fprintf(fp, "scatter-model         = %s\n",   is_scatter_model ? "ON" : "OFF");
+    fprintf(fp, "scatter-per-node      = %s\n",   is_scatter_per_node ? "ON" : "OFF");
+    fprintf(fp, "load-shards           = '%s'\n", shards_path);
     fprintf(fp, "five-example          = %s\n",   run_five_neuron_example ? "ON" : "OFF");
     fprintf(fp, "gol-model             = %s\n",   gol ? "ON" : "OFF");
     fprintf(fp, "gol-model-width       = %d\n",   gol_width);
@@ -160,13 +308,37 @@ void fprint_doryta_params(FILE * fp) {
     fprintf(fp, "probe-voltage         = %s\n",   is_voltage_probe_active ? "ON" : "OFF");
     fprintf(fp, "probe-voltage-buffer  = %d\n",   probe_voltage_buffer_size);
     fprintf(fp, "probe-stats           = %s\n",   is_stats_probe_active ? "ON" : "OFF");
+    fprintf(fp, "probe-load            = %s\n",   is_load_probe_active ? "ON" : "OFF");
+    fprintf(fp, "probe-load-interval   = %f\n",   probe_load_interval);
 }
 
 
 void fprint_settings_params(FILE * fp, struct SettingsNeuronLP * settings_neuron_lp) {
     fprintf(fp, "============== Doryta Internal Resources ==============\n");
     fprintf(fp, "Total Neurons         = %d\n", settings_neuron_lp->num_neurons);
-    //fprintf(fp, "Total Synapses        = %d\n", );
+    fprintf(fp, "Neurons in a PE       = min %" PRIu64 ", max %" PRIu64 "\n",
+            neurons_min_pe, neurons_max_pe);
+    if (stats_path[0] != '\0') {
+        fprintf(fp, "Load in a PE          = min %.0f, max %.0f\n",
+                load_min_pe, load_max_pe);
+    }
+    if (g_tw_synchronization_protocol == CONSERVATIVE) {
+        fprintf(fp, "Lookahead             = %f\n", g_tw_lookahead);
+    }
+    if (prune_weights >= 0) {
+        fprintf(fp, "Pruned Synapses       = %" PRIu64 " (at most %" PRIu64 " in a PE)\n",
+                pruned_synapses_total, pruned_synapses_max_pe);
+    }
+    fprintf(fp, "Total Synapses        = %" PRIu64 " (stored %" PRIu64 ", compact %"
+            PRIu64 ", generated %" PRIu64 ")\n",
+            synapses_total[0] + synapses_total[1] + synapses_total[2],
+            synapses_total[0], synapses_total[1], synapses_total[2]);
+    fprintf(fp, "Remote Synapses       = %" PRIu64 "\n", synapses_total[3]);
+    if (is_compact_synapses) {
+        fprintf(fp, "Compact Store         = %" PRIu64 " bytes (%" PRIu64
+                " bytes as struct Synapse)\n",
+                synapses_total[4], synapses_total[1] * sizeof(struct Synapse));
+    }
     //fprintf(fp, "Total Loaded Spikes   = %d\n", );
     fprintf(fp, "=======================================================\n");
 }
@@ -204,7 +376,8 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    int const num_models_selected = gol + run_five_neuron_example + (model_path[0] != '\0');
+    int const num_models_selected = gol + run_five_neuron_example
+        + (model_path[0] != '\0') + (shards_path[0] != '\0');
     if (num_models_selected != 1) {
         tw_error(TW_LOC, "You have to specify ONE model to run");
     }
@@ -216,11 +389,35 @@ int main(int argc, char *argv[]) {
     if (random_spikes_prob < 0 && 1 < random_spikes_prob) {
         tw_error(TW_LOC, "`random-spikes-prob` must be a number between 0.0 and 1.0");
     }
+    if (is_scatter_per_node && !is_scatter_model) {
+        tw_error(TW_LOC, "`scatter-per-node` requires `scatter-model`");
+    }
+    if (is_accumulate_spikes && !is_spike_multicast) {
+        tw_error(TW_LOC, "`accumulate-spikes` requires `spike-multicast` (spikes "
+                "are only added up by the SynapseLPs)");
+    }
 
     // ------------- Initializing model, spikes and probes (partially) -------------
     struct SettingsNeuronLP settings_neuron_lp;
     struct ModelParams params;
 
+    // Load of each neuron in a previous run
+    double * neuron_loads = NULL;
+    int32_t num_neuron_loads = 0;
+    if (stats_path[0] != '\0') {
+        neuron_loads = probes_stats_load(stats_path, &num_neuron_loads);
+    }
+
+    layout_master_set_options(&(struct LayoutMasterOptions) {
+        .multicast = is_spike_multicast,
+        .relay_fanout = relay_fanout,
+        .procedural_conv2d = is_procedural_conv2d,
+        .dense_all2all = is_dense_all2all,
+        .tiled_placement = is_tiled_placement,
+        .neuron_loads = neuron_loads,
+        .num_neuron_loads = num_neuron_loads,
+    });
+
     // Loading Model
     if (run_five_neuron_example) {
         params = model_five_neurons_init(&settings_neuron_lp);
@@ -229,7 +426,55 @@ int main(int argc, char *argv[]) {
         params = model_GoL_neurons_init(&settings_neuron_lp, gol_width);
     }
     if (model_path[0] != '\0') {
-        params = model_load_neurons_init(&settings_neuron_lp, model_path);
+        if (is_scatter_per_node) {
+            params = model_load_neurons_init_scattered_per_node(
+                    &settings_neuron_lp, model_path);
+        } else if (is_scatter_model) {
+            params = model_load_neurons_init_scattered(&settings_neuron_lp, model_path);
+        } else {
+            params = model_load_neurons_init(&settings_neuron_lp, model_path);
+        }
+    }
+    if (shards_path[0] != '\0') {
+        params = model_load_neurons_init_shard(&settings_neuron_lp, shards_path);
+    }
+    // Neurons have been placed by now
+    {
+        size_t const num_neurons_pe = layout_master_total_neurons_pe();
+        uint64_t const neurons_pe = num_neurons_pe;
+        MPI_Allreduce(&neurons_pe, &neurons_min_pe, 1, MPI_UINT64_T,
+                MPI_MIN, MPI_COMM_ROSS);
+        MPI_Allreduce(&neurons_pe, &neurons_max_pe, 1, MPI_UINT64_T,
+                MPI_MAX, MPI_COMM_ROSS);
+
+        double load_pe = 0;
+        for (size_t i = 0; i < num_neurons_pe; i++) {
+            int32_t const doryta_id = layout_master_local_id_to_doryta_id(i);
+            if (doryta_id < num_neuron_loads) {
+                load_pe += neuron_loads[doryta_id];
+            }
+        }
+        MPI_Allreduce(&load_pe, &load_min_pe, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_ROSS);
+        MPI_Allreduce(&load_pe, &load_max_pe, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_ROSS);
+    }
+    free(neuron_loads);
+    // All weights have been set by now
+    if (prune_weights >= 0) {
+        uint64_t const pruned_pe = layout_master_prune_synapses(prune_weights);
+        MPI_Allreduce(&pruned_pe, &pruned_synapses_total, 1, MPI_UINT64_T,
+                MPI_SUM, MPI_COMM_ROSS);
+        MPI_Allreduce(&pruned_pe, &pruned_synapses_max_pe, 1, MPI_UINT64_T,
+                MPI_MAX, MPI_COMM_ROSS);
+    }
+    if (is_compact_synapses) {
+        layout_master_compact_synapses(&settings_neuron_lp);
+    }
+    {
+        struct LayoutMasterSynapseStats const stats = layout_master_synapse_stats_pe();
+        uint64_t const synapses_pe[5] = {stats.stored, stats.compact,
+            stats.generated, stats.remote, stats.compact_bytes};
+        MPI_Allreduce(synapses_pe, synapses_total, 5, MPI_UINT64_T, MPI_SUM,
+                MPI_COMM_ROSS);
     }
 
     // Loading Spikes
@@ -263,7 +508,7 @@ int main(int argc, char *argv[]) {
     }
 
     // Loading probe recording mechanism
-    probe_event_f probe_events[4] = {NULL};
+    probe_event_f probe_events[5] = {NULL};
     {
         int i = 0;
         if (is_firing_probe_active) {
@@ -278,16 +523,57 @@ int main(int argc, char *argv[]) {
             probe_events[i] = probes_stats_record;
             i++;
         }
+        if (is_load_probe_active) {
+            probe_events[i] = probes_load_record;
+            i++;
+        }
         probe_events[i] = NULL;
     }
     settings_neuron_lp.probe_events = probe_events;
 
+    settings_neuron_lp.accumulate_spikes = is_accumulate_spikes;
+    settings_neuron_lp.skip_quiescent = is_skip_quiescent;
+    // Adding up the currents of spikes is only exact for neurons linear on
+    // their input current. We know this to be the case for LIF and LifBeta
+    if (is_accumulate_spikes && settings_neuron_lp.neuron_type == NEURON_TYPE_generic) {
+        tw_error(TW_LOC, "`accumulate-spikes` only works with LIF or LifBeta "
+                "neurons");
+    }
+    if (use_generic_handlers) {
+        settings_neuron_lp.neuron_type = NEURON_TYPE_generic;
+    }
+    neuron_type = settings_neuron_lp.neuron_type;
+
     // ---------------------- Setting up LPs ----------------------
     driver_neuron_config(&settings_neuron_lp);
 
+    synapse_probe_event_f synapse_probe_events[2] = {
+        is_load_probe_active ? probes_load_record_synapse : NULL, NULL};
+    struct SettingsSynapseLP settings_synapse_lp = {
+        .beat = settings_neuron_lp.beat,
+        .batch_size = relay_batch,
+        .accumulate = is_accumulate_spikes,
+        .probe_events = synapse_probe_events,
+    };
+    layout_master_configure_synapse_lps(&settings_synapse_lp);
+    driver_synapse_config(&settings_synapse_lp);
+
+    // Lookahead for conservative synchronization. It is determined by the
+    // shortest synaptic delay and the heartbeats
+    if (g_tw_synchronization_protocol == CONSERVATIVE) {
+        double const lookahead_pe = fmin(
+                driver_neuron_lookahead(is_spike_driven),
+                driver_synapse_lookahead());
+        double lookahead;
+        MPI_Allreduce(&lookahead_pe, &lookahead, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_ROSS);
+        // Offsets are computed from timestamps, so they might be rounded
+        // slightly below the lookahead
+        g_tw_lookahead = lookahead * (1 - 1e-6);
+    }
+
     // ---------------- Setting up ROSS variables -----------------
     set_mapping_on_all_lps(params.gid_to_pe);
-    tw_define_lps(params.lps_in_pe, sizeof(struct Message));
+    tw_define_lps(params.lps_in_pe, size_of_Message(settings_neuron_lp.sizeof_storage));
     // to determine the type of LP
     g_tw_lp_typemap = model_typemap;
     // set the global variable and initialize each LP's type
@@ -321,6 +607,9 @@ int main(int argc, char *argv[]) {
     if (is_stats_probe_active) {
         probes_stats_init(settings_neuron_lp.num_neurons_pe, output_dir);
     }
+    if (is_load_probe_active) {
+        probes_load_init(probe_load_interval, output_dir);
+    }
 
     // -------------------- Running simulation --------------------
     tw_run();
@@ -336,6 +625,9 @@ int main(int argc, char *argv[]) {
     if (is_stats_probe_active) {
         probes_stats_deinit();
     }
+    if (is_load_probe_active) {
+        probes_load_deinit();
+    }
 
     // --- DeInit of Spikes ---
     if (save_final_state_neurons) {
@@ -356,7 +648,7 @@ int main(int argc, char *argv[]) {
     if (run_five_neuron_example) {
         model_five_neurons_deinit();
     }
-    if (model_path[0] != '\0') {
+    if (model_path[0] != '\0' || shards_path[0] != '\0') {
         model_load_neurons_deinit();
     }
 
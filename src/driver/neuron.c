@@ -1,6 +1,9 @@
 #include "neuron.h"
 #include "../storable_spikes.h"
+#include "../neurons/lif.h"
+#include "../neurons/lif_beta.h"
 #include <ross.h>
+#include <string.h>
 
 // If spikes and heartbeats "occur" at the same time (ie, they are scheduled
 // for the same timestamp), then all heartbeat events will be processed before
@@ -28,14 +31,54 @@
 // before spikes (if their timestamp coincide) because spikes can be easily
 // rescheduled to an instant in further in the future (within the heartbeat
 // time).
-#define SPIKE_PRIORITY 0.8
-#define HEARTBEAT_PRIORITY 0.5
+//
+// The priorities (`SPIKE_PRIORITY` and `HEARTBEAT_PRIORITY`) are defined in
+// `neuron.h` as SynapseLPs send spikes too.
 
 struct SettingsNeuronLP settings = {0};
 bool settings_initialized = false;
 
 
+// Specialized handlers ignore the function pointers in the settings. This makes
+// sure that they would call the same functions
+static bool neuron_functions_match_type(struct SettingsNeuronLP const * settings_in) {
+    switch (settings_in->neuron_type) {
+        case NEURON_TYPE_generic:
+            return true;
+        case NEURON_TYPE_lif:
+            return settings_in->neuron_leak == (neuron_leak_f) neurons_lif_leak
+                && settings_in->neuron_leak_bigdt == (neuron_leak_big_f) neurons_lif_big_leak
+                && settings_in->neuron_integrate == (neuron_integrate_f) neurons_lif_integrate
+                && settings_in->neuron_fire == (neuron_fire_f) neurons_lif_fire
+                && settings_in->store_neuron == (neuron_state_op_f) neurons_lif_store_state
+                && settings_in->reverse_store_neuron
+                    == (neuron_state_op_f) neurons_lif_reverse_store_state;
+        case NEURON_TYPE_lif_beta:
+            return settings_in->neuron_leak == (neuron_leak_f) neurons_lif_beta_leak
+                && (settings_in->neuron_leak_bigdt == NULL
+                    || settings_in->neuron_leak_bigdt
+                        == (neuron_leak_big_f) neurons_lif_beta_big_leak)
+                && settings_in->neuron_integrate == (neuron_integrate_f) neurons_lif_beta_integrate
+                && settings_in->neuron_fire == (neuron_fire_f) neurons_lif_beta_fire
+                && settings_in->store_neuron == (neuron_state_op_f) neurons_lif_beta_store_state
+                && settings_in->reverse_store_neuron
+                    == (neuron_state_op_f) neurons_lif_beta_reverse_store_state;
+    }
+    return false;
+}
+
+
 void driver_neuron_config(struct SettingsNeuronLP * settings_in) {
+    if (settings_in->accumulate_spikes && settings_in->sizeof_storage < sizeof(float)) {
+        tw_error(TW_LOC, "Accumulating spikes requires to store at least a float "
+                "in each message, but the neuron stores only %zu bytes",
+                settings_in->sizeof_storage);
+    }
+    if (!neuron_functions_match_type(settings_in)) {
+        tw_error(TW_LOC, "The neuron functions do not correspond to the neuron "
+                "type %d. Specialized handlers would call different functions",
+                settings_in->neuron_type);
+    }
     assert_valid_SettingsPE(settings_in);
     settings = *settings_in;
     settings_initialized = true;
@@ -63,27 +106,49 @@ static inline void send_heartbeat(struct NeuronLP *neuronLP, struct tw_lp *lp) {
 }
 
 
-static inline void send_spike(
-        struct NeuronLP *neuronLP, struct tw_lp *lp) {
-    if (neuronLP->to_contact.num > 0) {
-        for (int32_t i = 0; i < neuronLP->to_contact.num; i++) {
-            struct Synapse const synap =
-                neuronLP->to_contact.synapses[i];
-
-            struct tw_event * const event =
-                tw_event_new_user_prio(synap.gid_to_send, synap.delay_double, lp, SPIKE_PRIORITY);
-            struct Message * const msg = tw_event_data(event);
-            initialize_Message(msg, MESSAGE_TYPE_spike);
+static inline void send_spike_through(struct NeuronLP *neuronLP,
+        struct tw_lp *lp, struct Synapse const *synap, double delay) {
+    (void) neuronLP;
+    struct tw_event * const event =
+        tw_event_new_user_prio(synap->gid_to_send, delay, lp, SPIKE_PRIORITY);
+    struct Message * const msg = tw_event_data(event);
+    initialize_Message(msg, MESSAGE_TYPE_spike);
 #ifndef NDEBUG
-            msg->neuron_from = neuronLP->doryta_id;
-            msg->neuron_to = synap.doryta_id_to_send;
+    msg->neuron_from = neuronLP->doryta_id;
+    msg->neuron_to = synap->doryta_id_to_send;
+    msg->neuron_to_gid = synap->gid_to_send;
 #endif
-            msg->neuron_from_gid = lp->gid;
-            msg->neuron_to_gid = synap.gid_to_send;
-            msg->spike_current = synap.weight;
-            assert_valid_Message(msg);
-            tw_event_send(event);
-        }
+    msg->neuron_from_gid = lp->gid;
+    msg->spike_current = synap->weight;
+    assert_valid_Message(msg);
+    tw_event_send(event);
+}
+
+
+// Context passed through `settings.generate_synapses`
+struct GeneratedSpikeContext {
+    struct NeuronLP *neuronLP;
+    struct tw_lp *lp;
+};
+
+
+static void send_spike_generated(struct Synapse const *synap, void *context_) {
+    struct GeneratedSpikeContext const * const context = context_;
+    assert(synap->delay > 0);
+    send_spike_through(context->neuronLP, context->lp, synap,
+            (synap->delay - 0.5) * settings.beat);
+}
+
+
+static inline void send_spike(
+        struct NeuronLP *neuronLP, struct tw_lp *lp) {
+    for (int32_t i = 0; i < neuronLP->to_contact.num; i++) {
+        struct Synapse const * const synap = &neuronLP->to_contact.synapses[i];
+        send_spike_through(neuronLP, lp, synap, synap->delay_double);
+    }
+    if (settings.generate_synapses != NULL) {
+        struct GeneratedSpikeContext context = {neuronLP, lp};
+        settings.generate_synapses(neuronLP->doryta_id, send_spike_generated, &context);
     }
 }
 
@@ -104,9 +169,9 @@ static inline void send_spike_from_StorableSpike(
 #ifndef NDEBUG
     msg->neuron_from = neuronLP->doryta_id;
     msg->neuron_to = neuronLP->doryta_id;
+    msg->neuron_to_gid = self;
 #endif
     msg->neuron_from_gid = lp->id;
-    msg->neuron_to_gid = self;
     msg->spike_current = spike->intensity;
     assert_valid_Message(msg);
     tw_event_send(event);
@@ -130,7 +195,11 @@ void driver_neuron_init(struct NeuronLP *neuronLP, struct tw_lp *lp) {
         neuronLP->to_contact = settings.synapses[local_id];
         for (int32_t i = 0; i < neuronLP->to_contact.num; i++) {
             struct Synapse * synapse = &neuronLP->to_contact.synapses[i];
-            synapse->delay_double = (synapse->delay - 0.5) * settings.beat;
+            if (synapse->delay == SYNAPSE_DELAY_RELAY) {
+                synapse->delay_double = settings.beat / 4;
+            } else {
+                synapse->delay_double = (synapse->delay - 0.5) * settings.beat;
+            }
         }
     }
 
@@ -160,63 +229,29 @@ void driver_neuron_init(struct NeuronLP *neuronLP, struct tw_lp *lp) {
 void driver_neuron_pre_run_needy(struct NeuronLP *neuronLP, struct tw_lp *lp) {
     // send initial heartbeat
     send_heartbeat(neuronLP, lp);
+    neuronLP->next_heartbeat_sent = true;
 }
 
 
-// Forward event handler
-void driver_neuron_event_needy(
-        struct NeuronLP *neuronLP,
-        struct tw_bf *bit_field,
-        struct Message *msg,
-        struct tw_lp *lp) {
-    (void) bit_field;
-    assert_valid_Message(msg);
-
-    msg->time_processed = tw_now(lp);
-    settings.store_neuron(neuronLP->neuron_struct, msg->reserved_for_reverse);
-
-    switch (msg->type) {
-        case MESSAGE_TYPE_heartbeat: {
-            // The order of leak and fire matters. In LIF, the leak operation
-            // (the second degree equation) updates the potential in the
-            // neuron. Leak cannot be performed after fire because the state of
-            // the neuron is unchanged until leak is executed.
-            // A different ordering (fire before leak) might be necessary for
-            // some neuron type but that hasn't happened yet.
-            settings.neuron_leak(neuronLP->neuron_struct, settings.beat);
-            bool const fired = settings.neuron_fire(neuronLP->neuron_struct);
-            if (fired) {
-                send_spike(neuronLP, lp);
-                msg->fired = true;
-            }
-            send_heartbeat(neuronLP, lp);
-            break;
-        }
-
-        case MESSAGE_TYPE_spike:
-            settings.neuron_integrate(neuronLP->neuron_struct, msg->spike_current);
-            break;
-    }
+// In accumulate mode, a spike only adds its current to the accumulator. The
+// neuron state is left untouched, so the space reserved in the message is used
+// to store the previous value of the accumulator (a floating point addition
+// cannot be reversed by a subtraction)
+static inline bool stores_neuron(struct Message const *msg) {
+    return !(settings.accumulate_spikes && msg->type == MESSAGE_TYPE_spike);
 }
 
-
-// Reverse Event Handler
-// Notice that all operations are reversed using the data stored in either the reverse
-// message or the bit field
-void driver_neuron_event_reverse_needy(
-        struct NeuronLP *neuronLP,
-        struct tw_bf *bit_field,
-        struct Message *msg,
-        struct tw_lp *lp) {
-    (void) bit_field;
-    (void) lp;
-    settings.reverse_store_neuron(neuronLP->neuron_struct, msg->reserved_for_reverse);
-    if (msg->type == MESSAGE_TYPE_heartbeat) {
-        msg->fired = false;
-    }
-    msg->time_processed = -1;
+static inline void accumulate_spike(struct NeuronLP *neuronLP, struct Message *msg) {
+    float * const prev_accumulated = (float *) msg->reserved_for_reverse;
+    *prev_accumulated = neuronLP->accumulated_current;
+    neuronLP->accumulated_current += msg->spike_current;
 }
 
+static inline void reverse_accumulate_spike(
+        struct NeuronLP *neuronLP, struct Message const *msg) {
+    float const * const prev_accumulated = (float const *) msg->reserved_for_reverse;
+    neuronLP->accumulated_current = *prev_accumulated;
+}
 
 static inline double find_prev_heartbeat_time(double now) {
     double intpart;
@@ -225,84 +260,113 @@ static inline double find_prev_heartbeat_time(double now) {
 }
 
 
-// Forward event handler
-void driver_neuron_event_spike_driven(
-        struct NeuronLP *neuronLP,
-        struct tw_bf *bit_field,
-        struct Message *msg,
-        struct tw_lp *lp) {
-    assert(settings.neuron_leak_bigdt != NULL);
-    assert_valid_Message(msg);
+// A heartbeat that left the state of the neuron untouched (and didn't fire)
+// will do the same on every heartbeat that follows, until a spike arrives. The
+// state before the heartbeat was saved in the message. Both states are
+// compared byte by byte, so both buffers are zeroed before the state is stored
+// (`store_neuron` might leave padding untouched)
+static inline bool is_quiescent(
+        struct Message const *msg, char const state_after[MESSAGE_SIZE_REVERSE]) {
+    return !msg->fired
+        && memcmp(msg->reserved_for_reverse, state_after, settings.sizeof_storage) == 0;
+}
 
-    bit_field->c0 = neuronLP->next_heartbeat_sent;
 
-    msg->prev_heartbeat = neuronLP->last_heartbeat;
-    msg->time_processed = tw_now(lp);
-    settings.store_neuron(neuronLP->neuron_struct, msg->reserved_for_reverse);
+// Restarting the heartbeats of a quiescent neuron at the next heartbeat
+static inline void wake_up_needy(struct NeuronLP *neuronLP, struct tw_lp *lp) {
+    double const dt_to_next_beat =
+        find_prev_heartbeat_time(tw_now(lp)) + settings.beat - tw_now(lp);
+    send_heartbeat_at(neuronLP, lp, dt_to_next_beat);
+    neuronLP->next_heartbeat_sent = true;
+}
 
-    switch (msg->type) {
-        case MESSAGE_TYPE_heartbeat: {
-            // Same as needy mode, except for `last_heartbeat`
-            settings.neuron_leak(neuronLP->neuron_struct, settings.beat);
-            bool const fired = settings.neuron_fire(neuronLP->neuron_struct);
-            if (fired) {
-                send_spike(neuronLP, lp);
-                msg->fired = true;
-            }
-            neuronLP->last_heartbeat = tw_now(lp);
-            neuronLP->next_heartbeat_sent = false;
-            break;
-        }
 
-        case MESSAGE_TYPE_spike: {
-            // previous heartbeat is not last heartbeat. It is the timestamp
-            // for when the previous heartbeat to this spike message should
-            // have been
-            double const prev_heartbeat_time = find_prev_heartbeat_time(tw_now(lp));
-            double const beat = settings.beat;
-            assert(neuronLP->last_heartbeat <= prev_heartbeat_time);
-            assert(msg->neuron_to == neuronLP->doryta_id);
-            assert((uint64_t) msg->neuron_to_gid == lp->gid);
-
-            // Getting neuron up-to-date since last heartbeat
-            if (! neuronLP->next_heartbeat_sent &&
-                neuronLP->last_heartbeat < prev_heartbeat_time)
-            {
-                double const delta = prev_heartbeat_time - neuronLP->last_heartbeat;
-                settings.neuron_leak_bigdt(neuronLP->neuron_struct, delta, beat);
-                neuronLP->last_heartbeat = prev_heartbeat_time;
-            }
+static void count_synapse(struct Synapse const *synap, void *counter) {
+    (void) synap;
+    (*(int32_t *) counter)++;
+}
 
-            settings.neuron_integrate(neuronLP->neuron_struct, msg->spike_current);
 
-            if (!neuronLP->next_heartbeat_sent) {
-                double const dt_to_next_beat = prev_heartbeat_time + beat - tw_now(lp);
-                send_heartbeat_at(neuronLP, lp, dt_to_next_beat);
-                neuronLP->next_heartbeat_sent = true;
-            }
-            break;
-        }
+int32_t driver_neuron_num_synapses(struct NeuronLP const *neuronLP) {
+    int32_t num = neuronLP->to_contact.num;
+    if (settings.generate_synapses != NULL) {
+        settings.generate_synapses(neuronLP->doryta_id, count_synapse, &num);
     }
+    return num;
 }
 
 
-// Reverse Event Handler
-void driver_neuron_event_reverse_spike_driven(
-        struct NeuronLP *neuronLP,
-        struct tw_bf *bit_field,
-        struct Message *msg,
-        struct tw_lp *lp) {
-    (void) lp;
-    settings.reverse_store_neuron(neuronLP->neuron_struct, msg->reserved_for_reverse);
-    neuronLP->last_heartbeat = msg->prev_heartbeat;
-    neuronLP->next_heartbeat_sent = bit_field->c0;
-    if (msg->type == MESSAGE_TYPE_heartbeat) {
-        msg->fired = false;
+// The events a neuron sends are: spikes (through its synapses), heartbeats and
+// (at init) the spikes loaded from file. Heartbeats are sent a full beat ahead,
+// except for those sent by spikes (spike-driven mode or waking up a quiescent
+// neuron), which are sent at the next heartbeat. Spikes arrive at half a
+// heartbeat (`(delay - 0.5) * beat`), and loaded spikes can arrive at any time
+double driver_neuron_lookahead(bool spike_driven) {
+    assert(settings_initialized);
+    double const beat = settings.beat;
+    double lookahead = beat;
+
+    if (spike_driven || settings.skip_quiescent) {
+        lookahead = beat / 2;
+        if (settings.spikes != NULL) {
+            for (int i = 0; i < settings.num_neurons_pe; i++) {
+                struct StorableSpike const * spike = settings.spikes[i];
+                for (; spike != NULL && spike->intensity != 0; spike++) {
+                    double const dt_to_next_beat =
+                        find_prev_heartbeat_time(spike->time) + beat - spike->time;
+                    lookahead = fmin(lookahead, dt_to_next_beat);
+                }
+            }
+        }
     }
-    msg->time_processed = -1;
+
+    // Generated synapses have a delay of at least one heartbeat
+    if (settings.generate_synapses != NULL) {
+        lookahead = fmin(lookahead, beat / 2);
+    }
+    if (settings.synapses != NULL) {
+        for (int i = 0; i < settings.num_neurons_pe; i++) {
+            struct SynapseCollection const * to_contact = &settings.synapses[i];
+            for (int32_t j = 0; j < to_contact->num; j++) {
+                // Delays are converted into doubles at init
+                uint16_t const delay = to_contact->synapses[j].delay;
+                lookahead = fmin(lookahead, delay == SYNAPSE_DELAY_RELAY
+                        ? beat / 4 : (delay - 0.5) * beat);
+            }
+        }
+    }
+    return lookahead;
 }
 
 
+// Generic handlers. The neuron is called through the pointers in `settings`,
+// thus they work for any neuron type
+#define NEURON_HANDLER(name) name
+#define NEURON_LEAK(neuron, dt) settings.neuron_leak(neuron, dt)
+#define NEURON_LEAK_BIGDT(neuron, delta, dt) \
+    (assert(settings.neuron_leak_bigdt != NULL), \
+     settings.neuron_leak_bigdt(neuron, delta, dt))
+#define NEURON_INTEGRATE(neuron, current) settings.neuron_integrate(neuron, current)
+#define NEURON_FIRE(neuron) settings.neuron_fire(neuron)
+#define NEURON_STORE(neuron, storage) settings.store_neuron(neuron, storage)
+#define NEURON_REVERSE_STORE(neuron, storage) \
+    settings.reverse_store_neuron(neuron, storage)
+#include "neuron_handlers.h"
+
+
+// Handlers specialized for LIF neurons
+#define NEURON_HANDLER(name) name##_lif
+#define NEURON_LEAK(neuron, dt) neurons_lif_leak(neuron, dt)
+#define NEURON_LEAK_BIGDT(neuron, delta, dt) neurons_lif_big_leak(neuron, delta, dt)
+#define NEURON_INTEGRATE(neuron, current) neurons_lif_integrate(neuron, current)
+#define NEURON_FIRE(neuron) neurons_lif_fire(neuron)
+#define NEURON_STORE(neuron, storage) \
+    neurons_lif_store_state(neuron, (struct StorageInMessageLif *) (storage))
+#define NEURON_REVERSE_STORE(neuron, storage) \
+    neurons_lif_reverse_store_state(neuron, (struct StorageInMessageLif *) (storage))
+#include "neuron_handlers.h"
+
+
 // Commit event handler
 // This function is only called when it can be make sure that the message won't be
 // roll back. Either the commit or reverse handler will be called, not both
@@ -320,6 +384,30 @@ void driver_neuron_event_commit(
 }
 
 
+// Context passed through `settings.generate_synapses` when printing synapses
+struct PrintSynapsesContext {
+    FILE * fp;
+    int32_t doryta_id;
+    bool first;
+};
+
+
+static void print_synapse(struct Synapse const *synap, void *context_) {
+    struct PrintSynapsesContext * const context = context_;
+    if (context->first) {
+        fprintf(context->fp, "LP (neuron): %" PRIi32 ". Synapses:", context->doryta_id);
+        context->first = false;
+    } else {
+        fprintf(context->fp, ",");
+    }
+#ifdef NDEBUG
+    fprintf(context->fp, " %f", synap->weight);
+#else
+    fprintf(context->fp, " %" PRIi32 ": %f", synap->doryta_id_to_send, synap->weight);
+#endif
+}
+
+
 // The finalization function
 // Reporting any final statistics for this LP in the file previously opened
 void driver_neuron_final(struct NeuronLP *neuronLP, struct tw_lp *lp) {
@@ -336,21 +424,16 @@ void driver_neuron_final(struct NeuronLP *neuronLP, struct tw_lp *lp) {
         }
         fprintf(fp, "\n");
 
-        if (neuronLP->to_contact.num > 0) {
-            fprintf(fp, "LP (neuron): %" PRIi32 ". Synapses:", self);
-            for (int i = 0; i < neuronLP->to_contact.num; i++) {
-#ifdef NDEBUG
-                fprintf(fp, " %f",
-                        neuronLP->to_contact.synapses[i].weight);
-#else
-                fprintf(fp, " %" PRIi32 ": %f",
-                        neuronLP->to_contact.synapses[i].doryta_id_to_send,
-                        neuronLP->to_contact.synapses[i].weight);
-#endif
-                if (i < neuronLP->to_contact.num - 1) {
-                    fprintf(fp, ",");
-                }
-            }
+        // Generated synapses are printed after the stored ones
+        struct PrintSynapsesContext context = {
+            .fp = fp, .doryta_id = self, .first = true};
+        for (int i = 0; i < neuronLP->to_contact.num; i++) {
+            print_synapse(&neuronLP->to_contact.synapses[i], &context);
+        }
+        if (settings.generate_synapses != NULL) {
+            settings.generate_synapses(self, print_synapse, &context);
+        }
+        if (!context.first) {
             fprintf(fp, "\n");
         }
     }
@@ -13,6 +13,19 @@ struct tw_bf;
 struct tw_lp;
 struct StorableSpike;
 
+// Spikes and heartbeats scheduled for the same instant are processed in this
+// order (heartbeats first). See `neuron.c` for the rationale
+#define SPIKE_PRIORITY 0.8
+#define HEARTBEAT_PRIORITY 0.5
+
+/**
+ * A synapse with this (unconverted) delay points to a SynapseLP instead of a
+ * neuron. The spike reaches the SynapseLP a quarter of a heartbeat after it
+ * was fired, which leaves time for the SynapseLP to deliver it to the actual
+ * synapses (the shortest delay for a synapse is half a heartbeat).
+ */
+#define SYNAPSE_DELAY_RELAY 0
+
 /**
  * `gid_to_send` is not the neuron to which a spike is sent but rather the LP which will
  * receive the spike. A spike can be processed by a neuron or a SynapseLP (these are in
@@ -55,17 +68,23 @@ struct SynapseCollection {
  * - `to_contact` has to be valid (`num` == 0 iff `synapses` == NULL)
  * - if `to_contact` is not null, then all synapses must be correct
  * - `last_heartbeat` is never negative
+ * - `accumulated_current` must be a number (not NaN)
  */
 struct NeuronLP {
     int32_t doryta_id; // This might not be the same as the GID for the neuron (it is defined as dorytaID because that is how it is caled in src/layout, but it might be anything the user wants)
     void *neuron_struct; /**< A pointer to the neuron state */
     struct SynapseCollection to_contact;
 
-    // spike-driven mode only parameters
+    // spike-driven mode only parameters (`next_heartbeat_sent` is also used
+    // on needy mode when skipping quiescent neurons)
     struct {
         double last_heartbeat;
         bool next_heartbeat_sent;
     };
+
+    // accumulate mode only. Sum of the currents of all spikes received since
+    // the last heartbeat
+    float accumulated_current;
 };
 
 static inline void initialize_NeuronLP(struct NeuronLP * neuronLP) {
@@ -73,6 +92,7 @@ static inline void initialize_NeuronLP(struct NeuronLP * neuronLP) {
     neuronLP->to_contact = (struct SynapseCollection){0, NULL};
     neuronLP->last_heartbeat = 0;
     neuronLP->next_heartbeat_sent = false;
+    neuronLP->accumulated_current = 0;
 }
 
 static inline bool is_valid_NeuronLP(struct NeuronLP * neuronLP) {
@@ -81,7 +101,9 @@ static inline bool is_valid_NeuronLP(struct NeuronLP * neuronLP) {
         (neuronLP->to_contact.num == 0)
         == (neuronLP->to_contact.synapses == NULL);
     bool const positive_heartbeat = neuronLP->last_heartbeat >= 0;
-    return struct_notnull && synapse_collection && positive_heartbeat;
+    bool const accumulated_number = !isnan(neuronLP->accumulated_current);
+    return struct_notnull && synapse_collection && positive_heartbeat
+        && accumulated_number;
 }
 
 static inline void assert_valid_NeuronLP(struct NeuronLP * neuronLP) {
@@ -90,6 +112,7 @@ static inline void assert_valid_NeuronLP(struct NeuronLP * neuronLP) {
     assert((neuronLP->to_contact.num == 0)
             == (neuronLP->to_contact.synapses == NULL));
     assert(neuronLP->last_heartbeat >= 0);
+    assert(!isnan(neuronLP->accumulated_current));
     for (int32_t i = 0; i < neuronLP->to_contact.num; i++) {
         assert_valid_Synapse(&neuronLP->to_contact.synapses[i]);
     }
@@ -105,6 +128,21 @@ typedef void (*probe_event_f)      (struct NeuronLP *, struct Message *, struct
 typedef int32_t (*id_to_dorytaid)  (size_t);
 typedef void (*print_neuron_f)     (FILE *, void *);
 typedef void (*neuron_state_op_f)  (void *, char[MESSAGE_SIZE_REVERSE]);
+typedef void (*synapse_send_f)     (struct Synapse const *, void *);
+typedef void (*synapses_generator_f) (int32_t, synapse_send_f, void *);
+
+/**
+ * Neuron types known to the driver. The functions in `SettingsNeuronLP` must
+ * be those of the declared type. LIF neurons have specialized event handlers,
+ * which call the neuron functions directly instead of through the pointers in
+ * `SettingsNeuronLP`. Any other type runs the generic handlers.
+ * `NEURON_TYPE_generic` works for any neuron.
+ */
+enum NEURON_TYPE {
+    NEURON_TYPE_generic = 0,
+    NEURON_TYPE_lif,
+    NEURON_TYPE_lif_beta,
+};
 
 
 /**
@@ -122,6 +160,10 @@ typedef void (*neuron_state_op_f)  (void *, char[MESSAGE_SIZE_REVERSE]);
  * - `neurons` has the same number of elements as `num_neurons indicates`
  * - `neurons` and `neuron_init` cannot be both null at the same time
  * - `neuron_leak`, `neuron_integrate` and `neuron_fire` cannot be null
+ * - `sizeof_storage` is positive and at most `MESSAGE_SIZE_REVERSE`
+ * - if `accumulate_spikes` is set, `sizeof_storage` is at least `sizeof(float)`
+ * - if `neuron_type` is not generic, the neuron functions must be those of the
+ *   given type (checked by `driver_neuron_config`)
  * - all elements inside `neurons` must be non-null
  * - `beat` is a positive number
  *
@@ -144,6 +186,13 @@ struct SettingsNeuronLP {
      * must be an array of exactly `num_neurons_pe` elements, or the program
      * might segfault. */
     struct SynapseCollection * synapses;
+    /** Optional. Synapses that are not stored in `synapses` but generated
+     * every time a neuron fires (eg, from the geometry and kernel of a conv2d
+     * layer). It is called with the DorytaID of the neuron that fired, and it
+     * must call the given function (passing along the last argument) once per
+     * synapse. The `delay` of the generated synapses is given in heartbeats
+     * (it is converted by the driver). */
+    synapses_generator_f       generate_synapses;
     /** Input spikes for each neuron in PE. The first pointer corresponds to an
      * array to arrays. The second pointer corresponds to the array of spikes
      * for a specific neuron. The array of spikes must finalize in zero. An
@@ -174,12 +223,37 @@ struct SettingsNeuronLP {
      * to its state after firing and returns the true if it fired. */
     neuron_fire_f              neuron_fire;
     /** This operation is given the neuron state and a pointer to a reserved
-     * space of size `MESSAGE_SIZE_REVERSE`. The operation must save the full
-     * (modifiable) state of the neuron into the reserved space. */
+     * space of size `sizeof_storage`. The operation must save the full
+     * (modifiable) state of the neuron into the reserved space. The space is
+     * aligned as a double. With `skip_quiescent`, two stored states are
+     * compared byte by byte, thus the same state must always be stored as
+     * the same bytes (bytes not written are zeroed beforehand). */
     neuron_state_op_f          store_neuron;
     /** This operation is the inverse of `store_neuron`. It must modify the
      * state of the neuron given the data stored. */
     neuron_state_op_f          reverse_store_neuron;
+    /** Number of bytes `store_neuron` writes. Every message reserves this
+     * space, thus the size of messages is determined by it (check
+     * `size_of_Message`). */
+    size_t                     sizeof_storage;
+    /** If true, spikes are not integrated when they arrive. Their currents
+     * are added up and integrated at once at the next heartbeat. Spike
+     * events become much cheaper (the state of the neuron is not stored), but
+     * the neuron must be linear with respect to the input current (ie,
+     * integrating two currents must be the same as integrating their sum). */
+    bool                       accumulate_spikes;
+    /** Needy mode only. If true, a neuron stops sending itself heartbeats
+     * once it reaches a fixed point, ie, when a heartbeat (leak and fire)
+     * leaves its state unchanged and it doesn't fire. The next spike it
+     * receives restarts the heartbeats. This is exact for any neuron (a neuron
+     * with positive leak never reaches a fixed point), but probes are not
+     * called for the skipped heartbeats. */
+    bool                       skip_quiescent;
+    /** The type of all neurons in the simulation. It is used to pick the
+     * specialized event handlers for LIF neurons (check
+     * `driver_neuron_event_needy_lif` and company). Leave it as
+     * `NEURON_TYPE_generic` if unsure. */
+    enum NEURON_TYPE           neuron_type;
     /** An optional function in charge of printing in one line the state of the
      * neuron at the end of the simulation. Use only for debug purposes as the
      * output get clogged with large models with many neurons. */
@@ -208,7 +282,11 @@ static inline bool is_valid_SettingsPE(struct SettingsNeuronLP * settingsPE) {
     bool const correct_neuron_sizes =
            settingsPE->num_neurons > 0
         && settingsPE->num_neurons_pe > 0
-        && settingsPE->num_neurons_pe <= settingsPE->num_neurons;
+        && settingsPE->num_neurons_pe <= settingsPE->num_neurons
+        && settingsPE->sizeof_storage > 0
+        && settingsPE->sizeof_storage <= MESSAGE_SIZE_REVERSE
+        && (!settingsPE->accumulate_spikes
+            || settingsPE->sizeof_storage >= sizeof(float));
     bool const beat_validity = settingsPE->beat > 0
                             && !isnan(settingsPE->beat)
                             && !isinf(settingsPE->beat);
@@ -234,6 +312,10 @@ static inline void assert_valid_SettingsPE(struct SettingsNeuronLP * settingsPE)
     assert(settingsPE->gid_to_doryta_id != NULL);
     assert(settingsPE->store_neuron != NULL);
     assert(settingsPE->reverse_store_neuron != NULL);
+    assert(settingsPE->sizeof_storage > 0);
+    assert(settingsPE->sizeof_storage <= MESSAGE_SIZE_REVERSE);
+    assert(!settingsPE->accumulate_spikes
+            || settingsPE->sizeof_storage >= sizeof(float));
     assert(settingsPE->beat > 0);
     assert(!isnan(settingsPE->beat));
     assert(!isinf(settingsPE->beat));
@@ -246,6 +328,19 @@ static inline void assert_valid_SettingsPE(struct SettingsNeuronLP * settingsPE)
 /** Setting global variables for the simulation. */
 void driver_neuron_config(struct SettingsNeuronLP *);
 
+/**
+ * Smallest time offset of the events sent by the neurons in this PE (ie, a
+ * safe lookahead for this PE under conservative synchronization). It must be
+ * called after `driver_neuron_config` and before the neurons are initialized.
+ */
+double driver_neuron_lookahead(bool spike_driven);
+
+/**
+ * Number of synapses going out from the neuron, counting both the stored
+ * synapses (`to_contact`) and those generated by `generate_synapses`.
+ */
+int32_t driver_neuron_num_synapses(struct NeuronLP const *neuronLP);
+
 /** Neuron initialization. */
 void driver_neuron_init(struct NeuronLP *neuronLP, struct tw_lp *lp);
 
@@ -281,6 +376,34 @@ void driver_neuron_event_reverse_spike_driven(
         struct Message *message,
         struct tw_lp *lp);
 
+/** Forward and reverse event handlers specialized for LIF neurons. They
+ * behave exactly as the generic handlers, but the neuron functions are called
+ * directly (they can be inlined). Only to be used if `neuron_type` is
+ * `NEURON_TYPE_lif`. */
+void driver_neuron_event_needy_lif(
+        struct NeuronLP *neuronLP,
+        struct tw_bf *bit_field,
+        struct Message *message,
+        struct tw_lp *lp);
+
+void driver_neuron_event_reverse_needy_lif(
+        struct NeuronLP *neuronLP,
+        struct tw_bf *bit_field,
+        struct Message *message,
+        struct tw_lp *lp);
+
+void driver_neuron_event_spike_driven_lif(
+        struct NeuronLP *neuronLP,
+        struct tw_bf *bit_field,
+        struct Message *message,
+        struct tw_lp *lp);
+
+void driver_neuron_event_reverse_spike_driven_lif(
+        struct NeuronLP *neuronLP,
+        struct tw_bf *bit_field,
+        struct Message *message,
+        struct tw_lp *lp);
+
 /** Commit event handler. */
 void driver_neuron_event_commit(
         struct NeuronLP *neuronLP,
@@ -0,0 +1,229 @@
+/** @file
+ * Event handlers for neurons (needy and spike-driven modes). This file is a
+ * template: it has no include guard and it is included by `neuron.c` once per
+ * set of handlers to instantiate. Before including it, the following macros
+ * have to be defined:
+ *
+ * - `NEURON_HANDLER(name)`: name of the instantiated function `name`
+ * - `NEURON_LEAK(neuron, dt)`
+ * - `NEURON_LEAK_BIGDT(neuron, delta, dt)`: optional. If it isn't defined,
+ *   the spike-driven handlers are not instantiated
+ * - `NEURON_INTEGRATE(neuron, current)`
+ * - `NEURON_FIRE(neuron)`
+ * - `NEURON_STORE(neuron, storage)`
+ * - `NEURON_REVERSE_STORE(neuron, storage)`
+ *
+ * The generic handlers call the neuron through the pointers in `settings`.
+ * Specialized handlers call the neuron functions directly, which allows the
+ * compiler to inline them. All macros are undefined at the end of the file.
+ */
+
+// Integrates (at once) all spikes received since the last heartbeat
+static inline void NEURON_HANDLER(integrate_accumulated)(
+        struct NeuronLP *neuronLP, struct Message *msg) {
+    msg->accumulated_current = neuronLP->accumulated_current;
+    if (neuronLP->accumulated_current != 0) {
+        NEURON_INTEGRATE(neuronLP->neuron_struct, neuronLP->accumulated_current);
+        neuronLP->accumulated_current = 0;
+    }
+}
+
+
+// Forward event handler
+void NEURON_HANDLER(driver_neuron_event_needy)(
+        struct NeuronLP *neuronLP,
+        struct tw_bf *bit_field,
+        struct Message *msg,
+        struct tw_lp *lp) {
+    assert_valid_Message(msg);
+
+    bit_field->c0 = neuronLP->next_heartbeat_sent;
+
+    msg->time_processed = tw_now(lp);
+    if (stores_neuron(msg)) {
+        // Padding has to match when the states are compared (`is_quiescent`)
+        if (settings.skip_quiescent) {
+            memset(msg->reserved_for_reverse, 0, settings.sizeof_storage);
+        }
+        NEURON_STORE(neuronLP->neuron_struct, msg->reserved_for_reverse);
+    }
+
+    switch (msg->type) {
+        case MESSAGE_TYPE_heartbeat: {
+            if (settings.accumulate_spikes) {
+                NEURON_HANDLER(integrate_accumulated)(neuronLP, msg);
+            }
+            // The order of leak and fire matters. In LIF, the leak operation
+            // (the second degree equation) updates the potential in the
+            // neuron. Leak cannot be performed after fire because the state of
+            // the neuron is unchanged until leak is executed.
+            // A different ordering (fire before leak) might be necessary for
+            // some neuron type but that hasn't happened yet.
+            NEURON_LEAK(neuronLP->neuron_struct, settings.beat);
+            bool const fired = NEURON_FIRE(neuronLP->neuron_struct);
+            if (fired) {
+                send_spike(neuronLP, lp);
+                msg->fired = true;
+            }
+            if (settings.skip_quiescent) {
+                _Alignas(double) char state_after[MESSAGE_SIZE_REVERSE];
+                memset(state_after, 0, settings.sizeof_storage);
+                NEURON_STORE(neuronLP->neuron_struct, state_after);
+                if (is_quiescent(msg, state_after)) {
+                    neuronLP->next_heartbeat_sent = false;
+                    break;
+                }
+            }
+            send_heartbeat(neuronLP, lp);
+            break;
+        }
+
+        case MESSAGE_TYPE_spike:
+            if (settings.accumulate_spikes) {
+                accumulate_spike(neuronLP, msg);
+            } else {
+                NEURON_INTEGRATE(neuronLP->neuron_struct, msg->spike_current);
+            }
+            if (settings.skip_quiescent && !neuronLP->next_heartbeat_sent) {
+                wake_up_needy(neuronLP, lp);
+            }
+            break;
+    }
+}
+
+
+// Reverse Event Handler
+// Notice that all operations are reversed using the data stored in either the reverse
+// message or the bit field
+void NEURON_HANDLER(driver_neuron_event_reverse_needy)(
+        struct NeuronLP *neuronLP,
+        struct tw_bf *bit_field,
+        struct Message *msg,
+        struct tw_lp *lp) {
+    (void) lp;
+    if (stores_neuron(msg)) {
+        NEURON_REVERSE_STORE(neuronLP->neuron_struct, msg->reserved_for_reverse);
+    } else {
+        reverse_accumulate_spike(neuronLP, msg);
+    }
+    neuronLP->next_heartbeat_sent = bit_field->c0;
+    if (msg->type == MESSAGE_TYPE_heartbeat) {
+        if (settings.accumulate_spikes) {
+            neuronLP->accumulated_current = msg->accumulated_current;
+        }
+        msg->fired = false;
+    }
+    msg->time_processed = -1;
+}
+
+
+#ifdef NEURON_LEAK_BIGDT
+// Forward event handler
+void NEURON_HANDLER(driver_neuron_event_spike_driven)(
+        struct NeuronLP *neuronLP,
+        struct tw_bf *bit_field,
+        struct Message *msg,
+        struct tw_lp *lp) {
+    assert_valid_Message(msg);
+
+    bit_field->c0 = neuronLP->next_heartbeat_sent;
+
+    msg->prev_heartbeat = neuronLP->last_heartbeat;
+    msg->time_processed = tw_now(lp);
+    if (stores_neuron(msg)) {
+        NEURON_STORE(neuronLP->neuron_struct, msg->reserved_for_reverse);
+    }
+
+    switch (msg->type) {
+        case MESSAGE_TYPE_heartbeat: {
+            // In accumulate mode, the neuron is brought up-to-date (leaked
+            // until the previous heartbeat) before integrating the spikes. In
+            // the usual mode, the first spike takes care of this
+            if (settings.accumulate_spikes) {
+                double const prev_heartbeat_time = tw_now(lp) - settings.beat;
+                if (neuronLP->last_heartbeat < prev_heartbeat_time) {
+                    double const delta = prev_heartbeat_time - neuronLP->last_heartbeat;
+                    NEURON_LEAK_BIGDT(neuronLP->neuron_struct, delta, settings.beat);
+                }
+                NEURON_HANDLER(integrate_accumulated)(neuronLP, msg);
+            }
+            // Same as needy mode, except for `last_heartbeat`
+            NEURON_LEAK(neuronLP->neuron_struct, settings.beat);
+            bool const fired = NEURON_FIRE(neuronLP->neuron_struct);
+            if (fired) {
+                send_spike(neuronLP, lp);
+                msg->fired = true;
+            }
+            neuronLP->last_heartbeat = tw_now(lp);
+            neuronLP->next_heartbeat_sent = false;
+            break;
+        }
+
+        case MESSAGE_TYPE_spike: {
+            // previous heartbeat is not last heartbeat. It is the timestamp
+            // for when the previous heartbeat to this spike message should
+            // have been
+            double const prev_heartbeat_time = find_prev_heartbeat_time(tw_now(lp));
+            double const beat = settings.beat;
+            assert(neuronLP->last_heartbeat <= prev_heartbeat_time);
+            assert(msg->neuron_to == neuronLP->doryta_id);
+            assert((uint64_t) msg->neuron_to_gid == lp->gid);
+
+            if (settings.accumulate_spikes) {
+                accumulate_spike(neuronLP, msg);
+            } else {
+                // Getting neuron up-to-date since last heartbeat
+                if (! neuronLP->next_heartbeat_sent &&
+                    neuronLP->last_heartbeat < prev_heartbeat_time)
+                {
+                    double const delta = prev_heartbeat_time - neuronLP->last_heartbeat;
+                    NEURON_LEAK_BIGDT(neuronLP->neuron_struct, delta, beat);
+                    neuronLP->last_heartbeat = prev_heartbeat_time;
+                }
+
+                NEURON_INTEGRATE(neuronLP->neuron_struct, msg->spike_current);
+            }
+
+            if (!neuronLP->next_heartbeat_sent) {
+                double const dt_to_next_beat = prev_heartbeat_time + beat - tw_now(lp);
+                send_heartbeat_at(neuronLP, lp, dt_to_next_beat);
+                neuronLP->next_heartbeat_sent = true;
+            }
+            break;
+        }
+    }
+}
+
+
+// Reverse Event Handler
+void NEURON_HANDLER(driver_neuron_event_reverse_spike_driven)(
+        struct NeuronLP *neuronLP,
+        struct tw_bf *bit_field,
+        struct Message *msg,
+        struct tw_lp *lp) {
+    (void) lp;
+    if (stores_neuron(msg)) {
+        NEURON_REVERSE_STORE(neuronLP->neuron_struct, msg->reserved_for_reverse);
+    } else {
+        reverse_accumulate_spike(neuronLP, msg);
+    }
+    neuronLP->last_heartbeat = msg->prev_heartbeat;
+    neuronLP->next_heartbeat_sent = bit_field->c0;
+    if (msg->type == MESSAGE_TYPE_heartbeat) {
+        if (settings.accumulate_spikes) {
+            neuronLP->accumulated_current = msg->accumulated_current;
+        }
+        msg->fired = false;
+    }
+    msg->time_processed = -1;
+}
+#endif // NEURON_LEAK_BIGDT
+
+
+#undef NEURON_HANDLER
+#undef NEURON_LEAK
+#undef NEURON_LEAK_BIGDT
+#undef NEURON_INTEGRATE
+#undef NEURON_FIRE
+#undef NEURON_STORE
+#undef NEURON_REVERSE_STORE
@@ -0,0 +1,472 @@
+#include "synapse.h"
+#include "../utils/math.h"
+#include <ross.h>
+#include <stdlib.h>
+
+static struct SettingsSynapseLP settings_synapse = {0};
+static bool settings_synapse_initialized = false;
+
+
+void driver_synapse_config(struct SettingsSynapseLP * settings_in) {
+    assert_valid_SettingsSynapseLP(settings_in);
+    settings_synapse = *settings_in;
+    settings_synapse_initialized = true;
+}
+
+
+static inline bool accumulates(struct SynapseLP const * synapseLP) {
+    return settings_synapse.accumulate && synapseLP->num_sources > 1;
+}
+
+
+// Target and delay of a synapse, used to find the synapses sharing a slot
+struct SlotKey {
+    uint64_t gid_to;
+    uint16_t delay;
+    int32_t synapse;
+};
+
+static int compare_SlotKey(void const * a_, void const * b_) {
+    struct SlotKey const * const a = a_;
+    struct SlotKey const * const b = b_;
+    if (a->gid_to != b->gid_to) {
+        return a->gid_to < b->gid_to ? -1 : 1;
+    }
+    if (a->delay != b->delay) {
+        return a->delay < b->delay ? -1 : 1;
+    }
+    return (a->synapse > b->synapse) - (a->synapse < b->synapse);
+}
+
+
+static struct SpikeAccumulator * new_accumulator(struct SynapseLP const * synapseLP) {
+    int32_t const num_sources = synapseLP->num_sources;
+    struct SpikeAccumulator * const acc = malloc(sizeof(struct SpikeAccumulator));
+    int32_t * const first_synapse = malloc((num_sources + 1) * sizeof(int32_t));
+    int64_t * const fired_at_beat = malloc(num_sources * sizeof(int64_t));
+    if (acc == NULL || first_synapse == NULL || fired_at_beat == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space to accumulate spikes");
+    }
+
+    first_synapse[0] = 0;
+    for (int32_t i = 0; i < num_sources; i++) {
+        first_synapse[i+1] = first_synapse[i] + synapseLP->sources[i].to_contact.num;
+        fired_at_beat[i] = -1;
+    }
+    int32_t const num_synapses = first_synapse[num_sources];
+
+    struct SlotKey * const keys = malloc(num_synapses * sizeof(struct SlotKey));
+    struct Synapse const ** const synapses =
+        malloc(num_synapses * sizeof(struct Synapse const *));
+    int32_t * const slot_of = malloc(num_synapses * sizeof(int32_t));
+    if (num_synapses > 0 && (keys == NULL || synapses == NULL || slot_of == NULL)) {
+        tw_error(TW_LOC, "Not able to allocate space to accumulate spikes");
+    }
+    for (int32_t i = 0; i < num_sources; i++) {
+        struct SynapseCollection const * const to_contact =
+            &synapseLP->sources[i].to_contact;
+        for (int32_t j = 0; j < to_contact->num; j++) {
+            int32_t const synapse = first_synapse[i] + j;
+            synapses[synapse] = &to_contact->synapses[j];
+            keys[synapse] = (struct SlotKey) {
+                .gid_to = to_contact->synapses[j].gid_to_send,
+                .delay = to_contact->synapses[j].delay,
+                .synapse = synapse,
+            };
+        }
+    }
+    qsort(keys, num_synapses, sizeof(struct SlotKey), compare_SlotKey);
+
+    // Synapses with the same target and delay are contiguous once sorted
+    int32_t num_slots = 0;
+    for (int32_t k = 0; k < num_synapses; k++) {
+        if (k > 0 && (keys[k-1].gid_to != keys[k].gid_to
+                   || keys[k-1].delay != keys[k].delay)) {
+            num_slots++;
+        }
+        slot_of[keys[k].synapse] = num_slots;
+    }
+    if (num_synapses > 0) {
+        num_slots++;
+    }
+
+    struct Synapse const ** const slot_synapse =
+        malloc(num_slots * sizeof(struct Synapse const *));
+    float * const slot_current = malloc(num_slots * sizeof(float));
+    bool * const slot_touched = calloc(num_slots, sizeof(bool));
+    int32_t * const touched = malloc(num_slots * sizeof(int32_t));
+    if (num_slots > 0 && (slot_synapse == NULL || slot_current == NULL
+                       || slot_touched == NULL || touched == NULL)) {
+        tw_error(TW_LOC, "Not able to allocate space to accumulate spikes");
+    }
+    for (int32_t k = 0; k < num_synapses; k++) {
+        slot_synapse[slot_of[keys[k].synapse]] = synapses[keys[k].synapse];
+    }
+    free(synapses);
+    free(keys);
+
+    *acc = (struct SpikeAccumulator) {
+        .fired_at_beat = fired_at_beat,
+        .flush_beat = -1,
+        .first_synapse = first_synapse,
+        .slot_of = slot_of,
+        .num_slots = num_slots,
+        .slot_synapse = slot_synapse,
+        .slot_current = slot_current,
+        .slot_touched = slot_touched,
+        .touched = touched,
+    };
+    return acc;
+}
+
+
+static void free_accumulator(struct SpikeAccumulator * acc) {
+    free(acc->fired_at_beat);
+    free(acc->first_synapse);
+    free(acc->slot_of);
+    free(acc->slot_synapse);
+    free(acc->slot_current);
+    free(acc->slot_touched);
+    free(acc->touched);
+    free(acc);
+}
+
+
+void driver_synapse_init(struct SynapseLP *synapseLP, struct tw_lp *lp) {
+    assert(settings_synapse_initialized);
+    assert(lp->id >= settings_synapse.local_id_offset);
+
+    size_t const synapse_lp_id = lp->id - settings_synapse.local_id_offset;
+    assert(synapse_lp_id < (size_t) settings_synapse.num_synapse_lps_pe);
+
+    *synapseLP = settings_synapse.synapse_lps[synapse_lp_id];
+
+    for (int32_t i = 0; i < synapseLP->num_sources; i++) {
+        struct SynapseCollection * to_contact = &synapseLP->sources[i].to_contact;
+        for (int32_t j = 0; j < to_contact->num; j++) {
+            struct Synapse * synapse = &to_contact->synapses[j];
+            assert(synapse->delay != SYNAPSE_DELAY_RELAY);
+            synapse->delay_double = (synapse->delay - 0.5) * settings_synapse.beat;
+        }
+    }
+
+    synapseLP->accumulator = accumulates(synapseLP) ? new_accumulator(synapseLP) : NULL;
+
+    assert_valid_SynapseLP(synapseLP);
+}
+
+
+// Batches are sent between a quarter and half a heartbeat after the neuron
+// fired, `beat / 4 / num_batches` apart from each other. A spike in the last
+// batch is sent `beat / 4 / num_batches` before half a heartbeat, ie, its
+// offset is `(delay - 1) * beat + beat / 4 / num_batches`. Accumulated spikes
+// are sent in a single event, three eighths of a heartbeat after the neurons
+// fired (as if they were a single batch of half the spacing)
+double driver_synapse_lookahead(void) {
+    assert(settings_synapse_initialized);
+    double const beat = settings_synapse.beat;
+    double lookahead = beat;
+
+    for (int i = 0; i < settings_synapse.num_synapse_lps_pe; i++) {
+        struct SynapseLP const * synapseLP = &settings_synapse.synapse_lps[i];
+        for (int32_t j = 0; j < synapseLP->num_sources; j++) {
+            struct SynapseCollection const * to_contact =
+                &synapseLP->sources[j].to_contact;
+            int32_t const num_batches = settings_synapse.batch_size > 0
+                ? divceil_i32(to_contact->num, settings_synapse.batch_size) : 1;
+            double const spacing = accumulates(synapseLP)
+                ? beat / 8 : beat / 4 / num_batches;
+            lookahead = fmin(lookahead, spacing);
+            // Delays are converted into doubles at init
+            for (int32_t k = 0; k < to_contact->num; k++) {
+                uint16_t const delay = to_contact->synapses[k].delay;
+                lookahead = fmin(lookahead, (delay - 1) * beat + spacing);
+            }
+        }
+    }
+    return lookahead;
+}
+
+
+static inline struct RelayedSynapses *
+find_source(struct SynapseLP *synapseLP, uint64_t gid_from) {
+    int32_t low = 0;
+    int32_t high = synapseLP->num_sources - 1;
+    while (low <= high) {
+        int32_t const mid = low + (high - low) / 2;
+        uint64_t const gid_mid = synapseLP->sources[mid].gid_from;
+        if (gid_mid == gid_from) {
+            return &synapseLP->sources[mid];
+        } else if (gid_mid < gid_from) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return NULL;
+}
+
+
+static inline struct RelayedSynapses *
+find_source_of(struct SynapseLP *synapseLP, struct Message const *msg, struct tw_lp *lp) {
+    struct RelayedSynapses * const source = find_source(synapseLP, msg->neuron_from_gid);
+    if (source == NULL) {
+        tw_error(TW_LOC, "SynapseLP %" PRIu64 " holds no synapses for neuron "
+                "with GID %" PRIi64, lp->gid, msg->neuron_from_gid);
+    }
+    return source;
+}
+
+
+static inline double find_prev_heartbeat_index(double now) {
+    double intpart;
+    modf(now / settings_synapse.beat, &intpart);
+    return intpart;
+}
+
+
+static inline double find_prev_heartbeat_time(double now) {
+    return find_prev_heartbeat_index(now) * settings_synapse.beat;
+}
+
+
+static inline void send_next_batch(
+        struct Message const *msg, struct tw_lp *lp, int32_t next, double dt) {
+    struct tw_event * const event =
+        tw_event_new_user_prio(lp->gid, dt, lp, SPIKE_PRIORITY);
+    struct Message * const new_msg = tw_event_data(event);
+    initialize_Message(new_msg, MESSAGE_TYPE_spike);
+#ifndef NDEBUG
+    new_msg->neuron_from = msg->neuron_from;
+    new_msg->neuron_to = msg->neuron_to;
+    new_msg->neuron_to_gid = lp->gid;
+#endif
+    new_msg->neuron_from_gid = msg->neuron_from_gid;
+    new_msg->relay_next = next;
+    assert_valid_Message(new_msg);
+    tw_event_send(event);
+}
+
+
+// Accumulate mode. The spike from a source only marks that it fired in the
+// current heartbeat. The first spike in the heartbeat schedules the delivery
+// (a spike the SynapseLP sends to itself) once all sources have arrived. The
+// previous heartbeat in which the source fired is kept in a reverse-only field
+static inline void accumulate_spike(
+        struct SynapseLP *synapseLP,
+        struct tw_bf *bit_field,
+        struct Message *msg,
+        struct tw_lp *lp) {
+    struct SpikeAccumulator * const acc = synapseLP->accumulator;
+    struct RelayedSynapses const * const source = find_source_of(synapseLP, msg, lp);
+    int32_t const i = source - synapseLP->sources;
+    int64_t const beat = find_prev_heartbeat_index(tw_now(lp));
+
+    msg->prev_heartbeat = (double) acc->fired_at_beat[i];
+    acc->fired_at_beat[i] = beat;
+
+    bit_field->c0 = acc->flush_beat != beat;
+    msg->sent_by_synapse_lp = bit_field->c0;
+    if (bit_field->c0) {
+        acc->flush_beat = beat;
+        struct tw_event * const event = tw_event_new_user_prio(
+                lp->gid, settings_synapse.beat / 8, lp, SPIKE_PRIORITY);
+        struct Message * const new_msg = tw_event_data(event);
+        initialize_Message(new_msg, MESSAGE_TYPE_spike);
+#ifndef NDEBUG
+        new_msg->neuron_from = msg->neuron_from;
+        new_msg->neuron_to = msg->neuron_to;
+        new_msg->neuron_to_gid = lp->gid;
+#endif
+        new_msg->neuron_from_gid = lp->gid;
+        assert_valid_Message(new_msg);
+        tw_event_send(event);
+    }
+}
+
+static inline void reverse_accumulate_spike(
+        struct SynapseLP *synapseLP,
+        struct tw_bf *bit_field,
+        struct Message const *msg,
+        struct tw_lp *lp) {
+    struct SpikeAccumulator * const acc = synapseLP->accumulator;
+    struct RelayedSynapses const * const source = find_source_of(synapseLP, msg, lp);
+    acc->fired_at_beat[source - synapseLP->sources] = (int64_t) msg->prev_heartbeat;
+    // A delivery is scheduled for every heartbeat in which a source fired, so
+    // the last one scheduled is for the latest heartbeat any source fired in
+    if (bit_field->c0) {
+        int64_t latest = -1;
+        for (int32_t i = 0; i < synapseLP->num_sources; i++) {
+            if (acc->fired_at_beat[i] > latest) {
+                latest = acc->fired_at_beat[i];
+            }
+        }
+        acc->flush_beat = latest;
+    }
+}
+
+// Sends one spike per slot with the sum of the currents of all sources that
+// fired in the heartbeat. The state of the SynapseLP is not modified
+static inline void deliver_accumulated(
+        struct SynapseLP *synapseLP, struct Message *msg, struct tw_lp *lp) {
+    struct SpikeAccumulator * const acc = synapseLP->accumulator;
+    double const now = tw_now(lp);
+    int64_t const beat = find_prev_heartbeat_index(now);
+    double const sent_at = find_prev_heartbeat_time(now);
+
+    int32_t num_touched = 0;
+    for (int32_t i = 0; i < synapseLP->num_sources; i++) {
+        if (acc->fired_at_beat[i] != beat) {
+            continue;
+        }
+        struct SynapseCollection const * const to_contact =
+            &synapseLP->sources[i].to_contact;
+        int32_t const * const slot_of = &acc->slot_of[acc->first_synapse[i]];
+        for (int32_t j = 0; j < to_contact->num; j++) {
+            int32_t const slot = slot_of[j];
+            if (!acc->slot_touched[slot]) {
+                acc->slot_touched[slot] = true;
+                acc->slot_current[slot] = 0;
+                acc->touched[num_touched++] = slot;
+            }
+            acc->slot_current[slot] += to_contact->synapses[j].weight;
+        }
+    }
+
+    for (int32_t k = 0; k < num_touched; k++) {
+        int32_t const slot = acc->touched[k];
+        struct Synapse const * const synap = acc->slot_synapse[slot];
+        double const offset = sent_at + synap->delay_double - now;
+        assert(offset > 0);
+
+        struct tw_event * const event =
+            tw_event_new_user_prio(synap->gid_to_send, offset, lp, SPIKE_PRIORITY);
+        struct Message * const new_msg = tw_event_data(event);
+        initialize_Message(new_msg, MESSAGE_TYPE_spike);
+#ifndef NDEBUG
+        new_msg->neuron_from = msg->neuron_from;
+        new_msg->neuron_to = synap->doryta_id_to_send;
+        new_msg->neuron_to_gid = synap->gid_to_send;
+#endif
+        new_msg->neuron_from_gid = lp->gid;
+        new_msg->spike_current = acc->slot_current[slot];
+        assert_valid_Message(new_msg);
+        tw_event_send(event);
+
+        acc->slot_touched[slot] = false;
+    }
+    msg->sent_by_synapse_lp = num_touched;
+}
+
+
+// Forward event handler
+// A SynapseLP has no state to modify. It only translates one spike into many
+void driver_synapse_event(
+        struct SynapseLP *synapseLP,
+        struct tw_bf *bit_field,
+        struct Message *msg,
+        struct tw_lp *lp) {
+    (void) bit_field;
+    assert_valid_Message(msg);
+    assert(msg->type == MESSAGE_TYPE_spike);
+    assert((uint64_t) msg->neuron_to_gid == lp->gid);
+
+    if (synapseLP->accumulator != NULL) {
+        // The SynapseLP sends itself the spike that delivers the accumulated
+        // currents
+        if (msg->neuron_from_gid == (int64_t) lp->gid) {
+            deliver_accumulated(synapseLP, msg, lp);
+        } else {
+            accumulate_spike(synapseLP, bit_field, msg, lp);
+        }
+        msg->time_processed = tw_now(lp);
+        return;
+    }
+
+    struct RelayedSynapses const * const source = find_source_of(synapseLP, msg, lp);
+
+    // Neurons only fire on heartbeats, so the spike was sent at the previous
+    // heartbeat. The spikes are delivered as if they had been sent directly
+    // by the neuron
+    double const now = tw_now(lp);
+    double const sent_at = find_prev_heartbeat_time(now);
+
+    int32_t const num_synapses = source->to_contact.num;
+    int32_t const batch_size =
+        settings_synapse.batch_size > 0 ? settings_synapse.batch_size : num_synapses;
+    int32_t const first = msg->relay_next;
+    int32_t const last =
+        num_synapses - first > batch_size ? first + batch_size : num_synapses;
+    assert(first < num_synapses);
+
+    // The spike arrives a quarter heartbeat after it was sent. All batches
+    // are processed before half a heartbeat has passed, ie, before any
+    // synapse (with the shortest delay) has to be delivered
+    msg->sent_by_synapse_lp = last - first;
+    if (last < num_synapses) {
+        int32_t const num_batches = divceil_i32(num_synapses, batch_size);
+        send_next_batch(msg, lp, last, settings_synapse.beat / 4 / num_batches);
+        msg->sent_by_synapse_lp++;
+    }
+
+    for (int32_t i = first; i < last; i++) {
+        struct Synapse const * const synap = &source->to_contact.synapses[i];
+        double const offset = sent_at + synap->delay_double - now;
+        assert(offset > 0);
+
+        struct tw_event * const event =
+            tw_event_new_user_prio(synap->gid_to_send, offset, lp, SPIKE_PRIORITY);
+        struct Message * const new_msg = tw_event_data(event);
+        initialize_Message(new_msg, MESSAGE_TYPE_spike);
+#ifndef NDEBUG
+        new_msg->neuron_from = msg->neuron_from;
+        new_msg->neuron_to = synap->doryta_id_to_send;
+        new_msg->neuron_to_gid = synap->gid_to_send;
+#endif
+        new_msg->neuron_from_gid = msg->neuron_from_gid;
+        new_msg->spike_current = synap->weight;
+        assert_valid_Message(new_msg);
+        tw_event_send(event);
+    }
+
+    msg->time_processed = now;
+}
+
+
+// Reverse Event Handler
+// There is nothing to reverse, except for the sources accumulated. ROSS takes
+// care of cancelling sent spikes
+void driver_synapse_event_reverse(
+        struct SynapseLP *synapseLP,
+        struct tw_bf *bit_field,
+        struct Message *msg,
+        struct tw_lp *lp) {
+    if (synapseLP->accumulator != NULL && msg->neuron_from_gid != (int64_t) lp->gid) {
+        reverse_accumulate_spike(synapseLP, bit_field, msg, lp);
+    }
+    msg->time_processed = -1;
+}
+
+
+// Commit event handler
+void driver_synapse_event_commit(
+        struct SynapseLP *synapseLP,
+        struct tw_bf *bit_field,
+        struct Message *msg,
+        struct tw_lp *lp) {
+    (void) bit_field;
+    if (settings_synapse.probe_events != NULL) {
+        for (size_t i = 0; settings_synapse.probe_events[i] != NULL; i++) {
+            settings_synapse.probe_events[i](synapseLP, msg, lp);
+        }
+    }
+}
+
+
+void driver_synapse_final(struct SynapseLP *synapseLP, struct tw_lp *lp) {
+    (void) lp;
+    if (synapseLP->accumulator != NULL) {
+        free_accumulator(synapseLP->accumulator);
+        synapseLP->accumulator = NULL;
+    }
+}
@@ -0,0 +1,193 @@
+#ifndef DORYTA_DRIVER_SYNAPSE_H
+#define DORYTA_DRIVER_SYNAPSE_H
+
+/** @file
+ * Functions implementing a SynapseLP. A SynapseLP holds synapses on behalf of
+ * (possibly many) neurons. When one of those neurons fires, it sends a single
+ * spike to the SynapseLP, which in turn delivers the spike to all the
+ * synapses it holds for the neuron.
+ *
+ * Spikes are delivered in batches of (at most) `batch_size`. The SynapseLP
+ * sends the next batch to itself, spreading the batches between a quarter and
+ * half a heartbeat after the neuron fired (the spikes themselves are scheduled
+ * as if the neuron had sent them directly).
+ *
+ * In accumulate mode, a SynapseLP holding synapses of several neurons does not
+ * deliver spikes as they arrive. It adds up the currents of all neurons that
+ * fired in the same heartbeat which go to the same neuron with the same delay
+ * (one slot per pair of neuron and delay), and sends a single spike per slot.
+ */
+
+#include "neuron.h"
+
+/**
+ * All synapses from one neuron (the source) that a SynapseLP delivers.
+ *
+ * Invariants:
+ * - `to_contact` has to be valid (`num` == 0 iff `synapses` == NULL)
+ */
+struct RelayedSynapses {
+    uint64_t gid_from;
+    struct SynapseCollection to_contact;
+};
+
+/**
+ * Spikes accumulated by a SynapseLP (accumulate mode). All synapses with the
+ * same target neuron and delay share a slot. `fired_at_beat` and
+ * `flush_beat` are the state of the SynapseLP, everything else is either
+ * constant or scratch space used (and cleared) within a single event.
+ */
+struct SpikeAccumulator {
+    // Heartbeat (its index) in which each source fired last
+    int64_t * fired_at_beat;
+    // Heartbeat (its index) for which the delivery of spikes was scheduled
+    // last. It is always the largest value in `fired_at_beat`
+    int64_t flush_beat;
+    // Slot of each synapse. The synapses of source `i` start at
+    // `slot_of[first_synapse[i]]`
+    int32_t * first_synapse;
+    int32_t * slot_of;
+    int32_t num_slots;
+    // A synapse (target neuron and delay) for each slot
+    struct Synapse const ** slot_synapse;
+    // Scratch space. Current accumulated in each slot and slots touched
+    float * slot_current;
+    bool * slot_touched;
+    int32_t * touched;
+};
+
+/**
+ * Invariants:
+ * - `num_sources` is non-negative
+ * - `num_sources` == 0 iff `sources` == NULL
+ * - `sources` is sorted by `gid_from` and no `gid_from` is repeated
+ */
+struct SynapseLP {
+    int32_t num_sources;
+    struct RelayedSynapses * sources;
+    // Accumulate mode only, and only if the SynapseLP has several sources
+    struct SpikeAccumulator * accumulator;
+};
+
+static inline bool is_valid_SynapseLP(struct SynapseLP * synapseLP) {
+    if (synapseLP->num_sources < 0
+        || (synapseLP->num_sources == 0) != (synapseLP->sources == NULL)) {
+        return false;
+    }
+    for (int32_t i = 1; i < synapseLP->num_sources; i++) {
+        if (synapseLP->sources[i-1].gid_from >= synapseLP->sources[i].gid_from) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline void assert_valid_SynapseLP(struct SynapseLP * synapseLP) {
+#ifndef NDEBUG
+    assert(synapseLP->num_sources >= 0);
+    assert((synapseLP->num_sources == 0) == (synapseLP->sources == NULL));
+    for (int32_t i = 0; i < synapseLP->num_sources; i++) {
+        struct SynapseCollection const * const to_contact =
+            &synapseLP->sources[i].to_contact;
+        assert((to_contact->num == 0) == (to_contact->synapses == NULL));
+        if (i > 0) {
+            assert(synapseLP->sources[i-1].gid_from < synapseLP->sources[i].gid_from);
+        }
+    }
+#endif // NDEBUG
+}
+
+
+typedef void (*synapse_probe_event_f) (struct SynapseLP *, struct Message *, struct tw_lp *);
+
+/**
+ * General settings for all SynapseLPs in the PE. SynapseLPs are placed after
+ * the neurons in a PE, ie, the first SynapseLP has the local ID
+ * `local_id_offset`.
+ *
+ * Invariants:
+ * - `num_synapse_lps_pe` is non-negative
+ * - `synapse_lps` has `num_synapse_lps_pe` elements
+ * - `beat` is a positive number (and it is the same as the neurons' `beat`)
+ * - `batch_size` is non-negative
+ */
+struct SettingsSynapseLP {
+    /** Total number of SynapseLPs in this PE. */
+    int                  num_synapse_lps_pe;
+    /** Local ID of the first SynapseLP. */
+    size_t               local_id_offset;
+    /** Initial state of each SynapseLP in this PE. */
+    struct SynapseLP   * synapse_lps;
+    /** Heartbeat frequency of neurons. */
+    double               beat;
+    /** Maximum number of spikes to send in a single event. Zero means no
+     * limit. SynapseLPs that accumulate spikes send all of them at once. */
+    int32_t              batch_size;
+    /** If true, SynapseLPs with several sources accumulate spikes (check
+     * `struct SpikeAccumulator`). Neurons must be linear on their input
+     * current. */
+    bool                 accumulate;
+    /** A list of functions to call on every committed event (to record the
+     * computation). It can be NULL. The array must be NULL terminated. */
+    synapse_probe_event_f * probe_events;
+};
+
+static inline bool is_valid_SettingsSynapseLP(struct SettingsSynapseLP * settingsPE) {
+    return settingsPE->num_synapse_lps_pe >= 0
+        && (settingsPE->num_synapse_lps_pe == 0 || settingsPE->synapse_lps != NULL)
+        && settingsPE->beat > 0
+        && settingsPE->batch_size >= 0
+        && !isnan(settingsPE->beat)
+        && !isinf(settingsPE->beat);
+}
+
+static inline void assert_valid_SettingsSynapseLP(struct SettingsSynapseLP * settingsPE) {
+#ifndef NDEBUG
+    assert(settingsPE->num_synapse_lps_pe >= 0);
+    assert(settingsPE->num_synapse_lps_pe == 0 || settingsPE->synapse_lps != NULL);
+    assert(settingsPE->beat > 0);
+    assert(settingsPE->batch_size >= 0);
+    assert(!isnan(settingsPE->beat));
+    assert(!isinf(settingsPE->beat));
+#endif // NDEBUG
+}
+
+/** Setting global variables for the simulation. */
+void driver_synapse_config(struct SettingsSynapseLP *);
+
+/**
+ * Smallest time offset of the events sent by the SynapseLPs in this PE (ie, a
+ * safe lookahead for this PE under conservative synchronization). It must be
+ * called after `driver_synapse_config` and before the SynapseLPs are
+ * initialized.
+ */
+double driver_synapse_lookahead(void);
+
+/** SynapseLP initialization. */
+void driver_synapse_init(struct SynapseLP *synapseLP, struct tw_lp *lp);
+
+/** Forward event handler. */
+void driver_synapse_event(
+        struct SynapseLP *synapseLP,
+        struct tw_bf *bit_field,
+        struct Message *message,
+        struct tw_lp *lp);
+
+/** Reverse event handler. */
+void driver_synapse_event_reverse(
+        struct SynapseLP *synapseLP,
+        struct tw_bf *bit_field,
+        struct Message *message,
+        struct tw_lp *lp);
+
+/** Commit event handler. */
+void driver_synapse_event_commit(
+        struct SynapseLP *synapseLP,
+        struct tw_bf *bit_field,
+        struct Message *message,
+        struct tw_lp *lp);
+
+/** Cleaning before shut down. */
+void driver_synapse_final(struct SynapseLP *synapseLP, struct tw_lp *lp);
+
+#endif /* end of include guard */
@@ -1,6 +1,9 @@
 #include "master.h"
+#include "../utils/interval_index.h"
 #include "../utils/math.h"
 #include <ross.h>
+#include <limits.h>
+#include <string.h>
 
 #define MAX_NEURON_GROUPS 200
 #define MAX_SYNAPSE_GROUPS 2000
@@ -14,15 +17,35 @@ struct NeuronGroup {
     size_t total_pes;
     size_t global_neuron_offset;
 
+    // placement (see `group_tile`). The group is a stack of maps with
+    // `height` rows and `width` columns each, and each PE takes one tile
+    // of every map
+    size_t width;
+    size_t height;
+    size_t tiles_x;
+    size_t tiles_y;
+    // If not NULL, the columns are split at these `tiles_x + 1` positions
+    // (balancing the load of the PEs) instead of evenly
+    size_t * cuts;
+
     // local (PE) parameters
     size_t neurons_in_pe;
     size_t local_id_offset;
-    size_t doryta_id_offset;
 };
 
 enum CONNECTION_TYPE {
     CONNECTION_TYPE_all2all,
     CONNECTION_TYPE_conv2,
+    CONNECTION_TYPE_sparse,
+    CONNECTION_TYPE_one2one,
+};
+
+// Consecutive neurons (`num` of them, starting at column `first` of an
+// all2all group) whose GIDs are consecutive too, starting at `gid`
+struct GidRun {
+    int32_t first;
+    int32_t num;
+    uint64_t gid;
 };
 
 struct SynapseGroup {
@@ -31,8 +54,33 @@ struct SynapseGroup {
     int32_t from_end;
     int32_t to_start;
     int32_t to_end;
+    uint16_t delay; // in heartbeats
+    // Synapses are generated on fire, not stored (procedural conv2d or dense
+    // all2all groups)
+    bool procedural;
     union {
+        struct {  // conn_type == all2all
+            // NULL unless set by `layout_master_synapses_weights`. Row-major
+            // matrix with one row per neuron of `from` (all of them). It is
+            // not owned by the layout (eg, it is mapped from a file)
+            float const * matrix;
+            // Procedural only. Row-major matrix with one row (of `to_end -
+            // to_start + 1` weights) per neuron of `from` in this PE (unless
+            // `matrix` is given)
+            float * weights;
+            size_t first_row; // LocalID of the neuron in the first row
+            struct GidRun * gid_runs;
+            int32_t num_gid_runs;
+        };
         struct {  // conn_type == conv2
+            // NULL unless set by `layout_master_synapses_kernel`. It holds
+            // one `kernel_height * kernel_width` matrix per pair of channels
+            // (input channel major)
+            float * kernel;
+            // Each channel is a map of `width * height` neurons, and the maps
+            // of a layer are stored one after the other
+            int from_channels;
+            int to_channels;
             int from_width;
             int from_height;
             int to_width;
@@ -44,6 +92,24 @@ struct SynapseGroup {
             int padding_width;
             int padding_height;
         };
+        struct {  // conn_type == sparse
+            // Compressed sparse rows. Neuron `from_start + i` connects to
+            // `to_start + col_idx[k]` for every `k` in `[row_ptr[i],
+            // row_ptr[i+1])`, with weight `values[k]` (if not NULL). The rows
+            // are only kept until the synapses are stored (in init)
+            int32_t * row_ptr;
+            int32_t * col_idx;
+            float * values;
+        };
+        struct {  // conn_type == one2one
+            // Neuron `from_start + i` connects to `to_start + i` with weight
+            // `pair_weights[i]` (if not NULL). Kept only until init
+            float * pair_weights;
+            // Weights of the neurons of `from` in this PE (procedural only),
+            // by LocalID (starting at `first_pair`)
+            float * local_weights;
+            size_t first_pair;
+        };
     };
 };
 
@@ -55,23 +121,94 @@ static struct NeuronGroup neuron_groups[MAX_NEURON_GROUPS];
 static int32_t            max_num_neurons_per_pe = 0;
 static int32_t            total_neurons_globally = 0;
 static int32_t            total_neurons_in_pe = 0;
+// GIDs in a PE start at `pe * max_num_lps_per_pe`. Neurons come first,
+// supporting LPs (SynapseLPs) are placed right after them
+static int32_t            max_num_lps_per_pe = 0;
+static int32_t            support_lps_in_pe = 0;
 
 // Parameters that define synapse connections
 static int                 num_synap_groups = 0;
 static struct SynapseGroup synapse_groups[MAX_SYNAPSE_GROUPS];
 static size_t              total_synapses = 0; // total synapses in PE
+// Groups whose synapses are generated (`procedural`), in order of definition
+static int                 num_procedural_groups = 0;
+static int                 procedural_groups[MAX_SYNAPSE_GROUPS];
+// Synapse groups (in order of definition) in which each neuron is in `from`.
+// Built by `layout_master_init`
+static struct IntervalIndex from_index = {0};
+
+// Options set before the layout is initialized
+static struct LayoutMasterOptions options = {0};
 
 // Allocation variables
 static bool                     initialized = false;
+// Multicast and relays wait until the model has set the weights of the
+// synapses (see `layout_master_synapses_loaded`)
+static bool                     support_lps_pending = false;
 static struct Synapse           * naked_synapses = NULL;
 static char                     * naked_neurons = NULL;
 // The two below is what we pass to SettingsNeuronLP
 static void                    ** neurons = NULL; // In simulation time this ends up never been used, just in initialization
 static struct SynapseCollection * synapses = NULL;
 
+// Prefix table (built by `layout_master_init`) with one row per PE. The entry
+// `level` of a row is the number of neurons in the PE that belong to the
+// groups before `level`, ie, the local ID of the first neuron of the group in
+// the PE. The last entry of the row (`num_neuron_groups`) is the total number
+// of neurons in the PE. The row is sorted, so the group of a LocalID is found
+// by binary search (O(log groups)). A constant-time lookup would take one entry
+// per neuron
+static int32_t                  * local_offsets = NULL;
+
 // To be used for "linear" mapping
 static uint64_t pe_gid_offset;
 
+// SynapseLPs in this PE. If multicast is on, the first SynapseLP is in charge
+// of multicast, the rest (if any) are relays for neurons with large fan-out
+static struct SynapseLP       * synapse_lps = NULL;
+static int32_t                  num_relays_in_pe = 0;
+static int32_t                  max_num_relays_per_pe = 0;
+// Multicast. Synapses delivered by the multicast SynapseLP and synapses of
+// neurons in the PE (one per PE they connect to)
+static struct RelayedSynapses * multicast_sources = NULL;
+static struct Synapse         * multicast_synapses = NULL;
+static struct Synapse         * multicast_neuron_synapses = NULL;
+// Compact (structure of arrays) store of the synapses of neurons in the PE,
+// built by `layout_master_compact_synapses`. The synapses of a neuron are
+// grouped by the PE they go to. Neuron `i` owns the segments from
+// `compact_segments_start[i]` to `compact_segments_start[i+1]` (exclusive),
+// and the synapses from `compact_synapses_start[i]`. A synapse is stored as
+// the LocalID of its destination (within the PE of the segment), its weight
+// and its delay. Delays are not stored if all of them are one heartbeat
+struct PeSegment {
+    uint32_t pe;
+    uint32_t num;
+};
+static bool               compacted = false;
+static size_t           * compact_synapses_start = NULL;
+static size_t           * compact_segments_start = NULL;
+static struct PeSegment * compact_segments = NULL;
+static uint32_t         * compact_local_ids = NULL;
+static float            * compact_weights = NULL;
+static uint16_t         * compact_delays = NULL;
+// Synapses of procedural groups with a weight (in absolute value) not larger
+// than this are not generated. Negative means no pruning
+static float                    prune_threshold = -1;
+// Relays. One source per relay, and the synapse from a neuron to its relay
+static struct RelayedSynapses * relay_sources = NULL;
+static struct Synapse         * relay_links = NULL;
+
+
+void layout_master_set_options(struct LayoutMasterOptions const * options_in) {
+    assert(!initialized);
+    if ((options_in->procedural_conv2d || options_in->dense_all2all)
+            && (options_in->multicast || options_in->relay_fanout > 0)) {
+        tw_error(TW_LOC, "Procedural conv2d and dense all2all groups cannot be "
+                "combined with multicast or relays");
+    }
+    options = *options_in;
+}
+
 
 int32_t layout_master_neurons(
         int32_t total_neurons, unsigned long initial_pe, unsigned long final_pe) {
@@ -88,32 +225,15 @@ int32_t layout_master_neurons(
     // later case, the layout spands a total of 31 PEs, starting from a
     // position at the tail of the PE ID numbering and continuing from the
     // start.
-    size_t const my_pe = g_tw_mynode;
     size_t const max_pes = tw_nnodes();
     size_t const total_pes = initial_pe <= final_pe ?
         final_pe - initial_pe + 1
         : max_pes - (initial_pe - final_pe - 1);
-    bool const pe_inside_range = initial_pe <= final_pe ?
-        initial_pe <= my_pe && my_pe <= final_pe
-        : initial_pe <= my_pe || my_pe <= final_pe;
-    size_t const index_within_range = initial_pe <= my_pe ?
-        my_pe - initial_pe
-        : my_pe + (max_pes - initial_pe);
-    // The reminder neurons appear when the total number of neurons cannot be
-    // divided exactly in the number of PEs. To balance the number of neurons
-    // per PE we give an additional neuron to the first `total_neurons %
-    // total_pes` PEs
-    size_t const remainder_neurons = total_neurons % total_pes;
-    size_t const neurons_in_pe =
-        pe_inside_range ?
-        total_neurons / total_pes + (index_within_range < remainder_neurons)
-        : 0;
-    size_t const doryta_id_offset =
-        total_neurons_globally
-        + index_within_range * (total_neurons / total_pes)
-        + (index_within_range < remainder_neurons ?
-                index_within_range : remainder_neurons);
 
+    // By default, the group is a single row cut into one tile per PE, ie,
+    // each PE gets a range of consecutive neurons. Where neurons are placed
+    // (in this PE) is found once all groups have been defined, by
+    // `layout_master_init`
     neuron_groups[num_neuron_groups] = (struct NeuronGroup){
         .num_neurons = total_neurons,
         .initial_pe = initial_pe,
@@ -121,24 +241,16 @@ int32_t layout_master_neurons(
         .total_pes = total_pes,
         .global_neuron_offset = total_neurons_globally,
 
-        .neurons_in_pe = neurons_in_pe,
-        .local_id_offset = total_neurons_in_pe,
-        .doryta_id_offset = doryta_id_offset,
-        //.gid_offset = -1,
+        .width = total_neurons,
+        .height = 1,
+        .tiles_x = total_pes,
+        .tiles_y = 1,
     };
     num_neuron_groups++;
 
-    max_num_neurons_per_pe += ceil((double) total_neurons / total_pes);
-    total_neurons_in_pe += neurons_in_pe;
     size_t const to_ret = total_neurons_globally;
     total_neurons_globally += total_neurons;
 
-    /*
-     *printf("PE %lu - total neurons %lu - neurons in pe %lu - offset %lu "
-     *        "- total_neurons_globally = %lu\n",
-     *        g_tw_mynode, total_neurons, neurons_in_pe, doryta_id_offset,
-     *        total_neurons_globally);
-     */
     return to_ret;
 }
 
@@ -150,13 +262,391 @@ struct NeuronGroupInfo layout_master_info_latest_group(void) {
     };
 }
 
+// ========================== PLACEMENT ==========================
+//
+// A neuron group is a stack of maps, each with `height` rows and `width`
+// columns (the DorytaIDs of a map are consecutive, row after row). The rows
+// of a map are split into `tiles_y` bands and the columns into `tiles_x`
+// bands. The i-th PE in the range of the group takes the tile at band
+// `i / tiles_x` (rows) and band `i % tiles_x` (columns) of every map. Within
+// a PE, the neurons of a group are sorted by DorytaID, so that increasing the
+// LocalID also increases the DorytaID.
+
+// First element of band `band` when splitting `size` elements into `bands`
+// bands. To balance the bands, the first `size % bands` bands get an
+// additional element
+static inline size_t band_start(size_t band, size_t size, size_t bands) {
+    size_t const remainder = size % bands;
+    return band * (size / bands) + (band < remainder ? band : remainder);
+}
+
+// Band in which element `index` falls (inverse of `band_start`)
+static inline size_t band_of(size_t index, size_t size, size_t bands) {
+    size_t const per_band = size / bands;
+    size_t const remainder = size % bands;
+    size_t const within_remainder_bands = (per_band + 1) * remainder;
+    if (index < within_remainder_bands) {
+        return index / (per_band + 1);
+    }
+    return remainder + (index - within_remainder_bands) / per_band;
+}
+
+// First column of band `band` of the group
+static inline size_t group_col_start(struct NeuronGroup const * group, size_t band) {
+    if (group->cuts != NULL) {
+        return group->cuts[band];
+    }
+    return band_start(band, group->width, group->tiles_x);
+}
+
+// Band of the group in which column `col` falls
+static inline size_t group_col_band(struct NeuronGroup const * group, size_t col) {
+    if (group->cuts == NULL) {
+        return band_of(col, group->width, group->tiles_x);
+    }
+    // Last band starting at or before `col` (empty bands are skipped)
+    size_t low = 0;
+    size_t high = group->tiles_x - 1;
+    while (low < high) {
+        size_t const mid = low + (high - low + 1) / 2;
+        if (group->cuts[mid] <= col) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+// Position of `pe` within the range of PEs of the group. Returns false if the
+// PE is not in the range
+static inline bool group_pe_index(
+        struct NeuronGroup const * group, size_t pe, size_t * index) {
+    size_t const max_pes = tw_nnodes();
+    size_t const initial_pe = group->initial_pe;
+    size_t const final_pe = group->final_pe;
+
+    *index = initial_pe <= pe ? pe - initial_pe : pe + (max_pes - initial_pe);
+    return initial_pe <= final_pe ?
+        initial_pe <= pe && pe <= final_pe
+        : initial_pe <= pe || pe <= final_pe;
+}
+
+struct Tile {
+    size_t row;
+    size_t num_rows;
+    size_t col;
+    size_t num_cols;
+};
+
+// Tile of the maps of the group taken by the `index`-th PE of its range
+static inline struct Tile group_tile(struct NeuronGroup const * group, size_t index) {
+    size_t const band_y = index / group->tiles_x;
+    size_t const band_x = index % group->tiles_x;
+    size_t const row = band_start(band_y, group->height, group->tiles_y);
+    size_t const col = group_col_start(group, band_x);
+    return (struct Tile) {
+        .row = row,
+        .num_rows = band_start(band_y + 1, group->height, group->tiles_y) - row,
+        .col = col,
+        .num_cols = group_col_start(group, band_x + 1) - col,
+    };
+}
+
+// Number of neurons of group `level` in `pe`
+static size_t group_neurons_in_pe(int level, size_t pe) {
+    struct NeuronGroup const * const group = &neuron_groups[level];
+    size_t index;
+    if (!group_pe_index(group, pe, &index)) {
+        return 0;
+    }
+    struct Tile const tile = group_tile(group, index);
+    size_t const num_maps = group->num_neurons / (group->width * group->height);
+    return num_maps * tile.num_rows * tile.num_cols;
+}
+
+// DorytaID of the `j`-th neuron of group `level` in `pe`
+static int32_t group_doryta_id_in_pe(int level, size_t pe, size_t j) {
+    struct NeuronGroup const * const group = &neuron_groups[level];
+    size_t index;
+#ifndef NDEBUG
+    bool const pe_inside_range =
+#endif
+    group_pe_index(group, pe, &index);
+    assert(pe_inside_range);
+    struct Tile const tile = group_tile(group, index);
+
+    size_t const tile_size = tile.num_rows * tile.num_cols;
+    size_t const map = j / tile_size;
+    size_t const row = tile.row + (j % tile_size) / tile.num_cols;
+    size_t const col = tile.col + (j % tile_size) % tile.num_cols;
+    return group->global_neuron_offset
+        + (map * group->height + row) * group->width + col;
+}
+
+// PE in which the neuron `doryta_id` (from group `level`) lives. `j` is set to
+// the position of the neuron among the neurons of the group in the PE
+static size_t group_locate(int level, int32_t doryta_id, size_t * j) {
+    struct NeuronGroup const * const group = &neuron_groups[level];
+    size_t const id_within_level = doryta_id - group->global_neuron_offset;
+    size_t const map_size = group->width * group->height;
+    size_t const map = id_within_level / map_size;
+    size_t const row = (id_within_level % map_size) / group->width;
+    size_t const col = id_within_level % group->width;
+
+    size_t const index =
+        band_of(row, group->height, group->tiles_y) * group->tiles_x
+        + group_col_band(group, col);
+    struct Tile const tile = group_tile(group, index);
+
+    *j = (map * tile.num_rows + (row - tile.row)) * tile.num_cols + (col - tile.col);
+    return (group->initial_pe + index) % tw_nnodes();
+}
+
+// Number of neurons of group `level` in `pe` with a DorytaID smaller than
+// `doryta_id`. As the neurons in the PE are sorted, the neurons within a range
+// of DorytaIDs are the ones between two calls to this function
+static size_t group_neurons_in_pe_before(int level, size_t pe, int32_t doryta_id) {
+    size_t low = 0;
+    size_t high = group_neurons_in_pe(level, pe);
+    while (low < high) {
+        size_t const mid = low + (high - low) / 2;
+        if (group_doryta_id_in_pe(level, pe, mid) < doryta_id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Group in which `doryta_id` resides (groups are sorted by DorytaID)
+static int group_of_doryta_id(int32_t doryta_id) {
+    int level = 0;
+    int high = num_neuron_groups - 1;
+    while (level < high) {
+        int const mid = level + (high - level + 1) / 2;
+        if ((int32_t) neuron_groups[mid].global_neuron_offset <= doryta_id) {
+            level = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return level;
+}
+
+// Records that the neurons from `start` on are a map (of `width` by `height`).
+// `widths[level]` is zero if no map has been found for the group, and
+// `SIZE_MAX` if the maps found for it do not agree
+static void found_map(int32_t start, size_t width, size_t height,
+        size_t * widths, size_t * heights) {
+    int const level = group_of_doryta_id(start);
+    size_t const map_size = width * height;
+    bool const aligned =
+        (start - neuron_groups[level].global_neuron_offset) % map_size == 0
+        && neuron_groups[level].num_neurons % map_size == 0;
+
+    if (widths[level] == 0 && aligned) {
+        widths[level] = width;
+        heights[level] = height;
+    } else if (!aligned || widths[level] != width || heights[level] != height) {
+        widths[level] = SIZE_MAX;
+    }
+}
+
+/** Cuts the maps of the groups connected by conv2d groups into tiles. A
+ * conv2d synapse connects neurons that are close to each other in their maps,
+ * so the fewer rows and columns the cuts between tiles go through, the fewer
+ * spikes cross PEs. Groups with the same shape (and range of PEs) are cut in
+ * the same way, ie, matching tiles of consecutive conv2d layers are placed in
+ * the same PE. Groups whose shape cannot be told (or with too many PEs for
+ * their maps) keep the default placement.
+ */
+static void master_tile_groups(void) {
+    size_t widths[MAX_NEURON_GROUPS] = {0};
+    size_t heights[MAX_NEURON_GROUPS] = {0};
+    for (int i = 0; i < num_synap_groups; i++) {
+        struct SynapseGroup const * const group = &synapse_groups[i];
+        if (group->conn_type == CONNECTION_TYPE_conv2) {
+            found_map(group->from_start, group->from_width, group->from_height,
+                    widths, heights);
+            found_map(group->to_start, group->to_width, group->to_height,
+                    widths, heights);
+        }
+    }
+
+    for (int level = 0; level < num_neuron_groups; level++) {
+        if (widths[level] == 0 || widths[level] == SIZE_MAX) {
+            continue;
+        }
+        struct NeuronGroup * const group = &neuron_groups[level];
+        size_t const width = widths[level];
+        size_t const height = heights[level];
+        size_t const total_pes = group->total_pes;
+
+        // Picking the grid of tiles with the shortest cuts
+        size_t best_tiles_x = 0;
+        size_t best_cut = SIZE_MAX;
+        for (size_t tiles_x = 1; tiles_x <= total_pes; tiles_x++) {
+            size_t const tiles_y = total_pes / tiles_x;
+            if (total_pes % tiles_x != 0 || tiles_x > width || tiles_y > height) {
+                continue;
+            }
+            size_t const cut = (tiles_y - 1) * width + (tiles_x - 1) * height;
+            if (cut < best_cut) {
+                best_cut = cut;
+                best_tiles_x = tiles_x;
+            }
+        }
+
+        if (best_tiles_x > 0) {
+            group->width = width;
+            group->height = height;
+            group->tiles_x = best_tiles_x;
+            group->tiles_y = total_pes / best_tiles_x;
+        }
+    }
+}
+
+/** Splits the groups that are a single row (ie, not placed in tiles) into
+ * ranges with (about) the same load, one per PE. A range ends once its load
+ * is the closest to its share of the load of the group.
+ */
+static void master_balance_loads(void) {
+    if (options.num_neuron_loads != total_neurons_globally) {
+        tw_error(TW_LOC, "There are loads for %" PRIi32 " neurons but the model "
+                "has %" PRIi32 " neurons", options.num_neuron_loads,
+                total_neurons_globally);
+    }
+
+    for (int level = 0; level < num_neuron_groups; level++) {
+        struct NeuronGroup * const group = &neuron_groups[level];
+        if (group->height != 1 || group->width != group->num_neurons) {
+            continue;
+        }
+        double const * const loads = &options.neuron_loads[group->global_neuron_offset];
+        size_t const total_pes = group->total_pes;
+
+        double total_load = 0;
+        for (size_t i = 0; i < group->num_neurons; i++) {
+            total_load += loads[i];
+        }
+        if (total_load <= 0) {
+            continue;
+        }
+
+        group->cuts = malloc((total_pes + 1) * sizeof(size_t));
+        if (group->cuts == NULL) {
+            tw_error(TW_LOC, "Not able to allocate space for the placement of neurons");
+        }
+        group->cuts[0] = 0;
+        size_t i = 0;
+        double load_before_i = 0; // load of the neurons before `i`
+        for (size_t band = 1; band < total_pes; band++) {
+            double const target = total_load * band / total_pes;
+            while (i < group->num_neurons && load_before_i + loads[i] <= target) {
+                load_before_i += loads[i];
+                i++;
+            }
+            // Including neuron `i` might get the range closer to its share
+            if (i < group->num_neurons
+                    && load_before_i + loads[i] - target < target - load_before_i) {
+                load_before_i += loads[i];
+                i++;
+            }
+            group->cuts[band] = i;
+        }
+        group->cuts[total_pes] = group->num_neurons;
+    }
+}
+
+/** Finds how many neurons of each group live in this PE and the largest
+ * number of neurons any PE can get. */
+static void master_place_neurons(void) {
+    total_neurons_in_pe = 0;
+    max_num_neurons_per_pe = 0;
+    for (int level = 0; level < num_neuron_groups; level++) {
+        struct NeuronGroup * const group = &neuron_groups[level];
+        group->neurons_in_pe = group_neurons_in_pe(level, g_tw_mynode);
+        group->local_id_offset = total_neurons_in_pe;
+        total_neurons_in_pe += group->neurons_in_pe;
+
+        size_t const num_maps = group->num_neurons / (group->width * group->height);
+        size_t largest_tile = 0;
+        for (size_t index = 0; index < group->total_pes; index++) {
+            struct Tile const tile = group_tile(group, index);
+            if (tile.num_rows * tile.num_cols > largest_tile) {
+                largest_tile = tile.num_rows * tile.num_cols;
+            }
+        }
+        max_num_neurons_per_pe += num_maps * largest_tile;
+    }
+}
+
+
+static void master_tile_groups(void);
+static void master_balance_loads(void);
+static void master_place_neurons(void);
+static void master_count_synapses(void);
+static void master_build_local_offsets(void);
+static void master_count_relays(void);
 static void master_allocate(int sizeof_neuron);
 static void master_init_neurons(neuron_init_f, synapse_init_f);
+static void master_init_dense(synapse_init_f);
+static void master_init_one2one(synapse_init_f);
+static void master_init_relays(void);
+static void master_init_multicast(void);
+static void master_build_from_index(void);
 
 void layout_master_init(int sizeof_neuron,
         neuron_init_f neuron_init, synapse_init_f synapse_init) {
+    for (int i = 0; i < num_procedural_groups; i++) {
+        struct SynapseGroup const * const group = &synapse_groups[procedural_groups[i]];
+        if (group->conn_type == CONNECTION_TYPE_conv2 && group->kernel == NULL) {
+            tw_error(TW_LOC, "The procedural conv2d group %d has no kernel",
+                    procedural_groups[i]);
+        }
+        if (group->conn_type == CONNECTION_TYPE_one2one
+                && (options.multicast || options.relay_fanout > 0)) {
+            tw_error(TW_LOC, "The options of the layout must be set before "
+                    "defining the one2one group %d", procedural_groups[i]);
+        }
+    }
+    master_build_from_index();
+    if (options.tiled_placement) {
+        master_tile_groups();
+    }
+    if (options.neuron_loads != NULL) {
+        master_balance_loads();
+    }
+    master_place_neurons();
+    master_count_synapses();
+    master_build_local_offsets();
+    if (options.relay_fanout > 0) {
+        master_count_relays();
+    }
     master_allocate(sizeof_neuron);
     master_init_neurons(neuron_init, synapse_init);
+    if (options.dense_all2all) {
+        master_init_dense(synapse_init);
+    }
+    master_init_one2one(synapse_init);
+    support_lps_pending = options.multicast || options.relay_fanout > 0;
+    // Sparse and one2one groups are stored (or one2one weights taken) by now
+    for (int i = 0; i < num_synap_groups; i++) {
+        struct SynapseGroup * const group = &synapse_groups[i];
+        if (group->conn_type == CONNECTION_TYPE_sparse) {
+            free(group->row_ptr);
+            free(group->col_idx);
+            free(group->values);
+            group->row_ptr = NULL;
+            group->col_idx = NULL;
+            group->values = NULL;
+        } else if (group->conn_type == CONNECTION_TYPE_one2one) {
+            free(group->pair_weights);
+            group->pair_weights = NULL;
+        }
+    }
 }
 
 
@@ -187,7 +677,17 @@ static void master_allocate(int sizeof_neuron) {
             (void*) & naked_neurons[i*sizeof_neuron];
     }
 
-    pe_gid_offset = g_tw_mynode * max_num_neurons_per_pe;
+    support_lps_in_pe = (options.multicast ? 1 : 0) + num_relays_in_pe;
+    max_num_lps_per_pe = max_num_neurons_per_pe
+        + (options.multicast ? 1 : 0) + max_num_relays_per_pe;
+    pe_gid_offset = g_tw_mynode * max_num_lps_per_pe;
+
+    if (support_lps_in_pe > 0) {
+        synapse_lps = calloc(support_lps_in_pe, sizeof(struct SynapseLP));
+        if (synapse_lps == NULL) {
+            tw_error(TW_LOC, "Not able to allocate space for SynapseLPs");
+        }
+    }
 
     // Custom Mapping
     g_tw_mapping = CUSTOM;
@@ -208,6 +708,9 @@ static void master_allocate(int sizeof_neuron) {
 struct SynapseIterator {
     int32_t doryta_id;
     int n_group;
+    /** Groups that `doryta_id` belongs to and haven't been visited yet */
+    int32_t const * groups_left;
+    int32_t num_groups_left;
     /** A DorytaID to which the current (`doryta_id`) neuron points */
     int32_t to_id;
     /** This is just another value to be returned by the iterator. The idea is
@@ -219,8 +722,9 @@ struct SynapseIterator {
      * [0, 1, 2, 3,
      *  4, 5, 6, 7,
      *  8, 9, 10, 11]
-     * These values can later be used to determine the weights that should go
-     * in a particular connection.
+     * (plus 12 times the index of the pair of channels, if the group has
+     * several). These values can later be used to determine the weights that
+     * should go in a particular connection.
      **/
     int32_t conn_parameter;
 
@@ -234,6 +738,12 @@ struct SynapseIterator {
             int synapses_height;
             int output_x_last;
             int output_y_last;
+            int channel_in; // channel of doryta_id
+            int channel_out; // channel of to_id
+        };
+        struct {  // synapse_groups[n_group].conn_type == CONNECTION_TYPE_sparse
+            int32_t k; // position of `to_id` in `col_idx`
+            int32_t k_end;
         };
     };
 };
@@ -250,10 +760,31 @@ static inline bool in_group_next_id(struct SynapseIterator * iter) {
     if (synapse_groups[iter->n_group].conn_type == CONNECTION_TYPE_all2all) {
         iter->to_id++;
         return iter->to_id <= synapse_groups[iter->n_group].to_end;
+    } else if (synapse_groups[iter->n_group].conn_type == CONNECTION_TYPE_one2one) {
+        // There is only one synapse
+        return false;
+    } else if (synapse_groups[iter->n_group].conn_type == CONNECTION_TYPE_sparse) {
+        struct SynapseGroup const * const params = &synapse_groups[iter->n_group];
+        iter->k++;
+        if (iter->k >= iter->k_end) {
+            return false;
+        }
+        iter->to_id = params->to_start + params->col_idx[iter->k];
+        // The weight of the synapse is found at the same position
+        iter->conn_parameter = iter->k;
+        return true;
     } else { // conn_type == CONNECTION_TYPE_conv2
         assert(synapse_groups[iter->n_group].conn_type == CONNECTION_TYPE_conv2);
         struct SynapseGroup const * const params = &synapse_groups[iter->n_group];
 
+        // The same position in the next output channel
+        if (iter->channel_out + 1 < params->to_channels) {
+            iter->channel_out++;
+            iter->to_id += params->to_width * params->to_height;
+            iter->conn_parameter += params->kernel_width * params->kernel_height;
+            return true;
+        }
+
         bool found = false;
         // We traverse the kernel matrix one element at the time and check
         // whether the given pixel would be within the output layer or not. If
@@ -272,9 +803,13 @@ static inline bool in_group_next_id(struct SynapseIterator * iter) {
                     + (iter->synapses_width - iter->j - 1) * params->stride_width;
                 int32_t const ker_x = (iter->input_x + params->padding_height) % params->stride_height
                     + (iter->synapses_height - iter->i - 1) * params->stride_height;
-                iter->conn_parameter = ker_x * params->kernel_width + ker_y;
+                iter->conn_parameter =
+                    iter->channel_in * params->to_channels
+                        * params->kernel_width * params->kernel_height
+                    + ker_x * params->kernel_width + ker_y;
 
                 iter->to_id = params->to_start + params->to_width * output_x + output_y;
+                iter->channel_out = 0;
                 found = true;
             }
 
@@ -288,6 +823,18 @@ static inline bool in_group_next_id(struct SynapseIterator * iter) {
         return found;
     }
 }
+/** Range of outputs (along one axis) that an input neuron at position `input`
+ * connects to in a conv2d group. The range goes from `*last - *num + 1` to
+ * `*last`, and some of its elements might fall outside of the output layer.
+ */
+static inline void conv2d_outputs_along_axis(
+        int input, int padding, int stride, int kernel, int * num, int * last) {
+    // Stride important computations
+    int mod_stride = (input + padding) % stride;
+    mod_stride += mod_stride < 0 ? stride : 0;  // Making it positive!
+    *num = divceil_i32(kernel - mod_stride, stride);
+    *last = (input + padding) / stride;
+}
 /** Sets up initial conditions to allow "yielder"/producer loop, and it MUST
  * set up initial DorytaID in to_id.
  */
@@ -295,28 +842,41 @@ static inline bool in_group_first_id(struct SynapseIterator * iter) {
     if (synapse_groups[iter->n_group].conn_type == CONNECTION_TYPE_all2all) {
         iter->to_id = synapse_groups[iter->n_group].to_start;
         return true;
+    } else if (synapse_groups[iter->n_group].conn_type == CONNECTION_TYPE_one2one) {
+        struct SynapseGroup const * const params = &synapse_groups[iter->n_group];
+        iter->conn_parameter = iter->doryta_id - params->from_start;
+        iter->to_id = params->to_start + iter->conn_parameter;
+        return true;
+    } else if (synapse_groups[iter->n_group].conn_type == CONNECTION_TYPE_sparse) {
+        struct SynapseGroup const * const params = &synapse_groups[iter->n_group];
+        int32_t const row = iter->doryta_id - params->from_start;
+        // A row might be empty, ie, the neuron connects to nothing
+        iter->k = params->row_ptr[row] - 1;
+        iter->k_end = params->row_ptr[row + 1];
+        return in_group_next_id(iter);
     } else { // conn_type == CONNECTION_TYPE_conv2
         assert(synapse_groups[iter->n_group].conn_type == CONNECTION_TYPE_conv2);
 
         struct SynapseGroup const * const params = &synapse_groups[iter->n_group];
-        int32_t const shifted = iter->doryta_id - params->from_start;
+        int32_t const map_size = params->from_width * params->from_height;
+        int32_t const shifted = (iter->doryta_id - params->from_start) % map_size;
+        iter->channel_in = (iter->doryta_id - params->from_start) / map_size;
         iter->input_x = shifted / params->from_width;
         iter->input_y = shifted % params->from_width;
 
-        // Stride important computations
-        int32_t y_mod_stride = (iter->input_y + params->padding_width) % params->stride_width;
-        y_mod_stride += y_mod_stride < 0 ? params->stride_width : 0;  // Making it positive!
-        int32_t x_mod_stride = (iter->input_x + params->padding_height) % params->stride_height;
-        x_mod_stride += x_mod_stride < 0 ? params->stride_height : 0;  // Making it positive!
-        iter->synapses_width = divceil_i32(params->kernel_width - y_mod_stride, params->stride_width);
-        iter->synapses_height = divceil_i32(params->kernel_height - x_mod_stride, params->stride_height);
-
-        iter->output_y_last = (iter->input_y + params->padding_width) / params->stride_width;
-        iter->output_x_last = (iter->input_x + params->padding_height) / params->stride_height;
-        // End of stride important computations
+        conv2d_outputs_along_axis(iter->input_y, params->padding_width,
+                params->stride_width, params->kernel_width,
+                &iter->synapses_width, &iter->output_y_last);
+        conv2d_outputs_along_axis(iter->input_x, params->padding_height,
+                params->stride_height, params->kernel_height,
+                &iter->synapses_height, &iter->output_x_last);
 
-        iter->i = 0;
+        // If the stride is larger than the kernel, an input might connect to
+        // no output at all (along either axis)
+        iter->i = iter->synapses_width > 0 ? 0 : iter->synapses_height;
         iter->j = 0;
+        // No output channel to move on to before the first position is found
+        iter->channel_out = params->to_channels;
         return in_group_next_id(iter);
     }
 }
@@ -337,12 +897,18 @@ static inline int32_t synapse_iter_next(struct SynapseIterator * iter, int32_t *
     if (!found_next_within_group) {
         // Finding next level where `doryta_id` appears in "from" interval
         bool found = false;
-        while (!found && ++iter->n_group < num_synap_groups) {
-            if (synapse_groups[iter->n_group].from_start <= iter->doryta_id
-             && iter->doryta_id <= synapse_groups[iter->n_group].from_end) {
+        while (!found && iter->num_groups_left > 0) {
+            iter->n_group = *iter->groups_left;
+            iter->groups_left++;
+            iter->num_groups_left--;
+            // The synapses of procedural groups are not stored
+            if (!synapse_groups[iter->n_group].procedural) {
                 found = in_group_first_id(iter);
             }
         }
+        if (!found) {
+            iter->n_group = num_synap_groups;
+        }
     }
     return toret;
 }
@@ -350,6 +916,7 @@ static inline void synapse_iter_init(struct SynapseIterator * iter, int32_t dory
     // Finding first level where `doryta_id` appears in "from" interval
 
     iter->n_group = -1;
+    iter->num_groups_left = interval_index_find(&from_index, doryta_id, &iter->groups_left);
     iter->doryta_id = doryta_id;
     iter->to_id = -1;
     iter->conn_parameter = -1;
@@ -361,12 +928,11 @@ static void master_init_neurons(neuron_init_f neuron_init, synapse_init_f synaps
     size_t synapse_shift = 0;
     for (int i = 0; i < num_neuron_groups; i++) {
         int32_t const neurons_in_pe = neuron_groups[i].neurons_in_pe;
-        int32_t const doryta_id_offset = neuron_groups[i].doryta_id_offset;
 #ifndef NDEBUG
         int32_t const local_id_offset = neuron_groups[i].local_id_offset;
 #endif
         for (int32_t j = 0; j < neurons_in_pe; j++) {
-            int32_t const doryta_id = doryta_id_offset + j;
+            int32_t const doryta_id = group_doryta_id_in_pe(i, g_tw_mynode, j);
             assert(neuron_counter == local_id_offset + j);
 
             // Initializing synapses
@@ -378,6 +944,8 @@ static void master_init_neurons(neuron_init_f neuron_init, synapse_init_f synaps
             struct Synapse * synapses_neuron = &naked_synapses[synapse_shift];
             while (!synapse_iter_end(&iter)) {
                 int32_t conn_parameter;
+                // the group has to be read before the iterator moves forward
+                struct SynapseGroup const * const group = &synapse_groups[iter.n_group];
                 int32_t const to_doryta_id = synapse_iter_next(&iter, &conn_parameter);
                 assert(to_doryta_id >= 0);
                 assert(to_doryta_id < total_neurons_globally);
@@ -387,12 +955,25 @@ static void master_init_neurons(neuron_init_f neuron_init, synapse_init_f synaps
 #endif
                 synapses_neuron->gid_to_send =
                     layout_master_doryta_id_to_gid(to_doryta_id);
-                if (synapse_init != NULL) {
+                if (group->conn_type == CONNECTION_TYPE_conv2 && group->kernel != NULL) {
+                    synapses_neuron->weight = group->kernel[conn_parameter];
+                } else if (group->conn_type == CONNECTION_TYPE_sparse && group->values != NULL) {
+                    synapses_neuron->weight = group->values[conn_parameter];
+                } else if (group->conn_type == CONNECTION_TYPE_one2one
+                        && group->pair_weights != NULL) {
+                    synapses_neuron->weight = group->pair_weights[conn_parameter];
+                } else if (group->conn_type == CONNECTION_TYPE_all2all
+                        && group->matrix != NULL) {
+                    size_t const num_cols = group->to_end - group->to_start + 1;
+                    synapses_neuron->weight = group->matrix[
+                        (doryta_id - group->from_start) * num_cols
+                        + (to_doryta_id - group->to_start)];
+                } else if (synapse_init != NULL) {
                     synapses_neuron->weight = synapse_init(doryta_id, to_doryta_id);
                 } else {
                     synapses_neuron->weight = conn_parameter;
                 }
-                synapses_neuron->delay = 1;
+                synapses_neuron->delay = group->delay;
 
                 /*
                  *float const weight = synapses_neuron->weight;
@@ -420,7 +1001,766 @@ static void master_init_neurons(neuron_init_f neuron_init, synapse_init_f synaps
         }
     }
     assert(total_neurons_in_pe == neuron_counter);
-    assert(total_synapses >= synapse_shift);
+    assert(total_synapses == synapse_shift);
+}
+
+
+/** Number of synapses going out from a neuron. */
+static inline int32_t count_synapses_neuron(int32_t doryta_id) {
+    struct SynapseIterator iter = {0};
+    synapse_iter_init(&iter, doryta_id);
+    int32_t num_synapses = 0;
+    while (!synapse_iter_end(&iter)) {
+        synapse_iter_next(&iter, NULL);
+        num_synapses++;
+    }
+    return num_synapses;
+}
+
+/** Generates the synapses from a neuron in a procedural conv2d group. */
+static inline void generate_conv2d_synapses(int n_group,
+        int32_t doryta_id, synapse_send_f send, void * context) {
+    struct SynapseGroup const * const group = &synapse_groups[n_group];
+    struct SynapseIterator iter = {0};
+    iter.n_group = n_group;
+    iter.doryta_id = doryta_id;
+    for (bool found = in_group_first_id(&iter); found; found = in_group_next_id(&iter)) {
+        float const weight = group->kernel[iter.conn_parameter];
+        if (fabsf(weight) <= prune_threshold) {
+            continue;
+        }
+        struct Synapse const synapse = {
+            .gid_to_send = layout_master_doryta_id_to_gid(iter.to_id),
+#ifndef NDEBUG
+            .doryta_id_to_send = iter.to_id,
+#endif
+            .weight = weight,
+            .delay = group->delay,
+        };
+        send(&synapse, context);
+    }
+}
+
+/** Generates the synapses from a neuron in a dense all2all group. The weights
+ * are read in order from the row of the neuron. */
+static inline void generate_all2all_synapses(int n_group,
+        int32_t doryta_id, synapse_send_f send, void * context) {
+    struct SynapseGroup const * const group = &synapse_groups[n_group];
+    size_t const num_cols = group->to_end - group->to_start + 1;
+    float const * weights;
+    if (group->matrix != NULL) {
+        weights = &group->matrix[(doryta_id - group->from_start) * num_cols];
+    } else {
+        size_t const row = layout_master_doryta_id_to_local_id(doryta_id) - group->first_row;
+        weights = &group->weights[row * num_cols];
+    }
+
+    for (int32_t i = 0; i < group->num_gid_runs; i++) {
+        struct GidRun const run = group->gid_runs[i];
+        for (int32_t j = 0; j < run.num; j++) {
+            float const weight = weights[run.first + j];
+            if (fabsf(weight) <= prune_threshold) {
+                continue;
+            }
+            struct Synapse const synapse = {
+                .gid_to_send = run.gid + j,
+#ifndef NDEBUG
+                .doryta_id_to_send = group->to_start + run.first + j,
+#endif
+                .weight = weight,
+                .delay = group->delay,
+            };
+            send(&synapse, context);
+        }
+    }
+}
+
+/** Generates the synapse from a neuron in a procedural one2one group. */
+static inline void generate_one2one_synapse(int n_group,
+        int32_t doryta_id, synapse_send_f send, void * context) {
+    struct SynapseGroup const * const group = &synapse_groups[n_group];
+    size_t const pair = layout_master_doryta_id_to_local_id(doryta_id) - group->first_pair;
+    float const weight = group->local_weights[pair];
+    if (fabsf(weight) <= prune_threshold) {
+        return;
+    }
+    int32_t const to_id = group->to_start + (doryta_id - group->from_start);
+    struct Synapse const synapse = {
+        .gid_to_send = layout_master_doryta_id_to_gid(to_id),
+#ifndef NDEBUG
+        .doryta_id_to_send = to_id,
+#endif
+        .weight = weight,
+        .delay = group->delay,
+    };
+    send(&synapse, context);
+}
+
+/** Generates the synapses of a neuron kept in the compact store. Only the
+ * arrays the spike needs are read (destinations and weights, and delays if
+ * any is not one). */
+static inline void generate_compact_synapses(
+        int32_t doryta_id, synapse_send_f send, void * context) {
+    size_t const local_id = layout_master_doryta_id_to_local_id(doryta_id);
+    size_t k = compact_synapses_start[local_id];
+    for (size_t i = compact_segments_start[local_id];
+            i < compact_segments_start[local_id + 1]; i++) {
+        uint64_t const gid_offset = (uint64_t) compact_segments[i].pe * max_num_lps_per_pe;
+        for (uint32_t j = 0; j < compact_segments[i].num; j++, k++) {
+            struct Synapse const synapse = {
+                .gid_to_send = gid_offset + compact_local_ids[k],
+#ifndef NDEBUG
+                .doryta_id_to_send =
+                    layout_master_gid_to_doryta_id(gid_offset + compact_local_ids[k]),
+#endif
+                .weight = compact_weights[k],
+                .delay = compact_delays == NULL ? 1 : compact_delays[k],
+            };
+            send(&synapse, context);
+        }
+    }
+    assert(k == compact_synapses_start[local_id + 1]);
+}
+
+/** Generates the synapses going out from a neuron in procedural groups. */
+static inline void generate_procedural_synapses(
+        int32_t doryta_id, synapse_send_f send, void * context) {
+    if (num_procedural_groups == 0) {
+        return;
+    }
+    int32_t const * groups;
+    int32_t const num_groups = interval_index_find(&from_index, doryta_id, &groups);
+    for (int32_t i = 0; i < num_groups; i++) {
+        int const n_group = groups[i];
+        struct SynapseGroup const * const group = &synapse_groups[n_group];
+        if (!group->procedural) {
+            continue;
+        }
+        if (group->conn_type == CONNECTION_TYPE_conv2) {
+            generate_conv2d_synapses(n_group, doryta_id, send, context);
+        } else if (group->conn_type == CONNECTION_TYPE_one2one) {
+            generate_one2one_synapse(n_group, doryta_id, send, context);
+        } else {
+            generate_all2all_synapses(n_group, doryta_id, send, context);
+        }
+    }
+}
+
+/** Generates the synapses going out from a neuron in the compact store and
+ * in procedural groups. The neuron must live in this PE.
+ */
+static void master_generate_synapses(
+        int32_t doryta_id, synapse_send_f send, void * context) {
+    if (compacted) {
+        generate_compact_synapses(doryta_id, send, context);
+    }
+    generate_procedural_synapses(doryta_id, send, context);
+}
+
+
+/** Number of neurons of `from` in this PE. They have consecutive LocalIDs,
+ * the first of which is stored in `first_local_id` (if there is any).
+ */
+static size_t from_neurons_in_pe(
+        struct SynapseGroup const * group, size_t * first_local_id) {
+    size_t num = 0;
+    for (int j = 0; j < num_neuron_groups; j++) {
+        size_t const first = group_neurons_in_pe_before(j, g_tw_mynode, group->from_start);
+        size_t const last = group_neurons_in_pe_before(j, g_tw_mynode, group->from_end + 1);
+        if (first < last) {
+            if (num == 0) {
+                *first_local_id = neuron_groups[j].local_id_offset + first;
+            }
+            num += last - first;
+        }
+    }
+    return num;
+}
+
+
+/** Takes the weights of the neurons in this PE for procedural one2one groups
+ * (from the weights of the group, `synapse_init`, or zero).
+ */
+static void master_init_one2one(synapse_init_f synapse_init) {
+    for (int i = 0; i < num_procedural_groups; i++) {
+        struct SynapseGroup * const group = &synapse_groups[procedural_groups[i]];
+        if (group->conn_type != CONNECTION_TYPE_one2one) {
+            continue;
+        }
+        size_t const num_pairs = from_neurons_in_pe(group, &group->first_pair);
+        group->local_weights = malloc((num_pairs + 1) * sizeof(float));
+        if (group->local_weights == NULL) {
+            tw_error(TW_LOC, "Not able to allocate space for one2one synapses");
+        }
+        for (size_t pair = 0; pair < num_pairs; pair++) {
+            int32_t const from = layout_master_local_id_to_doryta_id(group->first_pair + pair);
+            int32_t const to = group->to_start + (from - group->from_start);
+            if (group->pair_weights != NULL) {
+                group->local_weights[pair] = group->pair_weights[from - group->from_start];
+            } else {
+                group->local_weights[pair] = synapse_init == NULL ? 0 : synapse_init(from, to);
+            }
+        }
+    }
+}
+
+
+/** Allocates the weight matrices of dense all2all groups and initializes them
+ * (with `synapse_init`, or zero). It also splits the range of neurons each
+ * group connects to into runs of consecutive GIDs, so that GIDs don't have to
+ * be stored (nor computed one by one) when a neuron fires.
+ */
+static void master_init_dense(synapse_init_f synapse_init) {
+    for (int i = 0; i < num_procedural_groups; i++) {
+        struct SynapseGroup * const group = &synapse_groups[procedural_groups[i]];
+        if (group->conn_type != CONNECTION_TYPE_all2all) {
+            continue;
+        }
+        int32_t const num_cols = group->to_end - group->to_start + 1;
+        // The weights are used in place
+        size_t const num_rows =
+            group->matrix != NULL ? 0 : from_neurons_in_pe(group, &group->first_row);
+
+        group->weights = num_rows == 0 ? NULL : malloc(num_rows * num_cols * sizeof(float));
+        group->gid_runs = malloc(num_cols * sizeof(struct GidRun));
+        if ((num_rows > 0 && group->weights == NULL) || group->gid_runs == NULL) {
+            tw_error(TW_LOC, "Not able to allocate space for dense all2all synapses");
+        }
+
+        for (size_t row = 0; row < num_rows; row++) {
+            int32_t const from = layout_master_local_id_to_doryta_id(group->first_row + row);
+            for (int32_t col = 0; col < num_cols; col++) {
+                group->weights[row * num_cols + col] = synapse_init == NULL ? 0
+                    : synapse_init(from, group->to_start + col);
+            }
+        }
+
+        int32_t num_runs = 0;
+        for (int32_t col = 0; col < num_cols; col++) {
+            uint64_t const gid = layout_master_doryta_id_to_gid(group->to_start + col);
+            if (num_runs > 0 && group->gid_runs[num_runs - 1].gid
+                                + group->gid_runs[num_runs - 1].num == gid) {
+                group->gid_runs[num_runs - 1].num++;
+            } else {
+                group->gid_runs[num_runs] = (struct GidRun) {
+                    .first = col, .num = 1, .gid = gid,
+                };
+                num_runs++;
+            }
+        }
+        group->num_gid_runs = num_runs;
+        // Shrinking the runs array (it cannot fail, but it doesn't hurt to check)
+        struct GidRun * const gid_runs =
+            realloc(group->gid_runs, num_runs * sizeof(struct GidRun));
+        if (gid_runs != NULL) {
+            group->gid_runs = gid_runs;
+        }
+    }
+}
+
+
+struct PruneCount {
+    float threshold;
+    size_t num;
+};
+
+static void count_pruned(struct Synapse const * synapse, void * context) {
+    struct PruneCount * const count = context;
+    if (fabsf(synapse->weight) <= count->threshold) {
+        count->num++;
+    }
+}
+
+size_t layout_master_prune_synapses(float threshold) {
+    assert(initialized);
+    if (options.multicast || options.relay_fanout > 0) {
+        tw_error(TW_LOC, "Synapses cannot be pruned with multicast or relays");
+    }
+    if (compacted) {
+        tw_error(TW_LOC, "Synapses must be pruned before they are compacted");
+    }
+    assert(prune_threshold < 0);
+
+    // Synapses of procedural groups are not generated from now on
+    struct PruneCount count = {.threshold = threshold, .num = 0};
+    for (int32_t i = 0; i < total_neurons_in_pe; i++) {
+        master_generate_synapses(layout_master_local_id_to_doryta_id(i),
+                count_pruned, &count);
+    }
+    prune_threshold = threshold;
+
+    // Stored synapses are moved down to fill the space of the pruned ones.
+    // Synapses are stored neuron after neuron, so a synapse is never moved
+    // up
+    size_t kept = 0;
+    for (int32_t i = 0; i < total_neurons_in_pe; i++) {
+        struct SynapseCollection * const collection = &synapses[i];
+        size_t const first = kept;
+        for (int32_t j = 0; j < collection->num; j++) {
+            if (fabsf(collection->synapses[j].weight) > threshold) {
+                naked_synapses[kept] = collection->synapses[j];
+                kept++;
+            }
+        }
+        collection->num = kept - first;
+    }
+    assert(kept <= total_synapses);
+    size_t const pruned = count.num + (total_synapses - kept);
+    total_synapses = kept;
+
+    // Shrinking the array of synapses (it cannot fail, but it doesn't hurt to
+    // check)
+    struct Synapse * const shrunk =
+        realloc(naked_synapses, (total_synapses + 1) * sizeof(struct Synapse));
+    if (shrunk != NULL) {
+        naked_synapses = shrunk;
+    }
+    size_t shift = 0;
+    for (int32_t i = 0; i < total_neurons_in_pe; i++) {
+        synapses[i].synapses = synapses[i].num == 0 ? NULL : &naked_synapses[shift];
+        shift += synapses[i].num;
+    }
+
+    return pruned;
+}
+
+
+// Counts synapses (`stats.generated`) and those going to another PE
+static void count_synapse(struct Synapse const * synapse, void * context) {
+    struct LayoutMasterSynapseStats * const stats = context;
+    stats->generated++;
+    if (layout_master_gid_to_pe(synapse->gid_to_send) != g_tw_mynode) {
+        stats->remote++;
+    }
+}
+
+struct LayoutMasterSynapseStats layout_master_synapse_stats_pe(void) {
+    assert(initialized);
+    struct LayoutMasterSynapseStats stats = {
+        .stored = compacted ? 0 : total_synapses,
+        .compact = compacted ? compact_synapses_start[total_neurons_in_pe] : 0,
+        .generated = 0,
+        .remote = 0,
+        .compact_bytes = 0,
+    };
+    // The original synapses are kept in `naked_synapses` even if multicast
+    // or relays took them over
+    for (size_t k = 0; k < stats.stored; k++) {
+        if (layout_master_gid_to_pe(naked_synapses[k].gid_to_send) != g_tw_mynode) {
+            stats.remote++;
+        }
+    }
+    if (compacted) {
+        size_t const num_segments = compact_segments_start[total_neurons_in_pe];
+        for (size_t i = 0; i < num_segments; i++) {
+            if (compact_segments[i].pe != g_tw_mynode) {
+                stats.remote += compact_segments[i].num;
+            }
+        }
+        stats.compact_bytes = 2 * (total_neurons_in_pe + 1) * sizeof(size_t)
+            + num_segments * sizeof(struct PeSegment)
+            + stats.compact * (sizeof(uint32_t) + sizeof(float)
+                    + (compact_delays == NULL ? 0 : sizeof(uint16_t)));
+    }
+    for (int32_t i = 0; i < total_neurons_in_pe; i++) {
+        generate_procedural_synapses(layout_master_local_id_to_doryta_id(i),
+                count_synapse, &stats);
+    }
+    return stats;
+}
+
+
+// A synapse (its position within the neuron) and the PE it goes to
+struct SynapseToPe {
+    uint32_t pe;
+    int32_t index;
+};
+
+static int compare_SynapseToPe(void const * a_, void const * b_) {
+    struct SynapseToPe const * const a = a_;
+    struct SynapseToPe const * const b = b_;
+    if (a->pe != b->pe) {
+        return a->pe < b->pe ? -1 : 1;
+    }
+    return (a->index > b->index) - (a->index < b->index);
+}
+
+struct SettingsNeuronLP *
+layout_master_compact_synapses(struct SettingsNeuronLP *settingsNeuronLP) {
+    assert(initialized);
+    if (options.multicast || options.relay_fanout > 0) {
+        tw_error(TW_LOC, "Synapses cannot be compacted with multicast or relays");
+    }
+    assert(!compacted);
+
+    size_t num_synapses = 0;
+    int32_t max_synapses_neuron = 0;
+    for (int32_t i = 0; i < total_neurons_in_pe; i++) {
+        num_synapses += synapses[i].num;
+        if (synapses[i].num > max_synapses_neuron) {
+            max_synapses_neuron = synapses[i].num;
+        }
+    }
+    bool all_delays_one = true;
+    for (size_t k = 0; k < num_synapses; k++) {
+        all_delays_one = all_delays_one && naked_synapses[k].delay == 1;
+    }
+
+    compact_synapses_start = malloc((total_neurons_in_pe + 1) * sizeof(size_t));
+    compact_segments_start = malloc((total_neurons_in_pe + 1) * sizeof(size_t));
+    // There cannot be more segments than synapses
+    compact_segments = malloc((num_synapses + 1) * sizeof(struct PeSegment));
+    compact_local_ids = malloc((num_synapses + 1) * sizeof(uint32_t));
+    compact_weights = malloc((num_synapses + 1) * sizeof(float));
+    compact_delays = all_delays_one ? NULL : malloc(num_synapses * sizeof(uint16_t));
+    struct SynapseToPe * const sorted =
+        malloc((max_synapses_neuron + 1) * sizeof(struct SynapseToPe));
+    if (compact_synapses_start == NULL || compact_segments_start == NULL
+        || compact_segments == NULL || compact_local_ids == NULL
+        || compact_weights == NULL || (!all_delays_one && compact_delays == NULL)
+        || sorted == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space for compacting synapses");
+    }
+
+    // Grouping synapses by PE. The sort is stable (the index breaks ties), so
+    // the synapses going to the same neuron keep their order
+    size_t k = 0;
+    size_t num_segments = 0;
+    for (int32_t i = 0; i < total_neurons_in_pe; i++) {
+        struct SynapseCollection const * const collection = &synapses[i];
+        for (int32_t j = 0; j < collection->num; j++) {
+            sorted[j] = (struct SynapseToPe) {
+                .pe = layout_master_gid_to_pe(collection->synapses[j].gid_to_send),
+                .index = j,
+            };
+        }
+        qsort(sorted, collection->num, sizeof(struct SynapseToPe), compare_SynapseToPe);
+
+        compact_synapses_start[i] = k;
+        compact_segments_start[i] = num_segments;
+        for (int32_t j = 0; j < collection->num; j++, k++) {
+            struct Synapse const * const synapse = &collection->synapses[sorted[j].index];
+            if (j == 0 || sorted[j - 1].pe != sorted[j].pe) {
+                compact_segments[num_segments] = (struct PeSegment) {
+                    .pe = sorted[j].pe, .num = 0,
+                };
+                num_segments++;
+            }
+            compact_segments[num_segments - 1].num++;
+            compact_local_ids[k] =
+                synapse->gid_to_send - (uint64_t) sorted[j].pe * max_num_lps_per_pe;
+            compact_weights[k] = synapse->weight;
+            if (compact_delays != NULL) {
+                compact_delays[k] = synapse->delay;
+            }
+        }
+    }
+    assert(k == num_synapses);
+    compact_synapses_start[total_neurons_in_pe] = k;
+    compact_segments_start[total_neurons_in_pe] = num_segments;
+    free(sorted);
+
+    // Shrinking segments array (it cannot fail, but it doesn't hurt to check)
+    struct PeSegment * const segments =
+        realloc(compact_segments, (num_segments + 1) * sizeof(struct PeSegment));
+    if (segments != NULL) {
+        compact_segments = segments;
+    }
+
+    // The synapses are now only in the compact store
+    free(naked_synapses);
+    naked_synapses = NULL;
+    for (int32_t i = 0; i < total_neurons_in_pe; i++) {
+        synapses[i] = (struct SynapseCollection) {0, NULL};
+    }
+    compacted = true;
+
+    settingsNeuronLP->synapses = synapses;
+    settingsNeuronLP->generate_synapses = master_generate_synapses;
+    return settingsNeuronLP;
+}
+
+
+/** Finds how many neurons in this PE need a relay (their fan-out is larger
+ * than `relay_fanout`), and the largest number of relays across all PEs.
+ * The latter determines the GID space each PE takes, thus it must be known
+ * before any synapse is initialized.
+ */
+static void master_count_relays(void) {
+    num_relays_in_pe = 0;
+    for (int i = 0; i < num_neuron_groups; i++) {
+        int32_t const neurons_in_pe = neuron_groups[i].neurons_in_pe;
+        for (int32_t j = 0; j < neurons_in_pe; j++) {
+            if (count_synapses_neuron(group_doryta_id_in_pe(i, g_tw_mynode, j))
+                    > options.relay_fanout) {
+                num_relays_in_pe++;
+            }
+        }
+    }
+    MPI_Allreduce(&num_relays_in_pe, &max_num_relays_per_pe, 1, MPI_INT32_T,
+            MPI_MAX, MPI_COMM_ROSS);
+}
+
+/** Neurons with more than `relay_fanout` synapses give their synapses to a
+ * relay (a SynapseLP in the same PE), and connect only to it.
+ */
+static void master_init_relays(void) {
+    if (num_relays_in_pe == 0) {
+        return;
+    }
+    relay_sources = malloc(num_relays_in_pe * sizeof(struct RelayedSynapses));
+    relay_links = malloc(num_relays_in_pe * sizeof(struct Synapse));
+    if (relay_sources == NULL || relay_links == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space for relays");
+    }
+
+    int const first_relay = options.multicast ? 1 : 0;
+    int32_t relay = 0;
+    for (int32_t i = 0; i < total_neurons_in_pe; i++) {
+        if (synapses[i].num <= options.relay_fanout) {
+            continue;
+        }
+        assert(relay < num_relays_in_pe);
+
+        relay_sources[relay] = (struct RelayedSynapses) {
+            .gid_from = pe_gid_offset + i,
+            .to_contact = synapses[i],
+        };
+        relay_links[relay] = (struct Synapse) {
+            .gid_to_send = pe_gid_offset + total_neurons_in_pe + first_relay + relay,
+#ifndef NDEBUG
+            .doryta_id_to_send = layout_master_local_id_to_doryta_id(i),
+#endif
+            .weight = 0,
+            .delay = SYNAPSE_DELAY_RELAY,
+        };
+        synapse_lps[first_relay + relay] = (struct SynapseLP) {
+            .num_sources = 1,
+            .sources = &relay_sources[relay],
+        };
+        synapses[i] = (struct SynapseCollection) {
+            .num = 1,
+            .synapses = &relay_links[relay],
+        };
+        relay++;
+    }
+    assert(relay == num_relays_in_pe);
+}
+
+
+static inline size_t get_local_offset_for_level_in_pe(size_t pe, int level);
+
+/** GID of the SynapseLP in charge of multicasting spikes within `pe`. */
+static inline uint64_t synapse_lp_gid_for_pe(size_t pe) {
+    return pe * max_num_lps_per_pe
+        + get_local_offset_for_level_in_pe(pe, num_neuron_groups);
+}
+
+/** A synapse as it is sent to the PE whose SynapseLP will deliver it. */
+struct RelayRecord {
+    uint64_t gid_from;
+    uint64_t gid_to;
+    float weight;
+    uint16_t delay;
+#ifndef NDEBUG
+    int32_t doryta_id_to;
+#endif
+};
+
+/** Counts how many synapses from a neuron land in each PE. */
+static inline void count_synapses_per_pe(
+        struct SynapseCollection const * collection, int32_t * synapses_to_pe) {
+    for (int32_t j = 0; j < collection->num; j++) {
+        synapses_to_pe[layout_master_gid_to_pe(collection->synapses[j].gid_to_send)]++;
+    }
+}
+
+/** Replaces the synapses of all neurons in the PE by one synapse per PE they
+ * connect to. The synapse points to the SynapseLP of the PE, which receives a
+ * copy of the original synapses (via MPI). If a neuron has only one synapse
+ * to a PE, the synapse is left as it is (a SynapseLP would only add an
+ * additional event).
+ */
+static void master_init_multicast(void) {
+    size_t const num_pes = tw_nnodes();
+    // Number of synapses from the current neuron to each PE. It is set to -1
+    // once the synapse to the SynapseLP of the PE has been created
+    int32_t * const synapses_to_pe = calloc(num_pes, sizeof(int32_t));
+    int * const send_counts = calloc(num_pes, sizeof(int));
+    int * const send_displs = malloc(num_pes * sizeof(int));
+    int * const send_cursor = malloc(num_pes * sizeof(int));
+    int * const recv_counts = malloc(num_pes * sizeof(int));
+    int * const recv_displs = malloc(num_pes * sizeof(int));
+    if (synapses_to_pe == NULL || send_counts == NULL || send_displs == NULL
+     || send_cursor == NULL || recv_counts == NULL || recv_displs == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space for multicast tables");
+    }
+
+    // Counting synapses to send to each PE and the new number of synapses
+    size_t total_new_synapses = 0;
+    for (int32_t i = 0; i < total_neurons_in_pe; i++) {
+        count_synapses_per_pe(&synapses[i], synapses_to_pe);
+        for (int32_t j = 0; j < synapses[i].num; j++) {
+            size_t const pe = layout_master_gid_to_pe(synapses[i].synapses[j].gid_to_send);
+            if (synapses_to_pe[pe] > 0) {
+                total_new_synapses++;
+                if (synapses_to_pe[pe] > 1) {
+                    send_counts[pe] += synapses_to_pe[pe];
+                }
+                synapses_to_pe[pe] = 0;
+            }
+        }
+    }
+
+    size_t total_send = 0;
+    for (size_t pe = 0; pe < num_pes; pe++) {
+        send_displs[pe] = total_send;
+        send_cursor[pe] = total_send;
+        total_send += send_counts[pe];
+    }
+    if (total_send > INT_MAX) {
+        tw_error(TW_LOC, "Too many synapses (%zu) to relay from PE %lu",
+                total_send, g_tw_mynode);
+    }
+
+    struct RelayRecord * const send_buf =
+        malloc(total_send * sizeof(struct RelayRecord));
+    struct Synapse * const new_synapses =
+        malloc(total_new_synapses * sizeof(struct Synapse));
+    if ((total_send > 0 && send_buf == NULL)
+     || (total_new_synapses > 0 && new_synapses == NULL)) {
+        tw_error(TW_LOC, "Not able to allocate space for multicast synapses");
+    }
+
+    // Splitting synapses into those that stay and those to relay
+    size_t new_shift = 0;
+    for (int32_t i = 0; i < total_neurons_in_pe; i++) {
+        uint64_t const gid_from = pe_gid_offset + i;
+        struct SynapseCollection const old = synapses[i];
+        struct Synapse * const synapses_neuron = &new_synapses[new_shift];
+        int32_t num_synapses_neuron = 0;
+
+        count_synapses_per_pe(&old, synapses_to_pe);
+        for (int32_t j = 0; j < old.num; j++) {
+            struct Synapse const * const synapse = &old.synapses[j];
+            size_t const pe = layout_master_gid_to_pe(synapse->gid_to_send);
+            if (synapses_to_pe[pe] == 1) {
+                synapses_neuron[num_synapses_neuron++] = *synapse;
+                continue;
+            }
+
+            if (synapses_to_pe[pe] > 1) {
+                synapses_neuron[num_synapses_neuron++] = (struct Synapse) {
+                    .gid_to_send = synapse_lp_gid_for_pe(pe),
+#ifndef NDEBUG
+                    .doryta_id_to_send = layout_master_local_id_to_doryta_id(i),
+#endif
+                    .weight = 0,
+                    .delay = SYNAPSE_DELAY_RELAY,
+                };
+                synapses_to_pe[pe] = -1;
+            }
+            send_buf[send_cursor[pe]++] = (struct RelayRecord) {
+                .gid_from = gid_from,
+                .gid_to = synapse->gid_to_send,
+                .weight = synapse->weight,
+                .delay = synapse->delay,
+#ifndef NDEBUG
+                .doryta_id_to = synapse->doryta_id_to_send,
+#endif
+            };
+        }
+        for (int32_t j = 0; j < old.num; j++) {
+            synapses_to_pe[layout_master_gid_to_pe(old.synapses[j].gid_to_send)] = 0;
+        }
+
+        synapses[i].num = num_synapses_neuron;
+        synapses[i].synapses = num_synapses_neuron == 0 ? NULL : synapses_neuron;
+        new_shift += num_synapses_neuron;
+    }
+    assert(new_shift == total_new_synapses);
+
+    // Exchanging synapses with all other PEs
+    MPI_Datatype relay_record_type;
+    MPI_Type_contiguous(sizeof(struct RelayRecord), MPI_BYTE, &relay_record_type);
+    MPI_Type_commit(&relay_record_type);
+
+    MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, MPI_COMM_ROSS);
+    size_t total_recv = 0;
+    for (size_t pe = 0; pe < num_pes; pe++) {
+        recv_displs[pe] = total_recv;
+        total_recv += recv_counts[pe];
+    }
+    if (total_recv > INT_MAX) {
+        tw_error(TW_LOC, "Too many synapses (%zu) to relay into PE %lu",
+                total_recv, g_tw_mynode);
+    }
+
+    struct RelayRecord * const recv_buf =
+        malloc(total_recv * sizeof(struct RelayRecord));
+    if (total_recv > 0 && recv_buf == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space for multicast synapses");
+    }
+    MPI_Alltoallv(send_buf, send_counts, send_displs, relay_record_type,
+                  recv_buf, recv_counts, recv_displs, relay_record_type,
+                  MPI_COMM_ROSS);
+    MPI_Type_free(&relay_record_type);
+
+    // Records arrive sorted by PE, and within each PE sorted by the local ID
+    // of the neuron, ie, sorted by `gid_from`
+    int32_t num_sources = 0;
+    for (size_t k = 0; k < total_recv; k++) {
+        assert(k == 0 || recv_buf[k-1].gid_from <= recv_buf[k].gid_from);
+        if (k == 0 || recv_buf[k-1].gid_from != recv_buf[k].gid_from) {
+            num_sources++;
+        }
+    }
+
+    if (num_sources > 0) {
+        multicast_sources = malloc(num_sources * sizeof(struct RelayedSynapses));
+        multicast_synapses = malloc(total_recv * sizeof(struct Synapse));
+        if (multicast_sources == NULL || multicast_synapses == NULL) {
+            tw_error(TW_LOC, "Not able to allocate space for multicast synapses");
+        }
+    }
+
+    int32_t source = -1;
+    for (size_t k = 0; k < total_recv; k++) {
+        if (k == 0 || recv_buf[k-1].gid_from != recv_buf[k].gid_from) {
+            source++;
+            multicast_sources[source] = (struct RelayedSynapses) {
+                .gid_from = recv_buf[k].gid_from,
+                .to_contact = {.num = 0, .synapses = &multicast_synapses[k]},
+            };
+        }
+        multicast_synapses[k] = (struct Synapse) {
+            .gid_to_send = recv_buf[k].gid_to,
+#ifndef NDEBUG
+            .doryta_id_to_send = recv_buf[k].doryta_id_to,
+#endif
+            .weight = recv_buf[k].weight,
+            .delay = recv_buf[k].delay,
+        };
+        multicast_sources[source].to_contact.num++;
+    }
+    assert(source + 1 == num_sources);
+
+    synapse_lps[0].num_sources = num_sources;
+    synapse_lps[0].sources = multicast_sources;
+    assert_valid_SynapseLP(&synapse_lps[0]);
+
+    // The new synapses replace the old ones. The old synapses cannot be
+    // freed, relays might still point to them
+    multicast_neuron_synapses = new_synapses;
+
+    free(recv_buf);
+    free(send_buf);
+    free(recv_displs);
+    free(recv_counts);
+    free(send_cursor);
+    free(send_displs);
+    free(send_counts);
+    free(synapses_to_pe);
 }
 
 
@@ -430,6 +1770,63 @@ void layout_master_free(void) {
     free(naked_neurons);
     free(neurons);
     free(synapses);
+    free(synapse_lps);
+    free(multicast_sources);
+    free(multicast_synapses);
+    free(multicast_neuron_synapses);
+    free(relay_sources);
+    free(relay_links);
+    free(local_offsets);
+    interval_index_free(&from_index);
+    free(compact_synapses_start);
+    free(compact_segments_start);
+    free(compact_segments);
+    free(compact_local_ids);
+    free(compact_weights);
+    free(compact_delays);
+    compacted = false;
+    prune_threshold = -1;
+    compact_synapses_start = NULL;
+    compact_segments_start = NULL;
+    compact_segments = NULL;
+    compact_local_ids = NULL;
+    compact_weights = NULL;
+    compact_delays = NULL;
+    for (int i = 0; i < num_synap_groups; i++) {
+        if (synapse_groups[i].conn_type == CONNECTION_TYPE_conv2) {
+            free(synapse_groups[i].kernel);
+            synapse_groups[i].kernel = NULL;
+        } else if (synapse_groups[i].conn_type == CONNECTION_TYPE_one2one) {
+            free(synapse_groups[i].pair_weights);
+            free(synapse_groups[i].local_weights);
+            synapse_groups[i].pair_weights = NULL;
+            synapse_groups[i].local_weights = NULL;
+        } else if (synapse_groups[i].conn_type == CONNECTION_TYPE_sparse) {
+            free(synapse_groups[i].row_ptr);
+            free(synapse_groups[i].col_idx);
+            free(synapse_groups[i].values);
+            synapse_groups[i].row_ptr = NULL;
+            synapse_groups[i].col_idx = NULL;
+            synapse_groups[i].values = NULL;
+        } else if (synapse_groups[i].procedural) {
+            free(synapse_groups[i].weights);
+            free(synapse_groups[i].gid_runs);
+            synapse_groups[i].weights = NULL;
+            synapse_groups[i].gid_runs = NULL;
+        }
+    }
+    for (int i = 0; i < num_neuron_groups; i++) {
+        free(neuron_groups[i].cuts);
+        neuron_groups[i].cuts = NULL;
+    }
+    synapse_lps = NULL;
+    multicast_sources = NULL;
+    multicast_synapses = NULL;
+    multicast_neuron_synapses = NULL;
+    relay_sources = NULL;
+    relay_links = NULL;
+    local_offsets = NULL;
+    support_lps_pending = false;
     initialized = false;
 }
 
@@ -439,6 +1836,8 @@ layout_master_configure(struct SettingsNeuronLP *settingsNeuronLP) {
     assert(initialized);
     settingsNeuronLP->neurons = neurons;
     settingsNeuronLP->synapses = synapses;
+    settingsNeuronLP->generate_synapses =
+        compacted || num_procedural_groups > 0 ? master_generate_synapses : NULL;
     settingsNeuronLP->gid_to_doryta_id = layout_master_gid_to_doryta_id;
 
     size_t total_neurons_across_all = 0;
@@ -451,10 +1850,45 @@ layout_master_configure(struct SettingsNeuronLP *settingsNeuronLP) {
 }
 
 
+void layout_master_synapses_loaded(void) {
+    assert(initialized);
+    if (!support_lps_pending) {
+        return;
+    }
+    // Multicast and relays take the synapses over (weights included)
+    if (options.relay_fanout > 0) {
+        master_init_relays();
+    }
+    if (options.multicast) {
+        master_init_multicast();
+    }
+    support_lps_pending = false;
+}
+
+
+struct SettingsSynapseLP *
+layout_master_configure_synapse_lps(struct SettingsSynapseLP *settingsSynapseLP) {
+    assert(initialized);
+    if (support_lps_pending) {
+        tw_error(TW_LOC, "The SynapseLPs are not set until the weights of the "
+                "synapses are (see `layout_master_synapses_loaded`)");
+    }
+    settingsSynapseLP->num_synapse_lps_pe = support_lps_in_pe;
+    settingsSynapseLP->local_id_offset = total_neurons_in_pe;
+    settingsSynapseLP->synapse_lps = synapse_lps;
+    return settingsSynapseLP;
+}
+
+
 size_t layout_master_total_lps_pe(void) {
-    // For now, this function and the following are the same. This will change
-    // once Supporting LPs are defined
-    return layout_master_total_neurons_pe();
+    return layout_master_total_neurons_pe() + support_lps_in_pe;
+}
+
+
+bool layout_master_gid_is_synapse_lp(uint64_t gid) {
+    size_t const pe = layout_master_gid_to_pe(gid);
+    return gid - pe * max_num_lps_per_pe
+        >= get_local_offset_for_level_in_pe(pe, num_neuron_groups);
 }
 
 
@@ -472,20 +1906,10 @@ static size_t neurons_within_pe(size_t start, size_t end) {
     }
 
     size_t total_overlap = 0;
-    // Finding overlap with all neuron intervals in this PE
+    // Finding overlap with the neurons of all groups in this PE
     for (int i = 0; i < num_neuron_groups; i++) {
-        size_t const start_i = neuron_groups[i].doryta_id_offset;
-        size_t const end_i = neuron_groups[i].doryta_id_offset
-            + neuron_groups[i].neurons_in_pe - 1;
-
-        // Only checking when intervals intersect
-        if (start_i <= end && start <= end_i) {
-            // The line below is the same as this. There is no standard min or
-            // max function in C :(
-            // total_overlap += min(end, end_i) - max(start, start_i) + 1;
-            total_overlap += (end < end_i ? end : end_i)
-                - (start > start_i ? start : start_i) + 1;
-        }
+        total_overlap += group_neurons_in_pe_before(i, g_tw_mynode, end + 1)
+            - group_neurons_in_pe_before(i, g_tw_mynode, start);
     }
 
     return total_overlap;
@@ -530,11 +1954,57 @@ void layout_master_synapses_all2all(int32_t from_start, int32_t from_end,
         .from_end   = from_end,
         .to_start   = to_start,
         .to_end     = to_end,
+        .delay      = 1,
+        .procedural = options.dense_all2all,
     };
     num_synap_groups++;
 
-    total_synapses += neurons_within_pe(from_start, from_end)
-                        * (to_end - to_start + 1);
+    if (options.dense_all2all) {
+        procedural_groups[num_procedural_groups] = num_synap_groups - 1;
+        num_procedural_groups++;
+    }
+}
+
+
+void layout_master_synapses_one2one(int32_t from_start, int32_t from_end,
+        int32_t to_start, int32_t to_end, float const * weights) {
+    check_from_to_inputs(from_start, from_end, to_start, to_end);
+    if (from_end - from_start != to_end - to_start) {
+        tw_error(TW_LOC, "A one2one group must connect ranges of the same size "
+                "(from has %" PRIi32 " neurons and to has %" PRIi32 ")",
+                from_end - from_start + 1, to_end - to_start + 1);
+    }
+
+    // The layout keeps its own copy of the weights
+    float * pair_weights = NULL;
+    if (weights != NULL) {
+        size_t const num_pairs = from_end - from_start + 1;
+        pair_weights = malloc(num_pairs * sizeof(float));
+        if (pair_weights == NULL) {
+            tw_error(TW_LOC, "Not able to allocate space for one2one weights");
+        }
+        memcpy(pair_weights, weights, num_pairs * sizeof(float));
+    }
+
+    // Synapses are generated, unless they have to be stored for multicast or
+    // relays
+    bool const procedural = !options.multicast && options.relay_fanout == 0;
+    synapse_groups[num_synap_groups] = (struct SynapseGroup) {
+        .conn_type    = CONNECTION_TYPE_one2one,
+        .from_start   = from_start,
+        .from_end     = from_end,
+        .to_start     = to_start,
+        .to_end       = to_end,
+        .delay        = 1,
+        .procedural   = procedural,
+        .pair_weights = pair_weights,
+    };
+    num_synap_groups++;
+
+    if (procedural) {
+        procedural_groups[num_procedural_groups] = num_synap_groups - 1;
+        num_procedural_groups++;
+    }
 }
 
 
@@ -568,23 +2038,78 @@ static inline void check_params(struct Conv2dParams const * params) {
 }
 
 
+/** Number of elements of the range (`num` elements up to `last`) that fall
+ * within the output layer (`[0, size)`). */
+static inline int32_t conv2d_outputs_within(int num, int last, int size) {
+    int const first = last - num + 1;
+    int const low = first > 0 ? first : 0;
+    int const high = last < size - 1 ? last : size - 1;
+    return high >= low ? high - low + 1 : 0;
+}
+
+/** Exact number of synapses going out from the input neurons of a conv2d
+ * group that live in this PE. Neurons on the edges of the input layer might
+ * connect to fewer outputs than `ceil(Kw / Sw) * ceil(Kh / Sh)`. The count is
+ * separable: it is the number of outputs along the width times the number
+ * along the height (times the number of output channels).
+ */
+static size_t conv2d_synapses_within_pe(struct SynapseGroup const * group) {
+    size_t total = 0;
+    // Finding overlap with the neurons of all groups in this PE
+    for (int i = 0; i < num_neuron_groups; i++) {
+        size_t const first_j = group_neurons_in_pe_before(i, g_tw_mynode, group->from_start);
+        size_t const end_j = group_neurons_in_pe_before(i, g_tw_mynode, group->from_end + 1);
+
+        for (size_t j = first_j; j < end_j; j++) {
+            int32_t const doryta_id = group_doryta_id_in_pe(i, g_tw_mynode, j);
+            int32_t const shifted = (doryta_id - group->from_start)
+                % (group->from_width * group->from_height);
+            int num, last;
+            conv2d_outputs_along_axis(shifted % group->from_width,
+                    group->padding_width, group->stride_width,
+                    group->kernel_width, &num, &last);
+            int32_t const along_width = conv2d_outputs_within(num, last, group->to_width);
+            conv2d_outputs_along_axis(shifted / group->from_width,
+                    group->padding_height, group->stride_height,
+                    group->kernel_height, &num, &last);
+            int32_t const along_height = conv2d_outputs_within(num, last, group->to_height);
+            total += (size_t) along_width * along_height * group->to_channels;
+        }
+    }
+    return total;
+}
+
+
 void layout_master_synapses_conv2d(
         int32_t from_start, int32_t from_end,
         int32_t to_start, int32_t to_end,
         struct Conv2dParams const * params) {
+    layout_master_synapses_conv2d_channels(
+            from_start, from_end, to_start, to_end, params, 1, 1);
+}
+
+
+void layout_master_synapses_conv2d_channels(
+        int32_t from_start, int32_t from_end,
+        int32_t to_start, int32_t to_end,
+        struct Conv2dParams const * params,
+        int32_t in_channels, int32_t out_channels) {
     check_from_to_inputs(from_start, from_end, to_start, to_end);
     check_params(params);
+    check_positive(in_channels,  "in_channels");
+    check_positive(out_channels, "out_channels");
 
     int32_t const total_input_neurons = from_end - from_start + 1;
 
-    // Checking that input shape is actually a rectangle
-    if (total_input_neurons % params->input_width != 0) {
+    // Checking that input shape is actually a rectangle (per channel)
+    if (total_input_neurons % (params->input_width * in_channels) != 0) {
         tw_error(TW_LOC, "A total of %" PRIi32
-                " neurons for a conv2d layer cannot have width of %" PRIi32,
-                total_input_neurons, params->input_width);
+                " neurons for a conv2d layer cannot have width of %" PRIi32
+                " and %" PRIi32 " channels",
+                total_input_neurons, params->input_width, in_channels);
     }
 
-    int32_t const from_height = total_input_neurons / params->input_width;
+    int32_t const from_height = total_input_neurons / (params->input_width * in_channels);
 
     int32_t const input_width = params->input_width + 2 * params->padding_width;
     int32_t const input_height = from_height + 2 * params->padding_height;
@@ -596,10 +2121,10 @@ void layout_master_synapses_conv2d(
 
     int32_t const total_output_neurons = to_end - to_start + 1;
 
-    if (total_output_neurons != to_width * to_height) {
+    if (total_output_neurons != to_width * to_height * out_channels) {
         tw_error(TW_LOC, "The output layer should have size %" PRIi32
                 ", but the size of the output layer is %" PRIi32,
-                to_width * to_height, total_output_neurons);
+                to_width * to_height * out_channels, total_output_neurons);
     }
 
     synapse_groups[num_synap_groups] = (struct SynapseGroup) {
@@ -608,7 +2133,12 @@ void layout_master_synapses_conv2d(
         .from_end   = from_end,
         .to_start   = to_start,
         .to_end     = to_end,
+        .delay      = 1,
+        .procedural = options.procedural_conv2d,
 
+        .kernel         = NULL,
+        .from_channels  = in_channels,
+        .to_channels    = out_channels,
         .from_width     = params->input_width,
         .from_height    = from_height,
         .to_width       = to_width,
@@ -622,17 +2152,210 @@ void layout_master_synapses_conv2d(
     };
     num_synap_groups++;
 
-    // This is wasteful (memory-wise) in the case of insuficient padding, as
-    // the neurons on the edges of the input layer will use less synapses than
-    // the neurons in the center of the image. Finding out the precise number
-    // of synapses for a given PE is too complicated and I rather spend some
-    // memory than computing and effort time.
+    if (options.procedural_conv2d) {
+        procedural_groups[num_procedural_groups] = num_synap_groups - 1;
+        num_procedural_groups++;
+    }
+}
+
+
+/** Number of synapses going out from the input neurons of a sparse group that
+ * live in this PE. */
+static size_t sparse_synapses_within_pe(struct SynapseGroup const * group) {
+    size_t total = 0;
+    for (int i = 0; i < num_neuron_groups; i++) {
+        size_t const first_j = group_neurons_in_pe_before(i, g_tw_mynode, group->from_start);
+        size_t const end_j = group_neurons_in_pe_before(i, g_tw_mynode, group->from_end + 1);
 
-    // ceil(Kw / Sw) * ceil(Kh / Sh) = maximum number of synapses out from a neuron
-    total_synapses +=
-        neurons_within_pe(from_start, from_end)
-        * divceil_i32(params->kernel_width, params->stride_width)
-        * divceil_i32(params->kernel_height, params->stride_height);
+        for (size_t j = first_j; j < end_j; j++) {
+            int32_t const row = group_doryta_id_in_pe(i, g_tw_mynode, j) - group->from_start;
+            total += group->row_ptr[row + 1] - group->row_ptr[row];
+        }
+    }
+    return total;
+}
+
+
+void layout_master_synapses_sparse(int32_t from_start, int32_t from_end,
+        int32_t to_start, int32_t to_end,
+        int32_t const * row_ptr, int32_t const * col_idx, float const * weights) {
+    check_from_to_inputs(from_start, from_end, to_start, to_end);
+
+    int32_t const num_rows = from_end - from_start + 1;
+    int32_t const num_cols = to_end - to_start + 1;
+    if (row_ptr[0] != 0) {
+        tw_error(TW_LOC, "The rows of a sparse group must start at 0 (not %" PRIi32 ")",
+                row_ptr[0]);
+    }
+    for (int32_t i = 0; i < num_rows; i++) {
+        if (row_ptr[i + 1] < row_ptr[i]) {
+            tw_error(TW_LOC, "The row %" PRIi32 " of a sparse group ends (%" PRIi32
+                    ") before it starts (%" PRIi32 ")", i, row_ptr[i + 1], row_ptr[i]);
+        }
+        for (int32_t k = row_ptr[i]; k < row_ptr[i + 1]; k++) {
+            if (col_idx[k] < 0 || col_idx[k] >= num_cols
+                    || (k > row_ptr[i] && col_idx[k] <= col_idx[k - 1])) {
+                tw_error(TW_LOC, "The columns in row %" PRIi32 " of a sparse group must "
+                        "be sorted, unique and within [0, %" PRIi32 "]", i, num_cols - 1);
+            }
+        }
+    }
+
+    // The layout keeps its own copy of the rows
+    int32_t const num_synapses = row_ptr[num_rows];
+    // (`malloc(0)` might return NULL)
+    size_t const to_alloc = num_synapses > 0 ? num_synapses : 1;
+    int32_t * const row_ptr_copy = malloc((num_rows + 1) * sizeof(int32_t));
+    int32_t * const col_idx_copy = malloc(to_alloc * sizeof(int32_t));
+    float * const values_copy =
+        weights == NULL ? NULL : malloc(to_alloc * sizeof(float));
+    if (row_ptr_copy == NULL || col_idx_copy == NULL
+            || (weights != NULL && values_copy == NULL)) {
+        tw_error(TW_LOC, "Not able to allocate space for the sparse group");
+    }
+    memcpy(row_ptr_copy, row_ptr, (num_rows + 1) * sizeof(int32_t));
+    memcpy(col_idx_copy, col_idx, num_synapses * sizeof(int32_t));
+    if (weights != NULL) {
+        memcpy(values_copy, weights, num_synapses * sizeof(float));
+    }
+
+    synapse_groups[num_synap_groups] = (struct SynapseGroup) {
+        .conn_type  = CONNECTION_TYPE_sparse,
+        .from_start = from_start,
+        .from_end   = from_end,
+        .to_start   = to_start,
+        .to_end     = to_end,
+        .delay      = 1,
+        .row_ptr    = row_ptr_copy,
+        .col_idx    = col_idx_copy,
+        .values     = values_copy,
+    };
+    num_synap_groups++;
+}
+
+
+/** Counts the synapses (to store) from neurons in this PE. It can only be
+ * done once neurons have been placed. */
+static void master_count_synapses(void) {
+    total_synapses = 0;
+    for (int i = 0; i < num_synap_groups; i++) {
+        struct SynapseGroup const * const group = &synapse_groups[i];
+        if (group->procedural) {
+            continue;
+        }
+        if (group->conn_type == CONNECTION_TYPE_conv2) {
+            total_synapses += conv2d_synapses_within_pe(group);
+        } else if (group->conn_type == CONNECTION_TYPE_sparse) {
+            total_synapses += sparse_synapses_within_pe(group);
+        } else if (group->conn_type == CONNECTION_TYPE_one2one) {
+            total_synapses += neurons_within_pe(group->from_start, group->from_end);
+        } else {
+            total_synapses += neurons_within_pe(group->from_start, group->from_end)
+                                * (group->to_end - group->to_start + 1);
+        }
+    }
+}
+
+
+void layout_master_synapses_delay(uint16_t delay) {
+    if (initialized) {
+        tw_error(TW_LOC, "Delays must be set before the layout is initialized");
+    }
+    if (num_synap_groups == 0) {
+        tw_error(TW_LOC, "There is no synapse group to set its delay");
+    }
+    if (delay == 0) {
+        tw_error(TW_LOC, "The delay of a synapse must be at least one heartbeat");
+    }
+    synapse_groups[num_synap_groups - 1].delay = delay;
+}
+
+
+float * layout_master_all2all_weights(
+        int32_t doryta_id, int32_t to_start, int32_t to_end) {
+    assert(initialized);
+    for (int i = 0; i < num_procedural_groups; i++) {
+        struct SynapseGroup const * const group = &synapse_groups[procedural_groups[i]];
+        if (group->conn_type == CONNECTION_TYPE_all2all && group->matrix == NULL
+         && group->from_start <= doryta_id && doryta_id <= group->from_end
+         && group->to_start == to_start && group->to_end == to_end) {
+            size_t const num_cols = to_end - to_start + 1;
+            size_t const row = layout_master_doryta_id_to_local_id(doryta_id) - group->first_row;
+            return &group->weights[row * num_cols];
+        }
+    }
+    return NULL;
+}
+
+
+void layout_master_synapses_weights(float const * matrix) {
+    if (initialized) {
+        tw_error(TW_LOC, "Weights must be set before the layout is initialized");
+    }
+    if (num_synap_groups == 0
+            || synapse_groups[num_synap_groups - 1].conn_type != CONNECTION_TYPE_all2all) {
+        tw_error(TW_LOC, "The latest synapse group is not an all2all group");
+    }
+    synapse_groups[num_synap_groups - 1].matrix = matrix;
+}
+
+
+void layout_master_synapses_kernel(float const * kernel) {
+    if (initialized) {
+        tw_error(TW_LOC, "Kernels must be set before the layout is initialized");
+    }
+    if (num_synap_groups == 0
+            || synapse_groups[num_synap_groups - 1].conn_type != CONNECTION_TYPE_conv2) {
+        tw_error(TW_LOC, "The latest synapse group is not a conv2d group");
+    }
+    struct SynapseGroup * const group = &synapse_groups[num_synap_groups - 1];
+    size_t const kernel_size = (size_t) group->kernel_width * group->kernel_height
+        * group->from_channels * group->to_channels;
+    free(group->kernel);
+    group->kernel = malloc(kernel_size * sizeof(float));
+    if (group->kernel == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space for the kernel");
+    }
+    memcpy(group->kernel, kernel, kernel_size * sizeof(float));
+}
+
+
+// Finding the groups of a neuron is a binary search (plus going through the
+// groups found), instead of going through every group for every neuron
+static void master_build_from_index(void) {
+    assert(from_index.bounds == NULL);
+    int32_t from[MAX_SYNAPSE_GROUPS];
+    int32_t to[MAX_SYNAPSE_GROUPS];
+    for (int i = 0; i < num_synap_groups; i++) {
+        from[i] = synapse_groups[i].from_start;
+        to[i] = synapse_groups[i].from_end;
+    }
+    from_index = interval_index_build(from, to, num_synap_groups);
+}
+
+
+// The table takes `(num_neuron_groups + 1) * tw_nnodes()` integers. It turns
+// every conversion below into a lookup (plus a binary search over groups
+// when the group is unknown)
+static void master_build_local_offsets(void) {
+    assert(local_offsets == NULL);
+    size_t const max_pes = tw_nnodes();
+    size_t const row_size = num_neuron_groups + 1;
+
+    local_offsets = malloc(max_pes * row_size * sizeof(int32_t));
+    if (local_offsets == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space for the conversion tables");
+    }
+
+    for (size_t pe = 0; pe < max_pes; pe++) {
+        int32_t * const offsets = &local_offsets[pe * row_size];
+        offsets[0] = 0;
+        for (int level = 0; level < num_neuron_groups; level++) {
+            offsets[level + 1] = offsets[level] + group_neurons_in_pe(level, pe);
+        }
+    }
+    assert(local_offsets[g_tw_mynode * row_size + num_neuron_groups]
+            == total_neurons_in_pe);
 }
 
 
@@ -645,7 +2368,7 @@ unsigned long layout_master_doryta_id_to_pe(int32_t doryta_id) {
 
 unsigned long layout_master_gid_to_pe(uint64_t gid) {
     //return (unsigned long)gid / max_num_neurons_per_pe;
-    return gid / max_num_neurons_per_pe;
+    return gid / max_num_lps_per_pe;
 }
 
 
@@ -659,53 +2382,36 @@ int32_t layout_master_local_id_to_doryta_id(size_t id) {
 }
 
 int32_t layout_master_local_id_to_doryta_id_for_pe(size_t id, size_t pe) {
-    size_t const max_pes = tw_nnodes();
-    size_t prev_num_neurons_in_pe = 0;
-    size_t num_neurons_in_pe = 0;
+    assert(local_offsets != NULL);
+    assert(pe < tw_nnodes());
+    int32_t const * const offsets = &local_offsets[pe * (num_neuron_groups + 1)];
 
-    for (int i = 0; i < num_neuron_groups; i++) {
-        size_t const num_neurons = neuron_groups[i].num_neurons;
-        size_t const initial_pe = neuron_groups[i].initial_pe;
-        size_t const final_pe = neuron_groups[i].final_pe;
-        size_t const total_pes = neuron_groups[i].total_pes;
-        size_t const global_neuron_offset = neuron_groups[i].global_neuron_offset;
-
-        // Yes, this is the same code used when reserving space for neurons
-        // in `layout_master_reserve_neurons`. The difference is that now we
-        // are computing these values for a given PE
-        bool const pe_inside_range = initial_pe <= final_pe ?
-            initial_pe <= pe && pe <= final_pe
-            : initial_pe <= pe || pe <= final_pe;
-        size_t const index_within_range = initial_pe <= pe ?
-            pe - initial_pe
-            : pe + (max_pes - initial_pe);
-        size_t const remainder_neurons = num_neurons % total_pes;
-        size_t const neurons_in_pe =
-            pe_inside_range ?
-            num_neurons / total_pes + (index_within_range < remainder_neurons)
-            : 0;
-
-        prev_num_neurons_in_pe = num_neurons_in_pe;
-        num_neurons_in_pe += neurons_in_pe;
-
-        if (id < num_neurons_in_pe) {
-            size_t const doryta_id_offset =
-                global_neuron_offset
-                + index_within_range * (num_neurons / total_pes)
-                + (index_within_range < remainder_neurons ?
-                        index_within_range : remainder_neurons);
-            return doryta_id_offset + (id - prev_num_neurons_in_pe);
-        }
-    }
-    tw_error(TW_LOC, "The given local id (%lu) for PE (%lu) is out of range. "
-            "There are only %lu LPs in the PE", id, pe, g_tw_nlp);
-    return -1;
+    if (id >= (size_t) offsets[num_neuron_groups]) {
+        tw_error(TW_LOC, "The given local id (%lu) for PE (%lu) is out of range. "
+                "There are only %lu LPs in the PE", id, pe, g_tw_nlp);
+    }
+
+    // The group is the last one starting at or before `id` (groups without
+    // neurons in the PE start where the next group starts, so they are
+    // skipped)
+    int low = 0;
+    int high = num_neuron_groups - 1;
+    while (low < high) {
+        int const mid = low + (high - low + 1) / 2;
+        if ((size_t) offsets[mid] <= id) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    return group_doryta_id_in_pe(low, pe, id - offsets[low]);
 }
 
 
 int32_t layout_master_gid_to_doryta_id(size_t gid) {
     size_t pe = layout_master_gid_to_pe(gid);
-    return layout_master_local_id_to_doryta_id_for_pe(gid % max_num_neurons_per_pe, pe);
+    return layout_master_local_id_to_doryta_id_for_pe(gid % max_num_lps_per_pe, pe);
 }
 
 size_t layout_master_doryta_id_to_local_id(int32_t doryta_id) {
@@ -715,83 +2421,21 @@ size_t layout_master_doryta_id_to_local_id(int32_t doryta_id) {
 }
 
 static inline size_t get_local_offset_for_level_in_pe(size_t pe, int level) {
+    assert(local_offsets != NULL);
     assert(pe < tw_nnodes());
-    assert(level < num_neuron_groups);
-
-    size_t const max_pes = tw_nnodes();
-    size_t num_neurons_in_pe = 0;
-
-    for (int i = 0; i < level; i++) {
-        size_t const num_neurons = neuron_groups[i].num_neurons;
-        size_t const initial_pe = neuron_groups[i].initial_pe;
-        size_t const final_pe = neuron_groups[i].final_pe;
-        size_t const total_pes = neuron_groups[i].total_pes;
-
-        // Yes, this is the same code used when reserving space for neurons
-        // in `layout_master_reserve_neurons`. The difference is that now we
-        // are computing these values for a given PE
-        bool const pe_inside_range = initial_pe <= final_pe ?
-            initial_pe <= pe && pe <= final_pe
-            : initial_pe <= pe || pe <= final_pe;
-        size_t const index_within_range = initial_pe <= pe ?
-            pe - initial_pe
-            : pe + (max_pes - initial_pe);
-        size_t const remainder_neurons = num_neurons % total_pes;
-        size_t const neurons_in_pe =
-            pe_inside_range ?
-            num_neurons / total_pes + (index_within_range < remainder_neurons)
-            : 0;
-
-        num_neurons_in_pe += neurons_in_pe;
-    }
-
-    return num_neurons_in_pe;
+    assert(level <= num_neuron_groups);
+    return local_offsets[pe * (num_neuron_groups + 1) + level];
 }
 
 
 size_t layout_master_doryta_id_to_gid(int32_t doryta_id) {
-    assert(doryta_id < total_neurons_globally);
-    int level;
+    assert(0 <= doryta_id && doryta_id < total_neurons_globally);
 
-    // Finding level in which DorytaID recides
-    for (level = 0; level < num_neuron_groups; level++) {
-        int32_t const num_neurons = neuron_groups[level].num_neurons;
-        int32_t const global_neuron_offset = neuron_groups[level].global_neuron_offset;
-        if (doryta_id < global_neuron_offset + num_neurons) {
-            break;
-        }
-    }
-    assert(level < num_neuron_groups);
-
-    // Finding PE in which DorytaID lives
-    size_t const global_neuron_offset = neuron_groups[level].global_neuron_offset;
-    size_t const num_neurons = neuron_groups[level].num_neurons;
-    size_t const initial_pe = neuron_groups[level].initial_pe;
-    size_t const total_pes = neuron_groups[level].total_pes;
-
-    size_t const neurons_per_pe = num_neurons / total_pes;
-    size_t const remainder_neurons = num_neurons % total_pes;
-
-    size_t const id_within_level = doryta_id - global_neuron_offset;
-    size_t pe;
+    int const level = group_of_doryta_id(doryta_id);
     size_t offset; // offset of neuron within layer in PE
+    size_t const pe = group_locate(level, doryta_id, &offset);
 
-    // The first `remainder_neurons` PEs will have a total of
-    // `neurons_per_pe + 1`. The ones that follow only have
-    // `remainder_neurons` each
-    size_t const neurons_within_remainder_pes = (neurons_per_pe + 1) * remainder_neurons;
-    if (id_within_level < neurons_within_remainder_pes) {
-        pe = id_within_level / (neurons_per_pe + 1);
-        offset = id_within_level % (neurons_per_pe + 1);
-    } else {
-        pe = remainder_neurons
-            + (id_within_level - neurons_within_remainder_pes) / neurons_per_pe;
-        offset = (id_within_level - neurons_within_remainder_pes) % neurons_per_pe;
-    }
-
-    pe = (pe + initial_pe) % tw_nnodes();
-
-    return pe * max_num_neurons_per_pe
+    return pe * max_num_lps_per_pe
         + get_local_offset_for_level_in_pe(pe, level)
         + offset;
 }
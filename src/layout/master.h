@@ -2,6 +2,7 @@
 #define DORYTA_SRC_LAYOUT_MASTER_H
 
 #include "../driver/neuron.h"
+#include "../driver/synapse.h"
 
 typedef void (*neuron_init_f) (void * neuron_struct, int32_t neuron_id);
 typedef float (*synapse_init_f) (int32_t neuron_from, int32_t neuron_to);
@@ -11,6 +12,48 @@ struct NeuronGroupInfo {
     int32_t num_neurons;
 };
 
+/**
+ * Options modifying how neurons and synapses are laid out.
+ *
+ * - `multicast`: a neuron sends a single spike to each PE it connects to.
+ *   One SynapseLP per PE (placed after all neurons) delivers the spike to the
+ *   synapses in the PE.
+ * - `relay_fanout`: neurons with more synapses than `relay_fanout` send their
+ *   spikes to a relay (a SynapseLP in the same PE) which delivers them in
+ *   batches. Zero means no relays.
+ * - `procedural_conv2d`: conv2d groups keep only their geometry and kernel.
+ *   Their synapses are not stored but generated every time a neuron fires.
+ * - `dense_all2all`: all2all groups keep their weights in a matrix (one row
+ *   per neuron in the PE). GIDs are not stored but derived when a neuron
+ *   fires. Weights are accessed through `layout_master_all2all_weights`.
+ * - `tiled_placement`: neuron groups connected by conv2d groups are cut into
+ *   2D tiles (one per PE) instead of ranges of consecutive DorytaIDs. Matching
+ *   tiles of groups with the same shape land on the same PE.
+ * - `neuron_loads`: expected load of each neuron (`num_neuron_loads` of them,
+ *   indexed by DorytaID), eg, as found by a previous run. Neuron groups (not
+ *   placed in tiles) are split into ranges with the same load, instead of the
+ *   same number of neurons. The array has to be valid until
+ *   `layout_master_init` is called. NULL means no loads.
+ *
+ * Neither `procedural_conv2d` nor `dense_all2all` can be combined with
+ * `multicast` or `relay_fanout`.
+ */
+struct LayoutMasterOptions {
+    bool multicast;
+    int32_t relay_fanout;
+    bool procedural_conv2d;
+    bool dense_all2all;
+    bool tiled_placement;
+    double const * neuron_loads;
+    int32_t num_neuron_loads;
+};
+
+/**
+ * Sets the options for the layout. It has to be called (if at all) before
+ * `layout_master_init`.
+ */
+void layout_master_set_options(struct LayoutMasterOptions const *);
+
 /**
  * Reserves N neuron IDs across indicated PEs.
  * The number of neurons must be more than zero.
@@ -54,15 +97,109 @@ void layout_master_synapses_conv2d(
         int32_t to_start, int32_t to_end,
         struct Conv2dParams const *);
 
+/** Connects the channels of an input layer (from) to the channels of an output
+ * layer (to) with a single conv2d group, as `layout_master_synapses_conv2d`
+ * would with one group per pair of channels. Each layer is a sequence of maps
+ * (one per channel) of the same shape, ie, `from_end - from_start + 1` must be
+ * a multiple of `input_width * in_channels`. Every input neuron connects to
+ * the same positions of all output channels. The kernel (see
+ * `layout_master_synapses_kernel`) holds one matrix per pair of channels.
+ */
+void layout_master_synapses_conv2d_channels(
+        int32_t from_start, int32_t from_end,
+        int32_t to_start, int32_t to_end,
+        struct Conv2dParams const *,
+        int32_t in_channels, int32_t out_channels);
+
+/**
+ * Connects each neuron of a range (from) to the neuron in the same position of
+ * another range of the same size (to), ie, `from_start + i` to `to_start + i`.
+ * `weights` holds the weight of each synapse (`from_end - from_start + 1` of
+ * them), and it is copied. If it is NULL, the weights are given by
+ * `synapse_init` (or zero). Synapses are not stored but generated when a
+ * neuron fires (only the weights of the neurons in the PE are kept), unless
+ * the layout uses multicast or relays.
+ */
+void layout_master_synapses_one2one(int32_t from_start, int32_t from_end,
+        int32_t to_start, int32_t to_end, float const * weights);
+
+/**
+ * Connects a range of neurons input (from) to a range of neurons output (to)
+ * with the synapses given in compressed sparse row (CSR) format. Neuron
+ * `from_start + i` connects to `to_start + col_idx[k]` for `k` from
+ * `row_ptr[i]` to `row_ptr[i+1] - 1`, with weight `weights[k]`. `row_ptr` has
+ * `from_end - from_start + 2` elements and starts at 0. The columns of a row
+ * must be sorted and unique. If `weights` is NULL, the weights are given by
+ * `synapse_init`. The arrays are copied, and the copy is freed once the
+ * synapses are stored by `layout_master_init`.
+ */
+void layout_master_synapses_sparse(int32_t from_start, int32_t from_end,
+        int32_t to_start, int32_t to_end,
+        int32_t const * row_ptr, int32_t const * col_idx, float const * weights);
+
+/**
+ * Sets the delay (in heartbeats) of the synapses in the latest group defined
+ * (by `layout_master_synapses_all2all`, `layout_master_synapses_conv2d`,
+ * `layout_master_synapses_one2one` or `layout_master_synapses_sparse`).
+ * Synapses have a delay of one heartbeat by default. The delay must be
+ * positive.
+ */
+void layout_master_synapses_delay(uint16_t delay);
+
+/**
+ * Sets the kernel (weights) of the latest group defined, which must have been
+ * defined by `layout_master_synapses_conv2d` (or its `_channels` variant).
+ * The kernel is an array of `kernel_height * kernel_width` elements (row by
+ * row), and it is copied. For groups with several channels, the kernel holds
+ * `in_channels * out_channels` of them: the matrix connecting input channel
+ * `i` to output channel `o` starts at `(i * out_channels + o) * kernel_height
+ * * kernel_width`. The
+ * weight of a synapse is taken from the kernel instead of `synapse_init`.
+ * With the option `procedural_conv2d`, all conv2d groups must have a kernel.
+ */
+void layout_master_synapses_kernel(float const * kernel);
+
+/**
+ * Sets the weights of the latest group defined, which must have been defined
+ * by `layout_master_synapses_all2all`. `matrix` holds one row (of `to_end -
+ * to_start + 1` weights) per neuron of `from`, and it is NOT copied: it must
+ * stay valid (and unchanged) until `layout_master_free` is called. Dense
+ * groups (option `dense_all2all`) use the weights in place, ie, `matrix` can
+ * be mapped from a file, and only the rows of the neurons in the PE are ever
+ * read. The weight of a synapse is taken from the matrix instead of
+ * `synapse_init`.
+ */
+void layout_master_synapses_weights(float const * matrix);
+
 /**
  * Defines custom mapping, and allocates memory for neurons and synapses.
  *
  * Notice that the space has been allocated but not initialized! You cannot
  * simply pass `neurons` and `synapses` to `SettingsNeuronLP`!
+ * Once the weights of all synapses have been set (by `synapse_init`, the
+ * layout or the model), `layout_master_synapses_loaded` has to be called.
  */
 void layout_master_init(int sizeof_neuron,
         neuron_init_f neuron_init, synapse_init_f synapse_init);
 
+/**
+ * Tells the layout that the weights of all synapses have been set. Multicast
+ * and relays take the synapses over at this point, so a model cannot walk the
+ * synapses of a neuron (to set their weights) anymore. It must be called
+ * before `layout_master_configure_synapse_lps`, and by all PEs at once.
+ */
+void layout_master_synapses_loaded(void);
+
+/**
+ * Weights of the synapses from `doryta_id` (a neuron in this PE) in the dense
+ * all2all group connecting to `to_start`-`to_end`, ie, an array of `to_end -
+ * to_start + 1` weights. It returns NULL if there is no such dense group (or
+ * its weights were given by `layout_master_synapses_weights`). It must be
+ * called after `layout_master_init`.
+ */
+float * layout_master_all2all_weights(
+        int32_t doryta_id, int32_t to_start, int32_t to_end);
+
 /**
  * Frees memory allocated by master_layout_init
  */
@@ -78,11 +215,72 @@ void layout_master_free(void);
 struct SettingsNeuronLP *
 layout_master_configure(struct SettingsNeuronLP *settingsNeuronLP);
 
+/**
+ * Removes the synapses whose weight (in absolute value) is not larger than
+ * `threshold` (eg, zero weights with a threshold of zero), and returns how
+ * many synapses of the neurons in this PE were removed. Stored synapses are
+ * dropped (and the array holding them shrunk), while the synapses of
+ * procedural groups are skipped when generated. It must be called once the
+ * weights of all synapses have been set (by the model) and before
+ * `layout_master_compact_synapses`, and it cannot be combined with multicast
+ * or relays.
+ */
+size_t layout_master_prune_synapses(float threshold);
+
+/**
+ * Synapses of the neurons in a PE, by where they are kept. `stored` are the
+ * synapses stored one by one (counted before multicast or relays take them
+ * over), `compact` those in the compact store, and `generated` those of
+ * procedural groups (generated every time a neuron fires). Pruned synapses
+ * are not counted. `remote` are the synapses (of any of the three kinds) that
+ * go to a neuron in another PE, and `compact_bytes` is the memory taken by
+ * the compact store.
+ */
+struct LayoutMasterSynapseStats {
+    size_t stored;
+    size_t compact;
+    size_t generated;
+    size_t remote;
+    size_t compact_bytes;
+};
+
+/**
+ * Counts the synapses of the neurons in this PE. It must be called after the
+ * synapses have been pruned and compacted (if they are).
+ */
+struct LayoutMasterSynapseStats layout_master_synapse_stats_pe(void);
+
+/**
+ * Moves the synapses (stored in `SettingsNeuronLP`) into a compact store. The
+ * compact store is a structure of arrays. The synapses of a neuron are grouped
+ * by destination PE, and only the LocalID of the destination (32 bits), the
+ * weight and the delay (only if a delay isn't one) are stored. The synapses
+ * are generated from it when a neuron fires. It must be called once the
+ * weights of all synapses have been set (by the model), and it cannot be
+ * combined with multicast or relays. As `layout_master_configure`, it
+ * modifies and returns the same pointer.
+ */
+struct SettingsNeuronLP *
+layout_master_compact_synapses(struct SettingsNeuronLP *settingsNeuronLP);
+
+/**
+ * Sets the SynapseLPs (if any) into `SettingsSynapseLP`. Only `beat` is left
+ * untouched. As `layout_master_configure`, it modifies and returns the same
+ * pointer.
+ */
+struct SettingsSynapseLP *
+layout_master_configure_synapse_lps(struct SettingsSynapseLP *settingsSynapseLP);
+
 /**
  * Returns the total number of lps (neurons and supporting lps) in this PE
  */
 size_t layout_master_total_lps_pe(void);
 
+/**
+ * Returns true if the GID corresponds to a SynapseLP (not a neuron).
+ */
+bool layout_master_gid_is_synapse_lp(uint64_t gid);
+
 /**
  * Returns the total number of neurons in this PE
  */
@@ -99,17 +297,20 @@ unsigned long layout_master_gid_to_pe(uint64_t gid);
 unsigned long layout_master_doryta_id_to_pe(int32_t doryta_id);
 
 /**
- * Converts DorytaID into GID.
+ * Converts DorytaID into GID. The group of the neuron is found by binary
+ * search over the groups (O(log groups)), the rest is arithmetic.
  */
 size_t layout_master_doryta_id_to_gid(int32_t doryta_id);
 
 /**
- * Converts GID into DorytaID.
+ * Converts GID into DorytaID. Same cost as
+ * `layout_master_local_id_to_doryta_id_for_pe`.
  */
 int32_t layout_master_gid_to_doryta_id(size_t gid);
 
 /**
- * Converts LocalID into DorytaID
+ * Converts LocalID into DorytaID. Same cost as
+ * `layout_master_local_id_to_doryta_id_for_pe`
  */
 int32_t layout_master_local_id_to_doryta_id(size_t id);
 
@@ -119,7 +320,9 @@ int32_t layout_master_local_id_to_doryta_id(size_t id);
 size_t layout_master_doryta_id_to_local_id(int32_t doryta_id);
 
 /**
- * Converts LocalID into DorytaID for an arbitrary PE
+ * Converts LocalID into DorytaID for an arbitrary PE. The group of the neuron
+ * is found by binary search over the row of the PE in the prefix table
+ * (O(log groups)), the rest is arithmetic.
  */
 int32_t layout_master_local_id_to_doryta_id_for_pe(size_t id, size_t pe);
 
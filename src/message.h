@@ -7,6 +7,9 @@
 #include <stddef.h>
 #include <stdint.h>
 
+// Upper limit for the space a neuron can use to store its state in a message.
+// The space actually reserved in each message is determined at runtime (see
+// `size_of_Message`)
 #define MESSAGE_SIZE_REVERSE 32
 
 // Order of types is important. An array of spikes is encoded as
@@ -18,38 +21,63 @@ enum MESSAGE_TYPE {
 };
 
 /**
+ * Fields are ordered to leave no padding in release mode (debug only fields
+ * are added to the union). A message ends with the space reserved for the
+ * neuron state, which size is only known at runtime. Thus, `sizeof(struct
+ * Message)` is NOT the size of a message, use `size_of_Message` instead.
+ *
  * Invariants:
  * - `spike_current` must be a number (not NaN)
  * - `neuron_from` must be less than the number of LPs in the system
  * - `neuron_to` must be less than the number of LPs in the system
+ * - `relay_next` must be non-negative
  */
 struct Message {
-    enum MESSAGE_TYPE type;
     double time_processed;
+    // Reverse only fields
+    double prev_heartbeat;
     union {
         struct { // message type = heartbeat
             bool fired;
+            // Reverse only field (accumulate mode). Current integrated at
+            // the heartbeat
+            float accumulated_current;
         };
         struct { // message type = spike
 #ifndef NDEBUG
             int32_t neuron_from; // DorytaID
             int32_t neuron_to;   // DorytaID
+            int64_t neuron_to_gid;
 #endif
             int64_t neuron_from_gid;
-            int64_t neuron_to_gid;
             float spike_current;
+            // Only used by SynapseLPs. Index of the next synapse to deliver
+            // to (non-zero only when a SynapseLP schedules the next batch of
+            // spikes to itself)
+            int32_t relay_next;
         };
     };
-    // Reverse only fields
-    double prev_heartbeat;
-    // This reserves MESSAGE_SIZE_REVERSE bytes (enough for
-    // MESSAGE_SIZE_REVERSE/4 double-precision floating point numbers,
-    // MESSAGE_SIZE_REVERSE/8 64-bit integers, or really anything that can occupy
-    // that same space. This is meant to be used by the neuron mechanism to store
-    // and restore the state of the neuron.)
-    char reserved_for_reverse[MESSAGE_SIZE_REVERSE];
+    enum MESSAGE_TYPE type;
+    // Only set by SynapseLPs (for probes). Number of events sent while
+    // processing the message. It takes the padding after `type`
+    int32_t sent_by_synapse_lp;
+    // This is meant to be used by the neuron mechanism to store and restore
+    // the state of the neuron. Its size (at most MESSAGE_SIZE_REVERSE) depends
+    // on the neuron type. It is aligned as a double, so that any struct can
+    // be stored in it
+    _Alignas(double) char reserved_for_reverse[];
 };
 
+/**
+ * Size of a message with enough space to store `storage_size` bytes of neuron
+ * state. This is the message size to pass to ROSS.
+ */
+static inline size_t size_of_Message(size_t storage_size) {
+    assert(storage_size <= MESSAGE_SIZE_REVERSE);
+    size_t const size = offsetof(struct Message, reserved_for_reverse) + storage_size;
+    return size < sizeof(struct Message) ? sizeof(struct Message) : size;
+}
+
 // Creates a message with the appropiate fields loaded. Default values are
 // given to all fields. Some default values are incorrect and must be
 // overwritten by the user (eg, `neuron_from`). This function just ensures
@@ -57,6 +85,7 @@ struct Message {
 // `time_processed` and `fired`)
 static inline void initialize_Message(struct Message * msg, enum MESSAGE_TYPE type) {
     msg->time_processed = -1;
+    msg->sent_by_synapse_lp = 0;
     switch (type) {
         case MESSAGE_TYPE_heartbeat:
             msg->type = MESSAGE_TYPE_heartbeat;
@@ -68,9 +97,10 @@ static inline void initialize_Message(struct Message * msg, enum MESSAGE_TYPE ty
 #ifndef NDEBUG
             msg->neuron_from = -1;
             msg->neuron_to = -1;
+            msg->neuron_to_gid = -1;
 #endif
             msg->neuron_from_gid = -1;
-            msg->neuron_to_gid = -1;
+            msg->relay_next = 0;
             break;
     }
 }
@@ -87,9 +117,10 @@ static inline bool is_valid_Message(struct Message * msg) {
                        && 0 <= msg->neuron_to
                        && (uint64_t) msg->neuron_from < g_tw_total_lps
                        && (uint64_t) msg->neuron_to < g_tw_total_lps
+                       && 0 <= msg->neuron_to_gid
 #endif
                        && 0 <= msg->neuron_from_gid
-                       && 0 <= msg->neuron_to_gid
+                       && 0 <= msg->relay_next
                        ;
     }
     return correct_spike;
@@ -105,6 +136,7 @@ static inline void assert_valid_Message(struct Message * msg) {
         assert((uint64_t) msg->neuron_to < g_tw_total_lps);
         assert(0 <= msg->neuron_from_gid);
         assert(0 <= msg->neuron_to_gid);
+        assert(0 <= msg->relay_next);
     }
 #endif // NDEBUG
 }
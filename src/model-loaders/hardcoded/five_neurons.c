@@ -105,6 +105,8 @@ model_five_neurons_init(struct SettingsNeuronLP * settings_neuron_lp) {
       .neuron_fire       = (neuron_fire_f) neurons_lif_fire,
       .store_neuron         = (neuron_state_op_f) neurons_lif_store_state,
       .reverse_store_neuron = (neuron_state_op_f) neurons_lif_reverse_store_state,
+      .sizeof_storage       = sizeof(struct StorageInMessageLif),
+      .neuron_type          = NEURON_TYPE_lif,
       .print_neuron_struct  = (print_neuron_f) neurons_lif_print,
       //.gid_to_doryta_id    = ...
       //.probe_events     = probe_events,
@@ -120,6 +122,7 @@ model_five_neurons_init(struct SettingsNeuronLP * settings_neuron_lp) {
     layout_master_init(sizeof(struct LifNeuron),
             (neuron_init_f) initialize_LIF,
             (synapse_init_f) initialize_weight_neurons);
+    layout_master_synapses_loaded();
     // Modifying and loading neuron configuration (it will be truly loaded
     // once the simulation starts)
     layout_master_configure(settings_neuron_lp);
@@ -1,11 +1,9 @@
 #include "gameoflife.h"
+#include <ross.h>
 #include "../../layout/master.h"
 #include "../../layout/standard_layouts.h"
 #include "../../neurons/lif.h"
 
-// Defined in ross.h
-unsigned int tw_nnodes(void);
-
 static int32_t width_world = 20;  // Default size of GoL is 20x20
 
 
@@ -41,37 +39,15 @@ static void initialize_LIF(struct LifNeuron * lif, int32_t doryta_id) {
 
 // The kernels to implement:
 // Board -> Life
-//   [1, 1, 1,
-//    1, 1, 1,
-//    1, 1, 1]
+static float const board_to_life[9] = {1, 1, 1,
+                                       1, 1, 1,
+                                       1, 1, 1};
 // Board -> Kill
-//   [1, 1, 1,
-//    1, 0, 1,
-//    1, 1, 1]
-// Life -> Board
-//   [1]
-// Kill -> Board
-//   [-1]
-static float initialize_weight_neurons(int32_t neuron_from, int32_t neuron_to) {
-    int32_t const size_world = width_world * width_world;
-
-    float weight = 0.0;
-    if (neuron_from < size_world) {  // From Board cell
-        assert(neuron_to >= size_world);
-        if (neuron_to < 2 * size_world) {  // To Life cell
-            weight = 1;
-        } else if (neuron_to < 3 * size_world) { // To Kill cell
-            weight = neuron_to - 2 * size_world == neuron_from ? 0 : 1;
-        }
-    } else if (neuron_from < 2 * size_world) { // From Life cell
-        assert(neuron_to < size_world);
-        weight = 1;
-    } else if (neuron_from < 3 * size_world) { // From Kill cell
-        assert(neuron_to < size_world);
-        weight = -1;
-    }
-    return weight;
-}
+static float const board_to_kill[9] = {1, 1, 1,
+                                       1, 0, 1,
+                                       1, 1, 1};
+// Life -> Board: one2one with weight 1
+// Kill -> Board: one2one with weight -1
 
 
 struct ModelParams
@@ -96,6 +72,8 @@ model_GoL_neurons_init(
       .neuron_fire       = (neuron_fire_f) neurons_lif_fire,
       .store_neuron         = (neuron_state_op_f) neurons_lif_store_state,
       .reverse_store_neuron = (neuron_state_op_f) neurons_lif_reverse_store_state,
+      .sizeof_storage       = sizeof(struct StorageInMessageLif),
+      .neuron_type          = NEURON_TYPE_lif,
       .print_neuron_struct  = (print_neuron_f) neurons_lif_print,
       //.gid_to_doryta_id    = ...
       //.probe_events     = probe_events,
@@ -131,32 +109,38 @@ model_GoL_neurons_init(
             layer_1st_start, layer_1st_end,
             layer_2nd_start, layer_2nd_end,
             &conv2d_params);
+    layout_master_synapses_kernel(board_to_life);
     layout_master_synapses_conv2d(
             layer_1st_start, layer_1st_end,
             layer_3rd_start, layer_3rd_end,
             &conv2d_params);
-    struct Conv2dParams const one2one_params = {
-            .input_width    = width_world,
-            .kernel_width   = 1,
-            .kernel_height  = 1,
-            .padding_width  = 0,
-            .padding_height = 0,
-            .stride_width  = 1,
-            .stride_height = 1,
-    };
-    layout_master_synapses_conv2d(
+    layout_master_synapses_kernel(board_to_kill);
+    float * one2one_weights = malloc(size_world * sizeof(float));
+    if (one2one_weights == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space for the weights");
+    }
+    // The layout keeps its own copy of the weights
+    for (int32_t i = 0; i < size_world; i++) {
+        one2one_weights[i] = 1;
+    }
+    layout_master_synapses_one2one(
             layer_2nd_start, layer_2nd_end,
             layer_1st_start, layer_1st_end,
-            &one2one_params);
-    layout_master_synapses_conv2d(
+            one2one_weights);
+    for (int32_t i = 0; i < size_world; i++) {
+        one2one_weights[i] = -1;
+    }
+    layout_master_synapses_one2one(
             layer_3rd_start, layer_3rd_end,
             layer_1st_start, layer_1st_end,
-            &one2one_params);
+            one2one_weights);
+    free(one2one_weights);
 
     // Allocates space for neurons and synapses
     layout_master_init(sizeof(struct LifNeuron),
-            (neuron_init_f) initialize_LIF,
-            (synapse_init_f) initialize_weight_neurons);
+            (neuron_init_f) initialize_LIF, (synapse_init_f) NULL);
+    // All weights are set by the layout (kernels and one2one weights)
+    layout_master_synapses_loaded();
     layout_master_configure(settings_neuron_lp);
 
     return (struct ModelParams) {
@@ -2,11 +2,56 @@
 #include "../../layout/master.h"
 #include "../../layout/standard_layouts.h"
 #include "../../neurons/lif.h"
+#include "../../utils/interval_index.h"
 #include "../../utils/io.h"
+#include "../../utils/math.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
+// Where the neurons of a PE are read from
+enum NEURONS_SOURCE {
+    NEURONS_SOURCE_model,     // The model file (skipping the neurons of other PEs)
+    NEURONS_SOURCE_scattered, // Memory, as sent by the reader (PE 0 or one per node)
+    NEURONS_SOURCE_shard,     // A shard (only the neurons of the PE are in it)
+};
+
 static void load_v1(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp);
-static void load_v2(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp);
+static void load_v2(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp,
+        uint16_t format, enum NEURONS_SOURCE source);
+static void map_model(char const filename[]);
+static char * receive_beginning(size_t * size);
+static void shard_filename(char filename[PATH_MAX], char const prefix[]);
+
+// The model file mapped in memory (format 8). The layout uses the weights of
+// all2all groups in place, so the file stays mapped until the model is
+// deinitialized
+static void * mapped_model = NULL;
+static size_t mapped_model_size = 0;
+
+// Shards to write while loading the model (see `model_load_neurons_partition`)
+static char const * shards_to_save = NULL;
+
+// PEs among which the model is scattered (see
+// `model_load_neurons_init_scattered`). The PE with rank 0 in `scatter_comm`
+// reads the file. It is either all PEs or the PEs in a node (see
+// `model_load_neurons_init_scattered_per_node`)
+static bool scatter_per_node = false;
+static MPI_Comm scatter_comm;
+static int scatter_rank = 0;
+
+// Checks the magic number, and returns the format of the file
+static uint16_t load_format(FILE * fp) {
+    uint32_t magic = load_uint32(fp);
+    if (magic != 0x23432BC4) {
+        tw_error(TW_LOC, "Input file corrupt or unknown (note: incorrect magic number)");
+    }
+    return load_uint16(fp);
+}
 
 struct ModelParams
 model_load_neurons_init(struct SettingsNeuronLP * settings_neuron_lp,
@@ -15,15 +60,17 @@ model_load_neurons_init(struct SettingsNeuronLP * settings_neuron_lp,
     if (!fp) {
         tw_error(TW_LOC, "File `%s` could not be read", filename);
     }
-    uint32_t magic = load_uint32(fp);
-    if (magic != 0x23432BC4) {
-        tw_error(TW_LOC, "Input file corrupt or unknown (note: incorrect magic number)");
-    }
-    uint16_t format = load_uint16(fp);
+    uint16_t format = load_format(fp);
     if (format == 0x1) {
         load_v1(settings_neuron_lp, fp);
-    } else if (format == 0x2) {
-        load_v2(settings_neuron_lp, fp);
+    } else if (format >= 0x2 && format <= 0x8) {
+        if (format >= 0x8) {
+            map_model(filename);
+        }
+        load_v2(settings_neuron_lp, fp, format, NEURONS_SOURCE_model);
+    } else if (format == 0x9) {
+        fclose(fp);
+        tw_error(TW_LOC, "File `%s` is the shard of a partitioned model", filename);
     } else {
         fclose(fp);
         tw_error(TW_LOC, "Input file corrupt or format unknown");
@@ -37,6 +84,123 @@ model_load_neurons_init(struct SettingsNeuronLP * settings_neuron_lp,
 }
 
 
+struct ModelParams
+model_load_neurons_init_scattered(struct SettingsNeuronLP * settings_neuron_lp,
+        char const filename[]) {
+    // Only the reader opens the file. The other PEs read the beginning of the
+    // file (up to the first neuron) from memory once the reader has sent it
+    if (scatter_per_node) {
+        MPI_Comm_split_type(MPI_COMM_ROSS, MPI_COMM_TYPE_SHARED, (int) g_tw_mynode,
+                MPI_INFO_NULL, &scatter_comm);
+    } else {
+        scatter_comm = MPI_COMM_ROSS;
+    }
+    MPI_Comm_rank(scatter_comm, &scatter_rank);
+
+    FILE * fp;
+    char * beginning = NULL;
+    if (scatter_rank == 0) {
+        fp = fopen(filename, "rb");
+        if (!fp) {
+            tw_error(TW_LOC, "File `%s` could not be read", filename);
+        }
+    } else {
+        size_t size;
+        beginning = receive_beginning(&size);
+        fp = fmemopen(beginning, size, "rb");
+        if (!fp) {
+            tw_error(TW_LOC, "Not able to read the model sent by the reader");
+        }
+    }
+    uint16_t format = load_format(fp);
+    if (format >= 0x2 && format <= 0x7) {
+        load_v2(settings_neuron_lp, fp, format, NEURONS_SOURCE_scattered);
+    } else {
+        fclose(fp);
+        tw_error(TW_LOC, "Only model formats 2 to 7 can be scattered");
+    }
+    fclose(fp);
+    free(beginning);
+    if (scatter_per_node) {
+        MPI_Comm_free(&scatter_comm);
+    }
+
+    return (struct ModelParams) {
+        .lps_in_pe = layout_master_total_lps_pe(),
+        .gid_to_pe = layout_master_gid_to_pe,
+    };
+}
+
+
+struct ModelParams
+model_load_neurons_init_scattered_per_node(struct SettingsNeuronLP * settings_neuron_lp,
+        char const filename[]) {
+    scatter_per_node = true;
+    struct ModelParams const params =
+        model_load_neurons_init_scattered(settings_neuron_lp, filename);
+    scatter_per_node = false;
+    return params;
+}
+
+
+struct ModelParams
+model_load_neurons_partition(struct SettingsNeuronLP * settings_neuron_lp,
+        char const filename[], char const prefix[]) {
+    shards_to_save = prefix;
+    struct ModelParams const params =
+        model_load_neurons_init_scattered(settings_neuron_lp, filename);
+    shards_to_save = NULL;
+    return params;
+}
+
+
+// A shard (format 9) holds the neurons of a single PE of a partitioned
+// model. It starts with the PE (int32) and the number of PEs (int32) of the
+// partition. Then, it holds the model (format 2 to 7, starting with its magic
+// number) up to its first neuron, followed by the number of neurons in the PE
+// (int32), their DorytaIDs (int32 each), their GIDs (uint64 each) and the
+// neurons themselves, as they are stored in the model. The GIDs are those the
+// layout gave the neurons when partitioning, and they have to match those of
+// the simulation. Synapses are stored as in the model: pruning and compacting
+// them depend on the options of the simulation, and are done once the shard
+// is loaded
+struct ModelParams
+model_load_neurons_init_shard(struct SettingsNeuronLP * settings_neuron_lp,
+        char const prefix[]) {
+    char filename[PATH_MAX];
+    shard_filename(filename, prefix);
+    FILE * fp = fopen(filename, "rb");
+    if (!fp) {
+        tw_error(TW_LOC, "Shard `%s` could not be read (note: was the model "
+                "partitioned for %lu PEs?)", filename, (unsigned long) tw_nnodes());
+    }
+    if (load_format(fp) != 0x9) {
+        fclose(fp);
+        tw_error(TW_LOC, "File `%s` is not a shard", filename);
+    }
+    int32_t const pe = load_int32(fp);
+    int32_t const num_pes = load_int32(fp);
+    if (pe < 0 || (tw_peid) pe != g_tw_mynode || (unsigned long) num_pes != tw_nnodes()) {
+        fclose(fp);
+        tw_error(TW_LOC, "Shard `%s` belongs to PE %" PRIi32 " of %" PRIi32,
+                filename, pe, num_pes);
+    }
+    uint16_t format = load_format(fp);
+    if (format >= 0x2 && format <= 0x7) {
+        load_v2(settings_neuron_lp, fp, format, NEURONS_SOURCE_shard);
+    } else {
+        fclose(fp);
+        tw_error(TW_LOC, "Shard corrupt or format unknown");
+    }
+    fclose(fp);
+
+    return (struct ModelParams) {
+        .lps_in_pe = layout_master_total_lps_pe(),
+        .gid_to_pe = layout_master_gid_to_pe,
+    };
+}
+
+
 static void load_neuron_params(struct LifNeuron * neuron, FILE * fp) {
     *neuron = (struct LifNeuron) {
         .potential         = load_float(fp),
@@ -50,6 +214,18 @@ static void load_neuron_params(struct LifNeuron * neuron, FILE * fp) {
 }
 
 
+// Weights read at once (on the stack) from all2all groups
+#define LOAD_CHUNK 1024
+
+// Range of neurons connected by a synapse group
+struct GroupRange {
+    int32_t from_start;
+    int32_t from_end;
+    int32_t to_start;
+    int32_t to_end;
+};
+
+
 static void load_v1(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
 #ifndef NDEBUG
     int32_t const total_num_neurons =
@@ -72,12 +248,19 @@ static void load_v1(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
     }
     assert(total_num_neurons == to_check_total_neurons);
 
+    struct GroupRange all2all_groups[synapse_groups];
     for (uint8_t i = 0; i < synapse_groups; i++) {
         int32_t const from_start = load_int32(fp);
         int32_t const from_end   = load_int32(fp);
         int32_t const to_start   = load_int32(fp);
         int32_t const to_end     = load_int32(fp);
         layout_master_synapses_all2all(from_start, from_end, to_start, to_end);
+        all2all_groups[i] = (struct GroupRange) {
+            .from_start = from_start,
+            .from_end = from_end,
+            .to_start = to_start,
+            .to_end = to_end,
+        };
     }
 
     // Setting the driver configuration
@@ -94,6 +277,8 @@ static void load_v1(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
       .neuron_fire       = (neuron_fire_f) neurons_lif_fire,
       .store_neuron         = (neuron_state_op_f) neurons_lif_store_state,
       .reverse_store_neuron = (neuron_state_op_f) neurons_lif_reverse_store_state,
+      .sizeof_storage       = sizeof(struct StorageInMessageLif),
+      .neuron_type          = NEURON_TYPE_lif,
       .print_neuron_struct  = (print_neuron_f) neurons_lif_print,
       //.gid_to_doryta_id    = ...
       //.probe_events     = probe_events,
@@ -134,17 +319,43 @@ static void load_v1(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
 
         int32_t const num_synapses = load_int32(fp);
         //printf("PE %lu - neuron id %d - num synapses %d\n", g_tw_mynode, doryta_id, num_synapses);
-        assert((int32_t) settings_neuron_lp->synapses[i].num == num_synapses);
 
-        // Loading synapses
+        // Loading synapses. They are stored group after group. Dense groups
+        // keep their weights in the layout, not in the synapses of the neuron
         if (num_synapses) {
-            float synapses_raw[num_synapses];
+            // (on the heap, a large layer would overflow the stack)
+            float * const synapses_raw = malloc(num_synapses * sizeof(float));
+            if (synapses_raw == NULL) {
+                tw_error(TW_LOC, "Not able to allocate space for the synapses of a neuron");
+            }
             load_floats(fp, synapses_raw, num_synapses);
             struct Synapse * synapses_neuron = settings_neuron_lp->synapses[i].synapses;
-            for (int32_t j = 0; j < num_synapses; j++) {
-                synapses_neuron[j].weight = synapses_raw[j];
-                synapses_neuron[j].delay = 1;
+            int32_t j = 0;
+            int32_t stored = 0;
+            for (uint8_t k = 0; k < synapse_groups; k++) {
+                struct GroupRange const * group = &all2all_groups[k];
+                if (doryta_id < group->from_start || group->from_end < doryta_id) {
+                    continue;
+                }
+                int32_t const num_synapses_group = group->to_end - group->to_start + 1;
+                float * const dense_weights = layout_master_all2all_weights(
+                        doryta_id, group->to_start, group->to_end);
+                for (int32_t l = 0; l < num_synapses_group; l++) {
+                    assert(j + l < num_synapses);
+                    if (dense_weights != NULL) {
+                        dense_weights[l] = synapses_raw[j + l];
+                    } else {
+                        synapses_neuron[stored].weight = synapses_raw[j + l];
+                        stored++;
+                    }
+                }
+                j += num_synapses_group;
             }
+            assert(j == num_synapses);
+            assert(stored == settings_neuron_lp->synapses[i].num);
+            free(synapses_raw);
+        } else {
+            assert(settings_neuron_lp->synapses[i].num == 0);
         }
         i_in_file++;
         /*
@@ -154,20 +365,376 @@ static void load_v1(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
          *        reset_potential, threshold, tau, num_synapses);
          */
     }
+    layout_master_synapses_loaded();
 }
 
 
-struct Conv2dGroup {
-    int32_t from_start;
-    int32_t from_end;
-    int32_t to_start;
-    int32_t to_end;
-    int32_t kernel_size;
-    float * kernel_data;
+// Maps the whole file (read only). The weights in it must be in the byte
+// order of the machine
+static void map_model(char const filename[]) {
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    tw_error(TW_LOC, "Model format 8 can only be loaded on little-endian machines");
+#endif
+    assert(mapped_model == NULL);
+    int const fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        tw_error(TW_LOC, "File `%s` could not be mapped", filename);
+    }
+    mapped_model_size = st.st_size;
+    mapped_model = mmap(NULL, mapped_model_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the file is closed
+    close(fd);
+    if (mapped_model == MAP_FAILED) {
+        mapped_model = NULL;
+        tw_error(TW_LOC, "File `%s` could not be mapped", filename);
+    }
+}
+
+
+// ================== SCATTERING THE MODEL FROM PE 0 (OR A NODE) ==================
+
+// Neurons (in bytes) that the reader reads before sending them to their PEs
+#define SCATTER_ROUND (64 << 20)
+// Largest message of a broadcast (MPI counts are `int`)
+#define BCAST_CHUNK (1 << 30)
+
+// Growing array of bytes
+struct Bytes {
+    char * data;
+    size_t size;
+    size_t capacity;
 };
 
+// Makes space for `n` more bytes at the end of the array, and returns them
+static char * bytes_extend(struct Bytes * bytes, size_t n) {
+    if (bytes->data == NULL || bytes->size + n > bytes->capacity) {
+        size_t capacity = bytes->capacity > 0 ? bytes->capacity : 4096;
+        while (bytes->size + n > capacity) {
+            capacity *= 2;
+        }
+        char * data = realloc(bytes->data, capacity);
+        if (data == NULL) {
+            tw_error(TW_LOC, "Not able to allocate space for the neurons of the model");
+        }
+        bytes->data = data;
+        bytes->capacity = capacity;
+    }
+    char * const extension = bytes->data + bytes->size;
+    bytes->size += n;
+    return extension;
+}
+
+// Appends the next `n` bytes in the file, and returns them
+static char * bytes_read(struct Bytes * bytes, FILE * fp, size_t n) {
+    char * const read = bytes_extend(bytes, n);
+    check_if_failure(fp, fread(read, 1, n, fp), n);
+    return read;
+}
+
+// Copies the next neuron in the file (formats 2 to 7): its parameters and the
+// weights of its fully groups
+static void copy_neuron(struct Bytes * bytes, FILE * fp) {
+    uint16_t num_groups_fully;
+    char const * const params =
+        bytes_read(bytes, fp, 7 * sizeof(float) + sizeof(num_groups_fully));
+    memcpy(&num_groups_fully, params + 7 * sizeof(float), sizeof(num_groups_fully));
+    num_groups_fully = ntohs(num_groups_fully);
+    for (uint16_t j = 0; j < num_groups_fully; j++) {
+        uint32_t range[2];
+        memcpy(range, bytes_read(bytes, fp, sizeof(range)), sizeof(range));
+        int32_t const to_start = ntohl(range[0]);
+        int32_t const to_end = ntohl(range[1]);
+        if (to_end < to_start) {
+            tw_error(TW_LOC, "Input file corrupt (note: invalid range of a fully group)");
+        }
+        bytes_read(bytes, fp, (size_t) (to_end - to_start + 1) * sizeof(float));
+    }
+}
+
+static void bcast_bytes(char * data, size_t size) {
+    for (size_t i = 0; i < size; i += BCAST_CHUNK) {
+        int const count = size - i < BCAST_CHUNK ? size - i : BCAST_CHUNK;
+        MPI_Bcast(data + i, count, MPI_BYTE, 0, scatter_comm);
+    }
+}
+
+// The reader sends the file up to the current position (the beginning of the
+// neurons). Everything before the neurons is needed by all PEs to define the
+// layout
+static void send_beginning(FILE * fp) {
+    assert(scatter_rank == 0);
+    long const position = ftell(fp);
+    uint64_t size = position;
+    char * beginning = malloc(size);
+    if (beginning == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space for the beginning of the model");
+    }
+    rewind(fp);
+    check_if_failure(fp, fread(beginning, 1, size, fp), size);
+    fseek(fp, position, SEEK_SET);
+
+    MPI_Bcast(&size, 1, MPI_UINT64_T, 0, scatter_comm);
+    bcast_bytes(beginning, size);
+    free(beginning);
+}
+
+// The other end of `send_beginning`
+static char * receive_beginning(size_t * size) {
+    assert(scatter_rank != 0);
+    uint64_t size_beginning;
+    MPI_Bcast(&size_beginning, 1, MPI_UINT64_T, 0, scatter_comm);
+    char * beginning = malloc(size_beginning);
+    if (beginning == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space for the beginning of the model");
+    }
+    bcast_bytes(beginning, size_beginning);
+    *size = size_beginning;
+    return beginning;
+}
+
+// The reader goes through the neurons in the file (`fp` is only used by the
+// reader), sending to each PE (in `scatter_comm`) its neurons in rounds of
+// `SCATTER_ROUND` bytes. The neurons of PEs in other nodes are skipped. Each PE
+// gets its neurons back to back, in the order in which they are in the file.
+// It returns the neurons of the PE, and their size
+static char * scatter_neurons(FILE * fp, int32_t total_neurons, size_t * size) {
+    bool const is_root = scatter_rank == 0;
+    struct Bytes own = {0};
+    int num_ranks;
+    MPI_Comm_size(scatter_comm, &num_ranks);
 
-static void load_v2(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
+    // Used by the reader only: the rank of each PE (-1 if it isn't in
+    // `scatter_comm`), the neurons of each rank in the round, then all of them
+    // together to be sent
+    int const pe = g_tw_mynode;
+    int * pes = NULL;
+    int * rank_of_pe = NULL;
+    struct Bytes * rank_neurons = NULL;
+    struct Bytes skipped = {0};
+    struct Bytes to_send = {0};
+    int * counts = NULL;
+    int * displs = NULL;
+    if (is_root) {
+        size_t const num_pes = tw_nnodes();
+        pes = malloc(num_ranks * sizeof(int));
+        rank_of_pe = malloc(num_pes * sizeof(int));
+        rank_neurons = calloc(num_ranks, sizeof(struct Bytes));
+        counts = malloc(num_ranks * sizeof(int));
+        displs = malloc(num_ranks * sizeof(int));
+        if (pes == NULL || rank_of_pe == NULL || rank_neurons == NULL
+                || counts == NULL || displs == NULL) {
+            tw_error(TW_LOC, "Not able to allocate space to scatter the neurons");
+        }
+        for (size_t i = 0; i < num_pes; i++) {
+            rank_of_pe[i] = -1;
+        }
+    }
+    MPI_Gather(&pe, 1, MPI_INT, pes, 1, MPI_INT, 0, scatter_comm);
+    if (is_root) {
+        for (int rank = 0; rank < num_ranks; rank++) {
+            rank_of_pe[pes[rank]] = rank;
+        }
+    }
+
+    int32_t next_neuron = 0;
+    while (true) {
+        int more = is_root && next_neuron < total_neurons;
+        MPI_Bcast(&more, 1, MPI_INT, 0, scatter_comm);
+        if (!more) {
+            break;
+        }
+
+        if (is_root) {
+            size_t in_round = 0;
+            while (next_neuron < total_neurons && in_round < SCATTER_ROUND) {
+                int const rank = rank_of_pe[layout_master_doryta_id_to_pe(next_neuron)];
+                if (rank < 0) {
+                    skipped.size = 0;
+                    copy_neuron(&skipped, fp);
+                    next_neuron++;
+                    continue;
+                }
+                struct Bytes * neurons = &rank_neurons[rank];
+                size_t const before = neurons->size;
+                copy_neuron(neurons, fp);
+                in_round += neurons->size - before;
+                next_neuron++;
+            }
+            if (in_round > INT_MAX) {
+                tw_error(TW_LOC, "A neuron is too large to be scattered");
+            }
+            to_send.size = 0;
+            for (int rank = 0; rank < num_ranks; rank++) {
+                counts[rank] = rank_neurons[rank].size;
+                displs[rank] = to_send.size;
+                if (rank_neurons[rank].size > 0) {
+                    memcpy(bytes_extend(&to_send, rank_neurons[rank].size),
+                            rank_neurons[rank].data, rank_neurons[rank].size);
+                }
+                rank_neurons[rank].size = 0;
+            }
+        }
+
+        int count;
+        MPI_Scatter(counts, 1, MPI_INT, &count, 1, MPI_INT, 0, scatter_comm);
+        char * const received = bytes_extend(&own, count);
+        MPI_Scatterv(to_send.data, counts, displs, MPI_BYTE,
+                received, count, MPI_BYTE, 0, scatter_comm);
+    }
+
+    if (is_root) {
+        for (int rank = 0; rank < num_ranks; rank++) {
+            free(rank_neurons[rank].data);
+        }
+        free(rank_neurons);
+        free(skipped.data);
+        free(to_send.data);
+        free(counts);
+        free(displs);
+        free(rank_of_pe);
+        free(pes);
+    }
+
+    *size = own.size;
+    return own.data;
+}
+
+// ================================ SHARDS ================================
+
+// Name of the shard of the PE: `<prefix>.<pe>-of-<number of PEs>`
+static void shard_filename(char filename[PATH_MAX], char const prefix[]) {
+    unsigned long const pe = g_tw_mynode;
+    unsigned long const num_pes = tw_nnodes();
+    int const size = snprintf(filename, PATH_MAX, "%s.%lu-of-%lu", prefix, pe, num_pes);
+    if (size < 0 || size >= PATH_MAX) {
+        tw_error(TW_LOC, "The name of the shard is too long (prefix `%s`)", prefix);
+    }
+}
+
+// Saves the shard of the PE (see `model_load_neurons_init_shard`). `fp` holds
+// the model up to its first neuron (`size_beginning` bytes), and `neurons` the
+// neurons of the PE
+static void save_shard(FILE * fp, long size_beginning,
+        struct SettingsNeuronLP const * settings_neuron_lp,
+        char const * neurons, size_t size_neurons) {
+    char filename[PATH_MAX];
+    shard_filename(filename, shards_to_save);
+    FILE * shard = fopen(filename, "wb");
+    if (!shard) {
+        tw_error(TW_LOC, "Shard `%s` could not be written", filename);
+    }
+    save_uint32(shard, 0x23432BC4);
+    save_uint16(shard, 0x9);
+    save_int32(shard, g_tw_mynode);
+    save_int32(shard, tw_nnodes());
+
+    rewind(fp);
+    char buffer[4096];
+    for (long i = 0; i < size_beginning; i += sizeof(buffer)) {
+        size_t const n = size_beginning - i < (long) sizeof(buffer)
+            ? (size_t) (size_beginning - i) : sizeof(buffer);
+        check_if_failure(fp, fread(buffer, 1, n, fp), n);
+        save_bytes(shard, buffer, n);
+    }
+
+    int32_t const num_neurons_pe = settings_neuron_lp->num_neurons_pe;
+    save_int32(shard, num_neurons_pe);
+    for (int32_t i = 0; i < num_neurons_pe; i++) {
+        save_int32(shard, layout_master_local_id_to_doryta_id(i));
+    }
+    for (int32_t i = 0; i < num_neurons_pe; i++) {
+        save_uint64(shard, layout_master_doryta_id_to_gid(
+                    layout_master_local_id_to_doryta_id(i)));
+    }
+    save_bytes(shard, neurons, size_neurons);
+
+    if (fclose(shard) != 0) {
+        tw_error(TW_LOC, "Shard `%s` could not be written", filename);
+    }
+}
+
+// The neurons in the shard have to be those that the layout placed in the PE,
+// and have the same GIDs
+static void check_shard_neurons(FILE * fp,
+        struct SettingsNeuronLP const * settings_neuron_lp) {
+    int32_t const num_neurons_pe = settings_neuron_lp->num_neurons_pe;
+    bool same = load_int32(fp) == num_neurons_pe;
+    for (int32_t i = 0; same && i < num_neurons_pe; i++) {
+        same = load_int32(fp) == layout_master_local_id_to_doryta_id(i);
+    }
+    if (!same) {
+        tw_error(TW_LOC, "The neurons in the shard are not those of the PE "
+                "(note: the model was partitioned with another placement, "
+                "see `--tiled-placement` and `--load-stats`)");
+    }
+    for (int32_t i = 0; same && i < num_neurons_pe; i++) {
+        same = load_uint64(fp) == layout_master_doryta_id_to_gid(
+                layout_master_local_id_to_doryta_id(i));
+    }
+    if (!same) {
+        tw_error(TW_LOC, "The GIDs of the neurons in the shard are not those of "
+                "the simulation (note: the model was partitioned with another "
+                "layout)");
+    }
+}
+
+// ========================= LOADING THE MODEL FROM FILE =========================
+
+// Format 3 is the same as format 2, except that each synapse group indicates
+// the delay (in heartbeats) of its synapses. The delay (uint16) comes right
+// after the `from` and `to` ranges of the group
+//
+// Format 4 adds sparse synapse groups (type 0x3) to format 3. A sparse group
+// stores its synapses in CSR format after the delay: the number of synapses
+// (int32), the start of each row plus the end of the last one (`from_end -
+// from_start + 2` int32), the column of each synapse relative to `to_start`
+// (int32) and the weight of each synapse (float). Neurons store no weights
+// for sparse groups
+//
+// Format 5 adds one-to-one synapse groups (type 0x4) to format 4. Both ranges
+// of a one-to-one group have the same size, and the weight of each synapse
+// (`from_end - from_start + 1` floats) comes after the delay. Neurons store no
+// weights for one-to-one groups either
+//
+// Format 6 adds conv2d groups with several channels (type 0x5) to format 5.
+// Their parameters are the number of input and output channels (int32 each)
+// followed by the parameters of a conv2d group (type 0x2), which describe the
+// map of a single channel. The kernel holds a matrix per pair of channels
+// (`in_channels * out_channels * kernel_height * kernel_width` floats, input
+// channel major)
+//
+// Format 7 adds a table of offsets to format 6, right after the synapse
+// groups: the size of a block of neurons (int32) and the position in the file
+// (uint64, in bytes from the start of the file) of the first neuron of every
+// block (`ceil(total_num_neurons / block_size)` of them). A PE jumps to the
+// block of its first neuron (and to any other block it needs) instead of going
+// through all the neurons that come before it
+//
+// Format 8 stores the weights of all2all groups as matrices (instead of with
+// every neuron) to format 7, and the file is mapped in memory. All2all groups
+// (type 0x1) have the position of their matrix (uint64, in bytes from the
+// start of the file) after the delay. The matrix has one row per neuron of
+// `from` (`from_end - from_start + 1` rows of `to_end - to_start + 1` floats)
+// in little-endian byte order, and it must be aligned to 4 bytes (64 bytes are
+// recommended). Neurons have no all2all weights (their number of groups is
+// zero). The weights are used in place by dense all2all groups (a PE only
+// reads the rows of its neurons), and copied into the synapses otherwise
+//
+// When the neurons are `NEURONS_SOURCE_scattered`, the reader reads the file
+// and the other PEs read what it sends them (see
+// `model_load_neurons_init_scattered`)
+static void load_v2(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp,
+        uint16_t format, enum NEURONS_SOURCE source) {
+    // Offsets are taken from the start of the model (shards have a header of
+    // their own before it)
+    long const model_start = ftell(fp) - (long) (sizeof(uint32_t) + sizeof(uint16_t));
+    bool const with_delays = format >= 0x3;
+    bool const with_sparse = format >= 0x4;
+    bool const with_one2one = format >= 0x5;
+    bool const with_channels = format >= 0x6;
+    bool const with_offsets = format >= 0x7;
+    bool const with_matrices = format >= 0x8;
 #ifndef NDEBUG
     int32_t const total_num_neurons =
 #endif
@@ -190,8 +757,10 @@ static void load_v2(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
     assert(total_num_neurons == to_check_total_neurons);
 
     // Loading layout/connections
-    struct Conv2dGroup conv_kernels[synapse_groups]; // A bit wasteful, but simple to implement
-    uint16_t n_convs = 0;
+    // Groups whose weights are set by the layout (conv2d kernels, sparse and
+    // one2one groups)
+    struct GroupRange preset_groups[synapse_groups]; // A bit wasteful, but simple to implement
+    uint16_t n_presets = 0;
 
     for (uint16_t i = 0; i < synapse_groups; i++) {
         uint8_t const conn_type = load_uint8(fp);
@@ -200,10 +769,35 @@ static void load_v2(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
         int32_t const from_end   = load_int32(fp);
         int32_t const to_start   = load_int32(fp);
         int32_t const to_end     = load_int32(fp);
+        uint16_t const delay     = with_delays ? load_uint16(fp) : 1;
 
         if (conn_type == 0x1) {
             layout_master_synapses_all2all(from_start, from_end, to_start, to_end);
-        } else if (conn_type == 0x2) {
+            if (with_matrices) {
+                uint64_t const offset = load_uint64(fp);
+                size_t const matrix_size = (size_t) (from_end - from_start + 1)
+                    * (to_end - to_start + 1) * sizeof(float);
+                if (offset % sizeof(float) != 0 || offset > mapped_model_size
+                        || mapped_model_size - offset < matrix_size) {
+                    tw_error(TW_LOC, "Input file corrupt (note: invalid position "
+                            "of the weights of an all2all group)");
+                }
+                layout_master_synapses_weights(
+                        (float const *) ((char const *) mapped_model + offset));
+                preset_groups[n_presets] = (struct GroupRange) {
+                    .from_start = from_start,
+                    .from_end = from_end,
+                    .to_start = to_start,
+                    .to_end = to_end,
+                };
+                n_presets++;
+            }
+        } else if (conn_type == 0x2 || (conn_type == 0x5 && with_channels)) {
+            int32_t const in_channels = conn_type == 0x5 ? load_int32(fp) : 1;
+            int32_t const out_channels = conn_type == 0x5 ? load_int32(fp) : 1;
+            if (in_channels <= 0 || out_channels <= 0) {
+                tw_error(TW_LOC, "Input file corrupt (note: invalid number of channels)");
+            }
             /*int32_t const input_height =*/ load_int32(fp);
             int32_t const input_width     = load_int32(fp);
             /*int32_t const output_height =*/ load_int32(fp);
@@ -224,25 +818,137 @@ static void load_v2(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
                     .stride_height  = striding_height,
             };
 
-            layout_master_synapses_conv2d(
+            layout_master_synapses_conv2d_channels(
                     from_start, from_end, to_start, to_end,
-                    &conv2d_params);
+                    &conv2d_params, in_channels, out_channels);
 
-            int32_t kernel_size = kernel_height * kernel_width;
+            size_t const kernel_size =
+                (size_t) kernel_height * kernel_width * in_channels * out_channels;
             float * kernel_data = malloc(kernel_size * sizeof(float));
+            if (kernel_data == NULL) {
+                tw_error(TW_LOC, "Not able to allocate space for the kernel");
+            }
             load_floats(fp, kernel_data, kernel_size);
-            conv_kernels[n_convs] = (struct Conv2dGroup) {
+            // The layout keeps its own copy of the kernel
+            layout_master_synapses_kernel(kernel_data);
+            free(kernel_data);
+            preset_groups[n_presets] = (struct GroupRange) {
                 .from_start = from_start,
                 .from_end = from_end,
                 .to_start = to_start,
                 .to_end = to_end,
-                .kernel_size = kernel_size,
-                .kernel_data = kernel_data
             };
-            n_convs++;
+            n_presets++;
+        } else if (conn_type == 0x3 && with_sparse) {
+            int32_t const num_synapses = load_int32(fp);
+            int32_t const num_rows = from_end - from_start + 1;
+            if (num_synapses < 0 || num_rows <= 0) {
+                tw_error(TW_LOC, "Input file corrupt (note: invalid sparse group)");
+            }
+            // (`malloc(0)` might return NULL)
+            size_t const to_alloc = num_synapses > 0 ? num_synapses : 1;
+            int32_t * row_ptr = malloc((num_rows + 1) * sizeof(int32_t));
+            int32_t * col_idx = malloc(to_alloc * sizeof(int32_t));
+            float * weights = malloc(to_alloc * sizeof(float));
+            if (row_ptr == NULL || col_idx == NULL || weights == NULL) {
+                tw_error(TW_LOC, "Not able to allocate space for the sparse group");
+            }
+            for (int32_t j = 0; j <= num_rows; j++) {
+                row_ptr[j] = load_int32(fp);
+            }
+            if (row_ptr[num_rows] != num_synapses) {
+                tw_error(TW_LOC, "Input file corrupt (note: the rows of a sparse group "
+                        "do not add up to %" PRIi32 " synapses)", num_synapses);
+            }
+            for (int32_t j = 0; j < num_synapses; j++) {
+                col_idx[j] = load_int32(fp);
+            }
+            load_floats(fp, weights, num_synapses);
+
+            // The layout keeps its own copy of the synapses
+            layout_master_synapses_sparse(from_start, from_end, to_start, to_end,
+                    row_ptr, col_idx, weights);
+            free(row_ptr);
+            free(col_idx);
+            free(weights);
+            preset_groups[n_presets] = (struct GroupRange) {
+                .from_start = from_start,
+                .from_end = from_end,
+                .to_start = to_start,
+                .to_end = to_end,
+            };
+            n_presets++;
+        } else if (conn_type == 0x4 && with_one2one) {
+            int32_t const num_synapses = from_end - from_start + 1;
+            if (num_synapses <= 0) {
+                tw_error(TW_LOC, "Input file corrupt (note: invalid one2one group)");
+            }
+            float * weights = malloc(num_synapses * sizeof(float));
+            if (weights == NULL) {
+                tw_error(TW_LOC, "Not able to allocate space for the one2one group");
+            }
+            load_floats(fp, weights, num_synapses);
+
+            // The layout keeps its own copy of the weights
+            layout_master_synapses_one2one(from_start, from_end, to_start, to_end,
+                    weights);
+            free(weights);
+            preset_groups[n_presets] = (struct GroupRange) {
+                .from_start = from_start,
+                .from_end = from_end,
+                .to_start = to_start,
+                .to_end = to_end,
+            };
+            n_presets++;
         } else {
             tw_error(TW_LOC, "Unknown layout type `%x`.", conn_type);
         }
+        layout_master_synapses_delay(delay);
+    }
+
+    // Preset groups (in order of definition) in which each neuron is in `from`
+    int32_t preset_from[n_presets + 1];
+    int32_t preset_to[n_presets + 1];
+    for (uint16_t i = 0; i < n_presets; i++) {
+        preset_from[i] = preset_groups[i].from_start;
+        preset_to[i] = preset_groups[i].from_end;
+    }
+    struct IntervalIndex preset_index =
+        interval_index_build(preset_from, preset_to, n_presets);
+
+    // Position of the first neuron of each block in the file
+    int32_t block_size = 0;
+    uint64_t * block_offsets = NULL;
+    if (with_offsets) {
+        block_size = load_int32(fp);
+        if (block_size <= 0) {
+            tw_error(TW_LOC, "Input file corrupt (note: invalid size of block)");
+        }
+        int32_t const num_blocks = divceil_i32(to_check_total_neurons, block_size);
+        block_offsets = malloc((num_blocks + 1) * sizeof(uint64_t));
+        if (block_offsets == NULL) {
+            tw_error(TW_LOC, "Not able to allocate space for the offsets of the file");
+        }
+        for (int32_t k = 0; k < num_blocks; k++) {
+            block_offsets[k] = load_uint64(fp);
+        }
+        // The first block starts right after the table
+        if (num_blocks > 0 && block_offsets[0] != (uint64_t) (ftell(fp) - model_start)) {
+            tw_error(TW_LOC, "Input file corrupt (note: the offset of the first "
+                    "neuron is %" PRIu64 ", but it is stored at %ld)",
+                    block_offsets[0], ftell(fp) - model_start);
+        }
+    }
+    long const size_beginning = ftell(fp);
+
+    if (source != NEURONS_SOURCE_model) {
+        // The other PEs have been waiting for everything up to the neurons
+        if (source == NEURONS_SOURCE_scattered && scatter_rank == 0) {
+            send_beginning(fp);
+        }
+        // The neurons of the PE come in order, one after the other
+        free(block_offsets);
+        block_offsets = NULL;
     }
 
     // Setting the driver configuration
@@ -259,6 +965,8 @@ static void load_v2(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
       .neuron_fire       = (neuron_fire_f) neurons_lif_fire,
       .store_neuron         = (neuron_state_op_f) neurons_lif_store_state,
       .reverse_store_neuron = (neuron_state_op_f) neurons_lif_reverse_store_state,
+      .sizeof_storage       = sizeof(struct StorageInMessageLif),
+      .neuron_type          = NEURON_TYPE_lif,
       .print_neuron_struct  = (print_neuron_f) neurons_lif_print,
       //.gid_to_doryta_id    = ...
       //.probe_events     = probe_events,
@@ -269,6 +977,26 @@ static void load_v2(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
             (neuron_init_f) NULL, (synapse_init_f) NULL);
     layout_master_configure(settings_neuron_lp);
 
+    // The neurons of a scattered model are read from memory. They are only
+    // those of the PE
+    char * own_neurons = NULL;
+    if (source == NEURONS_SOURCE_scattered) {
+        size_t size;
+        own_neurons = scatter_neurons(fp, to_check_total_neurons, &size);
+        if (shards_to_save != NULL) {
+            save_shard(fp, size_beginning, settings_neuron_lp, own_neurons, size);
+        }
+        fp = NULL;
+        if (size > 0) {
+            fp = fmemopen(own_neurons, size, "rb");
+            if (!fp) {
+                tw_error(TW_LOC, "Not able to read the neurons sent by the reader");
+            }
+        }
+    } else if (source == NEURONS_SOURCE_shard) {
+        check_shard_neurons(fp, settings_neuron_lp);
+    }
+
     // Loading neuron and synapses from file
     // Assumes that increasing the local id also increases the doryta id,
     // which is true for layout/master
@@ -278,6 +1006,19 @@ static void load_v2(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
         int32_t const doryta_id = layout_master_local_id_to_doryta_id(i);
         //printf("PE %lu - neuron id %d - total_num_neurons %d\n", g_tw_mynode, doryta_id, num_synapses);
         assert(doryta_id < total_num_neurons);
+        if (source != NEURONS_SOURCE_model) {
+            i_in_file = doryta_id;
+        }
+
+        // Jumping to the block of doryta_id (if it is ahead)
+        if (block_offsets != NULL && doryta_id / block_size * block_size > i_in_file) {
+            int32_t const block = doryta_id / block_size;
+            if (fseek(fp, block_offsets[block], SEEK_SET) != 0) {
+                tw_error(TW_LOC, "Input file corrupt (note: invalid offset of block %"
+                        PRIi32 ")", block);
+            }
+            i_in_file = block * block_size;
+        }
 
         // Seeking up to where doryta_id is stored
         while (i_in_file < doryta_id) {
@@ -300,8 +1041,14 @@ static void load_v2(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
         load_neuron_params(settings_neuron_lp->neurons[i], fp);
 
         uint16_t const num_groups_fully = load_uint16(fp);
+        if (with_matrices && num_groups_fully != 0) {
+            tw_error(TW_LOC, "Input file corrupt (note: neuron %" PRIi32
+                    " stores the weights of all2all groups)", doryta_id);
+        }
         uint16_t group_ind = 0;
-        uint16_t conv_ind = 0;
+        int32_t const * presets = NULL;
+        int32_t const num_presets = interval_index_find(&preset_index, doryta_id, &presets);
+        int32_t preset_ind = 0;
 
         // Arbitrary initial value of 1 and 0 to keep compiler happy. The actual values are
         // read from file
@@ -312,6 +1059,22 @@ static void load_v2(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
             to_end_fully = load_int32(fp);
         }
 
+        // Dense groups keep their weights in the layout, not in the synapses
+        // of the neuron. Either all fully groups are dense or none is
+        while (group_ind < num_groups_fully) {
+            float * const dense_weights = layout_master_all2all_weights(
+                    doryta_id, to_start_fully, to_end_fully);
+            if (dense_weights == NULL) {
+                break;
+            }
+            load_floats(fp, dense_weights, to_end_fully - to_start_fully + 1);
+            group_ind++;
+            if (group_ind < num_groups_fully) {
+                to_start_fully = load_int32(fp);
+                to_end_fully = load_int32(fp);
+            }
+        }
+
         int32_t const num_synapses = settings_neuron_lp->synapses[i].num;
         struct Synapse * synapses_neuron = settings_neuron_lp->synapses[i].synapses;
         for (int32_t j = 0; j < num_synapses; j++) {
@@ -326,15 +1089,20 @@ static void load_v2(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
 
             // check if id corresponds to to_start in current fully layer
             if (group_ind < num_groups_fully && to_id == to_start_fully) {
-                // load the entirety of synapses
+                // load the entirety of synapses (a chunk at the time, so that
+                // large layers do not overflow the stack)
                 int32_t const num_synapses_group = to_end_fully - to_start_fully + 1;
 
-                float synapses_raw[num_synapses_group];
-                load_floats(fp, synapses_raw, num_synapses_group);
-                for (int32_t k = 0; k < num_synapses_group; k++) {
-                    assert(synapses_neuron[j + k].doryta_id_to_send == to_start_fully + k);
-                    synapses_neuron[j + k].weight = synapses_raw[k];
-                    synapses_neuron[j + k].delay = 1;
+                float synapses_raw[LOAD_CHUNK];
+                for (int32_t k = 0; k < num_synapses_group; k += LOAD_CHUNK) {
+                    int32_t const num_chunk = num_synapses_group - k < LOAD_CHUNK
+                        ? num_synapses_group - k : LOAD_CHUNK;
+                    load_floats(fp, synapses_raw, num_chunk);
+                    for (int32_t l = 0; l < num_chunk; l++) {
+                        assert(synapses_neuron[j + k + l].doryta_id_to_send
+                                == to_start_fully + k + l);
+                        synapses_neuron[j + k + l].weight = synapses_raw[l];
+                    }
                 }
 
                 // we loaded a bunch of neurons at the same time!
@@ -349,29 +1117,23 @@ static void load_v2(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
 
                 neither = false;
 
-            // check if there are still convolutions to check for to_id to belong to
-            } else if (conv_ind < n_convs) {
-                // find next convolution group in which the current
+            // check if there are still convolution (sparse or one2one) groups to
+            // check for to_id to belong to
+            } else if (preset_ind < num_presets) {
+                // find next convolution (sparse or one2one) group in which the current
                 // neuron (doryta_id) appears and to_id belongs in the range (to_start, to_end)
-                while (conv_ind < n_convs) {
-                    struct Conv2dGroup * group = &conv_kernels[conv_ind];
-                    if (group->from_start <= doryta_id
-                            && doryta_id <= group->from_end
-                            && group->to_start <= to_id
-                            && to_id <= group->to_end) {
+                while (preset_ind < num_presets) {
+                    struct GroupRange * group = &preset_groups[presets[preset_ind]];
+                    assert(group->from_start <= doryta_id && doryta_id <= group->from_end);
+                    if (group->to_start <= to_id && to_id <= group->to_end) {
                         break;
                     }
-                    conv_ind++;
+                    preset_ind++;
                 }
 
-                // if a group were found, load from kernel value that synapse should have
-                if (conv_ind < n_convs) {
-                    // get the value stored in weight (it indicates which value of the kernel convolution to use)
-                    int32_t const kernel_id = (int32_t) synapses_neuron[j].weight;
-                    assert(kernel_id < conv_kernels[conv_ind].kernel_size);
-                    synapses_neuron[j].weight = conv_kernels[conv_ind].kernel_data[kernel_id];
-                    synapses_neuron[j].delay = 1;
-
+                // if a group were found, the synapse already has its weight
+                // (taken by the layout from the kernel or the weights of the group)
+                if (preset_ind < num_presets) {
                     // this advances neurons one at the time, no need to alter j
                     neither = false;
                 }
@@ -387,13 +1149,23 @@ static void load_v2(struct SettingsNeuronLP * settings_neuron_lp, FILE * fp) {
         i_in_file++;
     }
 
-    // Freeing dynamic memory used to load kernel params
-    for (uint16_t i = 0; i < n_convs; i++) {
-        free(conv_kernels[i].kernel_data);
+    if (source == NEURONS_SOURCE_scattered) {
+        if (fp != NULL) {
+            fclose(fp);
+        }
+        free(own_neurons);
     }
+    interval_index_free(&preset_index);
+    free(block_offsets);
+    layout_master_synapses_loaded();
 }
 
 
 void model_load_neurons_deinit(void) {
     layout_master_free();
+    if (mapped_model != NULL) {
+        munmap(mapped_model, mapped_model_size);
+        mapped_model = NULL;
+        mapped_model_size = 0;
+    }
 }
@@ -7,6 +7,21 @@ struct SettingsNeuronLP;
 
 struct ModelParams model_load_neurons_init(struct SettingsNeuronLP *, char const []);
 
+// Only PE 0 reads the file, and sends the other PEs what they need from it
+struct ModelParams model_load_neurons_init_scattered(struct SettingsNeuronLP *, char const []);
+
+// Only one PE per node (shared memory domain) reads the file, and sends the
+// PEs in its node what they need from it. Every node reads the whole file, but
+// a PE only gets its own neurons
+struct ModelParams model_load_neurons_init_scattered_per_node(struct SettingsNeuronLP *, char const []);
+
+// Loads the shard of the PE out of the shards with the given prefix
+struct ModelParams model_load_neurons_init_shard(struct SettingsNeuronLP *, char const []);
+
+// Loads the model (as `model_load_neurons_init_scattered`), and saves the
+// shard of each PE with the given prefix
+struct ModelParams model_load_neurons_partition(struct SettingsNeuronLP *, char const [], char const []);
+
 void model_load_neurons_deinit(void);
 
 #endif /* end of include guard */
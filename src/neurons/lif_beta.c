@@ -1,4 +1,6 @@
 #include "lif_beta.h"
+#include <assert.h>
+#include <math.h>
 #include <stdio.h>
 
 void neurons_lif_beta_leak(struct LifBetaNeuron * lf, double dt) {
@@ -7,6 +9,15 @@ void neurons_lif_beta_leak(struct LifBetaNeuron * lf, double dt) {
 }
 
 
+void neurons_lif_beta_big_leak(struct LifBetaNeuron * lf, double delta, double dt) {
+    // No positive leak, otherwise the neuron could fire on its own
+    assert(0 <= lf->beta && lf->beta <= 1);
+    // V(t + n * dt) = beta^n * V(t)
+    double const n = round(delta / dt);
+    lf->potential = pow(lf->beta, n) * lf->potential;
+}
+
+
 void neurons_lif_beta_integrate(struct LifBetaNeuron * lf, float current) {
     lf->potential += current;
 }
@@ -48,6 +48,10 @@ static_assert(sizeof(struct StorageInMessageLifBeta) <= MESSAGE_SIZE_REVERSE,
 
 void neurons_lif_beta_leak(struct LifBetaNeuron *, double);
 
+// Leak over `delta` time (a multiple of the heartbeat `dt`) with no input.
+// Needed to run on spike-driven mode
+void neurons_lif_beta_big_leak(struct LifBetaNeuron *, double delta, double dt);
+
 void neurons_lif_beta_integrate(struct LifBetaNeuron *, float current);
 
 bool neurons_lif_beta_fire(struct LifBetaNeuron *);
@@ -0,0 +1,73 @@
+#include <ross.h>
+#include "driver/neuron.h"
+#include "layout/master.h"
+#include "model-loaders/regular_io/load_neurons.h"
+#include "probes/stats.h"
+
+/** @file
+ * Splits a model into one shard per PE, so that `doryta --load-shards` reads
+ * on each PE only its neurons (with a single sequential read). It has to be
+ * run on as many PEs as the simulation, and with the same placement options.
+ */
+
+/** Define command line arguments default values. */
+static unsigned int is_tiled_placement = 0;
+// Strings
+static char model_path[512] = {'\0'};
+static char shards_prefix[512] = {'\0'};
+static char stats_path[512] = {'\0'};
+
+
+/** Custom to doryta-partition command line options. */
+static tw_optdef const partition_opts[] = {
+    TWOPT_GROUP("Doryta Partition Options"),
+    TWOPT_CHAR("load-model", model_path, "Model to partition (formats 2 to 7)"),
+    TWOPT_CHAR("shards", shards_prefix,
+            "Prefix of the shards. The shard of each PE is stored in "
+            "`<prefix>.<pe>-of-<number of PEs>`"),
+    TWOPT_FLAG("tiled-placement", is_tiled_placement,
+            "Layers connected by conv2d synapses are placed in 2D tiles (one per PE), so "
+            "that matching tiles of consecutive layers land on the same PE"),
+    TWOPT_CHAR("load-stats", stats_path,
+            "Path to the output of a previous run with `--probe-stats`. Neurons are "
+            "assigned to PEs by their load in that run instead of by their number"),
+    TWOPT_END(),
+};
+
+
+int main(int argc, char *argv[]) {
+    tw_opt_add(partition_opts);
+    tw_init(&argc, &argv);
+
+    if (model_path[0] == '\0' || shards_prefix[0] == '\0') {
+        tw_error(TW_LOC, "Both the model to partition and the prefix of the shards "
+                "are needed");
+    }
+
+    // The placement of the neurons has to be the same as in the simulation
+    double * neuron_loads = NULL;
+    int32_t num_neuron_loads = 0;
+    if (stats_path[0] != '\0') {
+        neuron_loads = probes_stats_load(stats_path, &num_neuron_loads);
+    }
+    layout_master_set_options(&(struct LayoutMasterOptions) {
+        .tiled_placement = is_tiled_placement,
+        .neuron_loads = neuron_loads,
+        .num_neuron_loads = num_neuron_loads,
+    });
+
+    struct SettingsNeuronLP settings_neuron_lp;
+    model_load_neurons_partition(&settings_neuron_lp, model_path, shards_prefix);
+    free(neuron_loads);
+    model_load_neurons_deinit();
+
+    if (g_tw_mynode == 0) {
+        printf("Model `%s` partitioned into %lu shards (`%s.*-of-%lu`)\n",
+                model_path, (unsigned long) tw_nnodes(), shards_prefix,
+                (unsigned long) tw_nnodes());
+    }
+
+    tw_end();
+
+    return 0;
+}
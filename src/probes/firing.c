@@ -36,9 +36,12 @@ void probes_firing_record(
     }
 
     bool const was_fired = msg->type == MESSAGE_TYPE_heartbeat && msg->fired;
-    bool const record_neuron = only_output_neurons ? neuronLP->to_contact.num == 0 : true;
+    // Synapses are only counted for neurons that fired (some might be
+    // generated, which takes time)
+    bool const record_neuron = was_fired
+        && (!only_output_neurons || driver_neuron_num_synapses(neuronLP) == 0);
 
-    if (was_fired && record_neuron) {
+    if (record_neuron) {
         if (buffer_used < buffer_size) {
             firing_spikes[buffer_used].neuron    = neuronLP->doryta_id;
             firing_spikes[buffer_used].time      = msg->time_processed;
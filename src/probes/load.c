@@ -0,0 +1,124 @@
+#include "load.h"
+#include "../driver/neuron.h"
+#include "../driver/synapse.h"
+#include "ross.h"
+
+#include <stdio.h>
+
+static int64_t * load = NULL;
+static size_t num_windows = 0;
+static double interval;
+static char const * output_path = NULL;
+
+void probes_load_init(double interval_, char const output_path_[]) {
+    if (!(interval_ > 0) || isinf(interval_)) {
+        tw_error(TW_LOC, "The load probe interval must be a positive number (given %f)",
+                interval_);
+    }
+    interval = interval_;
+    output_path = output_path_;
+    num_windows = 64;
+    load = calloc(num_windows, sizeof(int64_t));
+    if (load == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space for the load probe");
+    }
+}
+
+
+// Making sure that `window` is within the buffer (the buffer grows with the
+// simulation)
+static void grow_to(size_t window) {
+    if (window < num_windows) {
+        return;
+    }
+    size_t new_num_windows = 2 * num_windows;
+    while (window >= new_num_windows) {
+        new_num_windows *= 2;
+    }
+    int64_t * const new_load = realloc(load, new_num_windows * sizeof(int64_t));
+    if (new_load == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space for the load probe");
+    }
+    for (size_t i = num_windows; i < new_num_windows; i++) {
+        new_load[i] = 0;
+    }
+    load = new_load;
+    num_windows = new_num_windows;
+}
+
+
+void probes_load_record(
+        struct NeuronLP * neuronLP,
+        struct Message * msg,
+        struct tw_lp * lp) {
+    (void) lp;
+    assert(load != NULL);
+
+    if (msg == NULL) {
+        return;
+    }
+
+    assert(msg->time_processed >= 0);
+    size_t const window = (size_t) (msg->time_processed / interval);
+    grow_to(window);
+
+    load[window]++;
+    // Same cost as in `probes_stats_load`: a neuron that fires sends one
+    // spike per synapse
+    if (msg->type == MESSAGE_TYPE_heartbeat && msg->fired) {
+        load[window] += driver_neuron_num_synapses(neuronLP);
+    }
+}
+
+
+void probes_load_record_synapse(
+        struct SynapseLP * synapseLP,
+        struct Message * msg,
+        struct tw_lp * lp) {
+    (void) synapseLP;
+    (void) lp;
+    assert(load != NULL);
+    assert(msg->time_processed >= 0);
+
+    size_t const window = (size_t) (msg->time_processed / interval);
+    grow_to(window);
+
+    load[window] += 1 + msg->sent_by_synapse_lp;
+}
+
+
+static void load_save(void) {
+    assert(output_path != NULL);
+    unsigned long const self = g_tw_mynode;
+
+    // Finding name for file
+    char const fmt[] = "%s/load-gid=%lu.txt";
+    int const sz = snprintf(NULL, 0, fmt, output_path, self);
+    char filename_path[sz + 1]; // `+ 1` for terminating null byte
+    snprintf(filename_path, sizeof(filename_path), fmt, output_path, self);
+
+    FILE * fp = fopen(filename_path, "w");
+
+    if (fp != NULL) {
+        // Windows past the last event are not stored
+        size_t last = num_windows;
+        while (last > 0 && load[last - 1] == 0) {
+            last--;
+        }
+        for (size_t i = 0; i < last; i++) {
+            fprintf(fp, "%f\t%" PRIi64 "\n", i * interval, load[i]);
+        }
+
+        fclose(fp);
+    } else {
+        fprintf(stderr, "Unable to store `load` in file %s\n", filename_path);
+    }
+}
+
+
+void probes_load_deinit(void) {
+    assert(load != NULL);
+    load_save();
+    free(load);
+    load = NULL;
+}
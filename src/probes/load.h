@@ -0,0 +1,28 @@
+#ifndef DORYTA_PROBES_LOAD_H
+#define DORYTA_PROBES_LOAD_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct NeuronLP;
+struct SynapseLP;
+struct Message;
+struct tw_lp;
+
+/** This probe records the load of the PE over time: the number of events
+ * (heartbeats and spikes) committed by its neurons and SynapseLPs (multicast,
+ * relays and accumulated spikes), plus the events they sent, in consecutive
+ * windows of `interval` (simulation) time. Comparing the load of all PEs in a
+ * window shows how much time is lost waiting for the busiest PE.
+ */
+void probes_load_init(double interval, char const output_path[]);
+
+void probes_load_record(struct NeuronLP *, struct Message *, struct tw_lp *);
+
+void probes_load_record_synapse(struct SynapseLP *, struct Message *, struct tw_lp *);
+
+void probes_load_deinit(void);
+
+#endif /* end of include guard */
@@ -31,7 +31,7 @@ void probes_stats_record(
     // Setting up neuron ID
     if (msg == NULL) {
         stats[lp->id].neuron = neuronLP->doryta_id;
-        stats[lp->id].synapses = neuronLP->to_contact.num;
+        stats[lp->id].synapses = driver_neuron_num_synapses(neuronLP);
         return;
     }
 
@@ -81,6 +81,67 @@ static void stats_save(void) {
 }
 
 
+// Expected cost of a neuron: the events it processes (heartbeats and spikes)
+// and the spikes it sends
+static inline double load_of(struct NeuronLPStats const * st) {
+    return (double) st->leaks + (double) st->integrations
+        + (double) st->fires * st->synapses;
+}
+
+double * probes_stats_load(char const path[], int32_t * num_neurons) {
+    double * loads = NULL;
+    int32_t capacity = 0;
+    *num_neurons = 0;
+
+    // Reading the files of all PEs (from PE 0 up to the first missing file)
+    unsigned long pe = 0;
+    for (;; pe++) {
+        char const fmt[] = "%s/stats-gid=%lu.txt";
+        int const sz = snprintf(NULL, 0, fmt, path, pe);
+        char filename_path[sz + 1]; // `+ 1` for terminating null byte
+        snprintf(filename_path, sizeof(filename_path), fmt, path, pe);
+
+        FILE * fp = fopen(filename_path, "r");
+        if (fp == NULL) {
+            break;
+        }
+
+        struct NeuronLPStats st;
+        while (fscanf(fp, "%" SCNi32 "%" SCNi32 "%" SCNi64 "%" SCNi64 "%" SCNi64,
+                    &st.neuron, &st.synapses, &st.leaks, &st.integrations,
+                    &st.fires) == 5) {
+            if (st.neuron < 0) {
+                tw_error(TW_LOC, "Invalid neuron id %" PRIi32 " in file %s",
+                        st.neuron, filename_path);
+            }
+            if (st.neuron >= capacity) {
+                int32_t const new_capacity =
+                    st.neuron >= 2 * capacity ? st.neuron + 1 : 2 * capacity;
+                double * const new_loads = realloc(loads, new_capacity * sizeof(double));
+                if (new_loads == NULL) {
+                    tw_error(TW_LOC, "Not able to allocate space for neuron loads");
+                }
+                for (int32_t i = capacity; i < new_capacity; i++) {
+                    new_loads[i] = 0;
+                }
+                loads = new_loads;
+                capacity = new_capacity;
+            }
+            loads[st.neuron] = load_of(&st);
+            if (st.neuron >= *num_neurons) {
+                *num_neurons = st.neuron + 1;
+            }
+        }
+        fclose(fp);
+    }
+
+    if (pe == 0) {
+        tw_error(TW_LOC, "No stats files (`stats-gid=*.txt`) found in `%s`", path);
+    }
+    return loads;
+}
+
+
 void probes_stats_deinit(void) {
     assert(stats != NULL);
     stats_save();
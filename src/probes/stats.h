@@ -18,4 +18,14 @@ void probes_stats_record(struct NeuronLP *, struct Message *, struct tw_lp *);
 
 void probes_stats_deinit(void);
 
+/**
+ * Reads the stats files (`stats-gid=*.txt`) stored in `path` by a previous
+ * run, and returns the expected load of each neuron (indexed by DorytaID):
+ * the number of leaks and integrations plus the number of spikes it sent
+ * (fires times synapses). `num_neurons` is set to the length of the array
+ * (the largest neuron ID found plus one). The array must be freed by the
+ * caller.
+ */
+double * probes_stats_load(char const path[], int32_t * num_neurons);
+
 #endif /* end of include guard */
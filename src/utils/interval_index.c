@@ -0,0 +1,97 @@
+#include "interval_index.h"
+#include <ross.h>
+#include <assert.h>
+
+static int compare_int32(void const * a, void const * b) {
+    int32_t const x = *(int32_t const *) a;
+    int32_t const y = *(int32_t const *) b;
+    return (x > y) - (x < y);
+}
+
+// Position of `value` in `bounds` (it must be there)
+static int32_t find_bound(int32_t const * bounds, int32_t num_bounds, int32_t value) {
+    int32_t low = 0;
+    int32_t high = num_bounds - 1;
+    while (low < high) {
+        int32_t const mid = low + (high - low) / 2;
+        if (bounds[mid] < value) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    assert(bounds[low] == value);
+    return low;
+}
+
+struct IntervalIndex interval_index_build(
+        int32_t const * from, int32_t const * to, int32_t num_ranges) {
+    // Every range starts and ends at a bound (the first ID after it)
+    int32_t * bounds = malloc((2 * (size_t) num_ranges + 1) * sizeof(int32_t));
+    if (bounds == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space for the interval index");
+    }
+    int32_t num_bounds = 0;
+    for (int32_t i = 0; i < num_ranges; i++) {
+        if (from[i] <= to[i]) {
+            bounds[num_bounds++] = from[i];
+            bounds[num_bounds++] = to[i] + 1;
+        }
+    }
+    qsort(bounds, num_bounds, sizeof(int32_t), compare_int32);
+    int32_t unique = 0;
+    for (int32_t i = 0; i < num_bounds; i++) {
+        if (unique == 0 || bounds[unique - 1] != bounds[i]) {
+            bounds[unique++] = bounds[i];
+        }
+    }
+    num_bounds = unique;
+    int32_t const num_intervals = num_bounds > 0 ? num_bounds - 1 : 0;
+
+    // Counting the ranges of each interval, and then placing them (in order)
+    int32_t * starts = calloc(num_intervals + 2, sizeof(int32_t));
+    if (starts == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space for the interval index");
+    }
+    for (int32_t i = 0; i < num_ranges; i++) {
+        if (from[i] <= to[i]) {
+            int32_t const first = find_bound(bounds, num_bounds, from[i]);
+            int32_t const end = find_bound(bounds, num_bounds, to[i] + 1);
+            for (int32_t k = first; k < end; k++) {
+                starts[k + 2]++;
+            }
+        }
+    }
+    for (int32_t k = 2; k <= num_intervals + 1; k++) {
+        starts[k] += starts[k - 1];
+    }
+    int32_t * ranges = malloc((starts[num_intervals + 1] + 1) * sizeof(int32_t));
+    if (ranges == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space for the interval index");
+    }
+    // `starts[k + 1]` is the next free position of interval `k` (and, once
+    // all ranges are in place, where the interval ends)
+    for (int32_t i = 0; i < num_ranges; i++) {
+        if (from[i] <= to[i]) {
+            int32_t const first = find_bound(bounds, num_bounds, from[i]);
+            int32_t const end = find_bound(bounds, num_bounds, to[i] + 1);
+            for (int32_t k = first; k < end; k++) {
+                ranges[starts[k + 1]++] = i;
+            }
+        }
+    }
+
+    return (struct IntervalIndex) {
+        .num_intervals = num_intervals,
+        .bounds = bounds,
+        .starts = starts,
+        .ranges = ranges,
+    };
+}
+
+void interval_index_free(struct IntervalIndex * index) {
+    free(index->bounds);
+    free(index->starts);
+    free(index->ranges);
+    *index = (struct IntervalIndex) {0};
+}
@@ -0,0 +1,52 @@
+#ifndef DORYTA_SRC_UTILS_INTERVAL_INDEX_H
+#define DORYTA_SRC_UTILS_INTERVAL_INDEX_H
+
+#include <stdint.h>
+
+/** @file
+ * Index from an ID (eg, DorytaID) to the ranges of IDs it belongs to. The IDs
+ * are cut into intervals at the start and end of every range, so that all IDs
+ * in an interval belong to the same ranges. Finding the ranges of an ID takes
+ * a binary search over the intervals, instead of going through all ranges.
+ */
+
+struct IntervalIndex {
+    int32_t num_intervals;
+    // Interval `k` goes from `bounds[k]` to `bounds[k+1] - 1`, and the ranges
+    // it belongs to are `ranges[starts[k]]` to `ranges[starts[k+1] - 1]`
+    int32_t * bounds;
+    int32_t * starts;
+    int32_t * ranges;
+};
+
+/** Builds the index of `num_ranges` ranges. Range `i` goes from `from[i]` to
+ * `to[i]` (inclusive). Empty ranges (`to[i] < from[i]`) are ignored. */
+struct IntervalIndex interval_index_build(
+        int32_t const * from, int32_t const * to, int32_t num_ranges);
+
+/** Ranges `id` belongs to (sorted), by the index of the range. Returns the
+ * number of ranges, and a pointer to them in `ranges`. */
+static inline int32_t interval_index_find(struct IntervalIndex const * index,
+        int32_t id, int32_t const ** ranges) {
+    if (index->num_intervals == 0
+            || id < index->bounds[0] || id >= index->bounds[index->num_intervals]) {
+        return 0;
+    }
+    // The interval is the last one starting at or before `id`
+    int32_t low = 0;
+    int32_t high = index->num_intervals - 1;
+    while (low < high) {
+        int32_t const mid = low + (high - low + 1) / 2;
+        if (index->bounds[mid] <= id) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    *ranges = &index->ranges[index->starts[low]];
+    return index->starts[low + 1] - index->starts[low];
+}
+
+void interval_index_free(struct IntervalIndex * index);
+
+#endif /* end of include guard */
@@ -57,6 +57,10 @@ static inline int32_t load_int32(FILE * fp) {
     check_if_failure(fp, ret_code, 1);
     return ntohl(res);
 }
+static inline uint64_t load_uint64(FILE * fp) {
+    uint64_t const high = load_uint32(fp);
+    return (high << 32) | load_uint32(fp);
+}
 static inline float load_float(FILE * fp) {
     union {
         uint32_t ui32;
@@ -80,4 +84,28 @@ static inline void load_floats(FILE * fp, float * buffer, int32_t num) {
         buffer[i] = val.flt;
     }
 }
+
+// ======================== WRITING TO A FILE FUNCTIONALITY ========================
+
+// Each one of them can print an error
+static inline void save_bytes(FILE * fp, void const * data, size_t size) {
+    if (fwrite(data, 1, size, fp) != size) {
+        tw_error(TW_LOC, "Error found while writing file");
+    }
+}
+static inline void save_uint16(FILE * fp, uint16_t value) {
+    uint16_t const res = htons(value);
+    save_bytes(fp, &res, sizeof(res));
+}
+static inline void save_uint32(FILE * fp, uint32_t value) {
+    uint32_t const res = htonl(value);
+    save_bytes(fp, &res, sizeof(res));
+}
+static inline void save_int32(FILE * fp, int32_t value) {
+    save_uint32(fp, value);
+}
+static inline void save_uint64(FILE * fp, uint64_t value) {
+    save_uint32(fp, value >> 32);
+    save_uint32(fp, value);
+}
 #endif /* end of include guard */
@@ -139,6 +139,7 @@ int main(int argc, char *argv[]) {
       .neuron_fire      = (neuron_fire_f) dummy_fire,
       .store_neuron         = (neuron_state_op_f) dummy_store,
       .reverse_store_neuron = (neuron_state_op_f) dummy_restore,
+      .sizeof_storage       = sizeof(int8_t),
       .print_neuron_struct  = NULL,
       .gid_to_doryta_id = identity_map,
       .probe_events     = NULL,
@@ -148,7 +149,7 @@ int main(int argc, char *argv[]) {
 
     // Setting up ROSS variables
     int const num_lps_in_pe = 2;
-    tw_define_lps(num_lps_in_pe, sizeof(struct Message));
+    tw_define_lps(num_lps_in_pe, size_of_Message(settings_neuron_lp.sizeof_storage));
     // set the global variable and initialize each LP's type
     g_tw_lp_types = doryta_lps;
     tw_lp_setup_types();
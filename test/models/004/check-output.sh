@@ -3,5 +3,9 @@
 # Not checking voltage output because it's too large and it doesn't differ
 # much from smaller tests (with 5 and 50 neurons)
 
+diff "$1/spikes-gid=0.txt" \
+     <(sort "$2"/spikes-gid=*.txt) || exit $?
+
+# Both handlers must produce the same spikes
 exec diff "$1/spikes-gid=0.txt" \
-          <(sort "$2"/spikes-gid=*.txt)
+          <(sort "$2"/generic/spikes-gid=*.txt)
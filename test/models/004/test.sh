@@ -1,3 +1,7 @@
 #!/usr/bin/bash
 
-exec mpirun -np $1 "$2" --gvt-interval=32 --extramem=16384 --synch=3 --end=1 --batch=2
+mpirun -np $1 "$2" --gvt-interval=32 --extramem=16384 --synch=3 --end=1 --batch=2 || exit $?
+
+# Running the same model with the generic handlers (instead of those
+# specialized for LIF). Compare the running time reported by ROSS for both
+exec mpirun -np $1 "$2" --gvt-interval=32 --extramem=16384 --synch=3 --end=1 --batch=2 --generic
@@ -17,17 +17,50 @@
  * - Multiple sets can be defined (for multiple LP types)
  */
 tw_lptype doryta_lps[] = {
-    {   .init     = (init_f)    driver_neuron_init,
+    { // Neuron LP - spike-driven mode (specialized for LIF)
+        .init     = (init_f)    driver_neuron_init,
+        .pre_run  = (pre_run_f) NULL,
+        .event    = (event_f)   driver_neuron_event_spike_driven_lif,
+        .revent   = (revent_f)  driver_neuron_event_reverse_spike_driven_lif,
+        .commit   = (commit_f)  driver_neuron_event_commit,
+        .final    = (final_f)   driver_neuron_final,
+        .map      = (map_f)     NULL, // Set own mapping function. ROSS won't work without it! Use `set_mapping_on_all_lps` for that
+        .state_sz = sizeof(struct NeuronLP)},
+
+    { // Neuron LP - spike-driven mode (generic, through function pointers)
+        .init     = (init_f)    driver_neuron_init,
         .pre_run  = (pre_run_f) NULL,
         .event    = (event_f)   driver_neuron_event_spike_driven,
         .revent   = (revent_f)  driver_neuron_event_reverse_spike_driven,
         .commit   = (commit_f)  driver_neuron_event_commit,
         .final    = (final_f)   driver_neuron_final,
-        .map      = (map_f)     NULL, // Set own mapping function. ROSS won't work without it! Use `set_mapping_on_all_lps` for that
+        .map      = (map_f)     NULL,
         .state_sz = sizeof(struct NeuronLP)},
+
     {0},
 };
 
+/** Define command line arguments default values. */
+static unsigned int use_generic_handlers = 0;
+
+
+// The LP type determines which handlers run the neuron
+static tw_lpid model_typemap(tw_lpid gid) {
+    (void) gid;
+    // 0 - specialized for LIF
+    // 1 - generic
+    return use_generic_handlers ? 1 : 0;
+}
+
+
+/** Custom to doryta command line options. */
+static tw_optdef const model_opts[] = {
+    TWOPT_GROUP("Doryta options"),
+    TWOPT_FLAG("generic", use_generic_handlers,
+            "Use the generic handlers instead of those specialized for LIF"),
+    TWOPT_END(),
+};
+
 
 static void initialize_LIF(struct LifNeuron * lif, int32_t doryta_id) {
     (void) doryta_id;
@@ -62,15 +95,17 @@ static void set_mapping_on_all_lps(map_f map) {
 
 
 int main(int argc, char *argv[]) {
-    //tw_opt_add(model_opts);
+    tw_opt_add(model_opts);
     tw_init(&argc, &argv);
 
     // Do some error checking?
     if (tw_nnodes() != 2) {
         fprintf(stderr, "This must be run in 2 PEs.");
     }
+    char const * const output_path = use_generic_handlers ? "output/generic" : "output";
     if (g_tw_mynode == 0) {
       check_folder("output");
+      check_folder(output_path);
     }
 
     size_t neurons_in_pe = (10000 / tw_nnodes()) + 2;
@@ -109,6 +144,8 @@ int main(int argc, char *argv[]) {
       .neuron_fire       = (neuron_fire_f) neurons_lif_fire,
       .store_neuron         = (neuron_state_op_f) neurons_lif_store_state,
       .reverse_store_neuron = (neuron_state_op_f) neurons_lif_reverse_store_state,
+      .sizeof_storage       = sizeof(struct StorageInMessageLif),
+      .neuron_type          = NEURON_TYPE_lif,
       //.print_neuron_struct  = (print_neuron_f) neurons_lif_print,
       //.gid_to_doryta_id    = ...
       .probe_events     = probe_events,
@@ -133,15 +170,17 @@ int main(int argc, char *argv[]) {
     // Setting up ROSS variables
     // number of LPs == number of neurons per PE
     int const num_lps_in_pe = layout_master_total_lps_pe();
-    tw_define_lps(num_lps_in_pe, sizeof(struct Message));
+    tw_define_lps(num_lps_in_pe, size_of_Message(settings_neuron_lp.sizeof_storage));
     // set the global variable and initialize each LP's type
     g_tw_lp_types = doryta_lps;
+    // to determine the type of LP
+    g_tw_lp_typemap = model_typemap;
     tw_lp_setup_types();
     // note that g_tw_nlp gets set here by tw_define_lps
 
     // Allocating memory for probes
-    probes_firing_init(5000, "output", false);
-    probes_lif_voltages_init(50000, "output");
+    probes_firing_init(5000, output_path, false);
+    probes_lif_voltages_init(50000, output_path);
 
     // Running simulation
     tw_run();
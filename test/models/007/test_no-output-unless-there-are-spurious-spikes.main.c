@@ -210,6 +210,7 @@ int main(int argc, char *argv[]) {
       .neuron_fire       = (neuron_fire_f) dummy_fire,
       .store_neuron         = (neuron_state_op_f) dummy_store,
       .reverse_store_neuron = (neuron_state_op_f) dummy_restore,
+      .sizeof_storage       = sizeof(struct DummyNeuron),
       //.print_neuron_struct  = (print_neuron_f) dummy_print,
       .gid_to_doryta_id = identity_map,
       .probe_events     = probe_events,
@@ -222,7 +223,7 @@ int main(int argc, char *argv[]) {
 
     // Setting up ROSS variables
     // number of LPs == number of neurons per PE + supporting neurons
-    tw_define_lps(num_lps_in_pe, sizeof(struct Message));
+    tw_define_lps(num_lps_in_pe, size_of_Message(settings_neuron_lp.sizeof_storage));
     // to determine the type of LP
     g_tw_lp_typemap = model_typemap;
     // set the global variable and initialize each LP's type
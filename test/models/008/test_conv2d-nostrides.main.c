@@ -128,6 +128,7 @@ int main(int argc, char *argv[]) {
       .neuron_fire       = (neuron_fire_f) neurons_lif_fire,
       .store_neuron         = (neuron_state_op_f) neurons_lif_store_state,
       .reverse_store_neuron = (neuron_state_op_f) neurons_lif_reverse_store_state,
+      .sizeof_storage       = sizeof(struct StorageInMessageLif),
       .print_neuron_struct  = (print_neuron_f) neurons_lif_print,
       //.gid_to_doryta_id    = ...
       .probe_events     = probe_events,
@@ -184,7 +185,7 @@ int main(int argc, char *argv[]) {
     // Setting up ROSS variables
     // number of LPs == number of neurons per PE + supporting neurons
     int const num_lps_in_pe = layout_master_total_lps_pe();
-    tw_define_lps(num_lps_in_pe, sizeof(struct Message));
+    tw_define_lps(num_lps_in_pe, size_of_Message(settings_neuron_lp.sizeof_storage));
     // to determine the type of LP
     g_tw_lp_typemap = model_typemap;
     // set the global variable and initialize each LP's type
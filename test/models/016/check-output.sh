@@ -0,0 +1,10 @@
+#!/usr/bin/bash
+
+# The spikes are those of test 015
+expected="$(dirname "$1")/../015/expected_output"
+
+diff <(sort "$expected"/spikes-gid=*.txt) \
+     <(sort "$2"/spikes-gid=*.txt) || exit $?
+
+exec diff <(sort "$expected"/spikes-gid=*.txt) \
+          <(sort "$2"/rollbacks/spikes-gid=*.txt)
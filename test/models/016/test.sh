@@ -0,0 +1,30 @@
+#!/usr/bin/bash
+
+nps=$1
+doryta="$2"
+modelsdir="$3"
+
+grid_width=20
+
+# Testing GoL with random spiking inputs, delivering spikes by multicast. The
+# spikes must be the same as those of test 015. The number of PEs is fixed as
+# the events depend on it: on top of the events of test 015, each of the 484
+# times a neuron in the first layer fires it sends one spike to the SynapseLP
+# of each PE it connects to (two PEs for the 43 firings of the neurons at the
+# border between PEs)
+mpirun -np 2 "$doryta" --synch=3 --spike-driven --spike-multicast \
+    --gol-model --gol-model-size=$grid_width --end=10.2 \
+    --random-spikes-time=0.6 \
+    --random-spikes-uplimit=$((grid_width * grid_width)) \
+    --probe-firing --probe-firing-buffer=20000 \
+    --extramem=100000 || exit $?
+
+# Small batches and GVT intervals make the PEs roll back often. The spikes and
+# (net) events must be the same
+exec mpirun -np 2 "$doryta" --synch=3 --spike-driven --spike-multicast \
+    --gvt-interval=4 --batch=1 --output-dir=output/rollbacks \
+    --gol-model --gol-model-size=$grid_width --end=10.2 \
+    --random-spikes-time=0.6 \
+    --random-spikes-uplimit=$((grid_width * grid_width)) \
+    --probe-firing --probe-firing-buffer=20000 \
+    --extramem=100000
@@ -0,0 +1,41 @@
+#!/usr/bin/bash
+
+nps=$1
+doryta="$2"
+modelsdir="$3"
+
+grid_width=20
+
+# Testing GoL with random spiking inputs, where the neurons in the first layer
+# (up to 18 synapses each) send their spikes to a relay. The relay delivers
+# them in batches of two, ie, it sends itself an event for each batch after
+# the first. The second run delivers them all at once. The spikes must be the
+# same as those of test 015. Two PEs, so that relays deliver spikes to neurons
+# in the other PE
+mpirun -np 2 "$doryta" --synch=3 --spike-driven \
+    --relay-fanout=4 --relay-batch=2 \
+    --gol-model --gol-model-size=$grid_width --end=10.2 \
+    --random-spikes-time=0.6 \
+    --random-spikes-uplimit=$((grid_width * grid_width)) \
+    --probe-firing --probe-firing-buffer=20000 \
+    --extramem=100000 || exit $?
+
+mpirun -np 2 "$doryta" --synch=3 --spike-driven \
+    --relay-fanout=4 --output-dir=output/one-batch \
+    --gol-model --gol-model-size=$grid_width --end=10.2 \
+    --random-spikes-time=0.6 \
+    --random-spikes-uplimit=$((grid_width * grid_width)) \
+    --probe-firing --probe-firing-buffer=20000 \
+    --extramem=100000 || exit $?
+
+# Small batches and GVT intervals make the PEs roll back often, undoing the
+# batches a relay sends to itself. The spikes and (net) events must be the
+# same as in the first run
+exec mpirun -np 2 "$doryta" --synch=3 --spike-driven \
+    --relay-fanout=4 --relay-batch=2 \
+    --gvt-interval=4 --batch=1 --output-dir=output/rollbacks \
+    --gol-model --gol-model-size=$grid_width --end=10.2 \
+    --random-spikes-time=0.6 \
+    --random-spikes-uplimit=$((grid_width * grid_width)) \
+    --probe-firing --probe-firing-buffer=20000 \
+    --extramem=100000
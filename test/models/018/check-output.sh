@@ -0,0 +1,10 @@
+#!/usr/bin/bash
+
+# The spikes are those of test 015
+expected="$(dirname "$1")/../015/expected_output"
+
+for output in "$2" "$2"/optimistic "$2"/rollbacks; do
+    diff <(sort "$expected"/spikes-gid=*.txt) \
+         <(sort "$output"/spikes-gid=*.txt) \
+       || exit $?
+done
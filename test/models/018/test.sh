@@ -0,0 +1,39 @@
+#!/usr/bin/bash
+
+nps=$1
+doryta="$2"
+modelsdir="$3"
+
+grid_width=20
+
+# Testing GoL with random spiking inputs, where the SynapseLPs add up the
+# spikes that go to the same neuron in the same heartbeat (accumulating spikes
+# requires multicast). The spikes must be the same as in test 015, with fewer
+# events than without accumulating (test 016 runs the same on two PEs). The
+# first run checks the lookahead under conservative synchronization
+mpirun -np 2 "$doryta" --synch=2 --spike-driven --accumulate-spikes \
+    --spike-multicast \
+    --gol-model --gol-model-size=$grid_width --end=10.2 \
+    --random-spikes-time=0.6 \
+    --random-spikes-uplimit=$((grid_width * grid_width)) \
+    --probe-firing --probe-firing-buffer=20000 \
+    --extramem=100000 || exit $?
+
+mpirun -np 2 "$doryta" --synch=3 --spike-driven --accumulate-spikes \
+    --spike-multicast --output-dir=output/optimistic \
+    --gol-model --gol-model-size=$grid_width --end=10.2 \
+    --random-spikes-time=0.6 \
+    --random-spikes-uplimit=$((grid_width * grid_width)) \
+    --probe-firing --probe-firing-buffer=20000 \
+    --extramem=100000 || exit $?
+
+# Small batches and GVT intervals make the PEs roll back often, undoing the
+# spikes that SynapseLPs have added up. The spikes and (net) events must be
+# the same
+exec mpirun -np 2 "$doryta" --synch=3 --spike-driven --accumulate-spikes \
+    --spike-multicast --gvt-interval=4 --batch=1 --output-dir=output/rollbacks \
+    --gol-model --gol-model-size=$grid_width --end=10.2 \
+    --random-spikes-time=0.6 \
+    --random-spikes-uplimit=$((grid_width * grid_width)) \
+    --probe-firing --probe-firing-buffer=20000 \
+    --extramem=100000
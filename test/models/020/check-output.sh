@@ -0,0 +1,4 @@
+#!/usr/bin/bash
+
+exec diff <(sort "$1"/spikes-gid=*.txt) \
+          <(sort "$2"/spikes-gid=*.txt)
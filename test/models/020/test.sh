@@ -0,0 +1,16 @@
+#!/usr/bin/bash
+
+nps=$1
+doryta="$2"
+modelsdir="$3"
+
+grid_width=20
+
+# Testing GoL with random spiking inputs on needy mode, skipping the heartbeats
+# of neurons at rest. The spikes must be the same as those of test 015
+exec mpirun -np $1 "$doryta" --synch=3 --skip-quiescent \
+    --gol-model --gol-model-size=$grid_width --end=10.2 \
+    --random-spikes-time=0.6 \
+    --random-spikes-uplimit=$((grid_width * grid_width)) \
+    --probe-firing --probe-firing-buffer=20000 \
+    --extramem=100000
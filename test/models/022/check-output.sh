@@ -0,0 +1,7 @@
+#!/usr/bin/bash
+
+diff <(sort "$1"/spikes-gid=*.txt) \
+     <(sort "$2"/spike-driven-test/spikes-gid=*.txt) || exit $?
+
+exec diff <(sort "$2"/spike-driven-test/spikes-gid=*.txt) \
+          <(sort "$2"/needy-test/spikes-gid=*.txt)
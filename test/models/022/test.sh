@@ -0,0 +1,8 @@
+#!/usr/bin/bash
+
+mkdir -p output/spike-driven-test
+mkdir -p output/needy-test
+
+mpirun -np 2 "$2" --synch=3 --end=1 || exit $?
+# Conservative synchronization uses the lookahead given by the synaptic delays
+exec mpirun -np 2 "$2" --synch=2 --end=1 --spikedriven
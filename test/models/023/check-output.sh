@@ -0,0 +1,17 @@
+#!/usr/bin/bash
+
+# The spikes and stats are those of test 015
+expected="$(dirname "$1")/../015/expected_output"
+
+diff <(sort "$expected"/spikes-gid=*.txt) \
+     <(sort "$2"/spikes-gid=*.txt) \
+   || exit $?
+
+diff <(sort "$expected"/stats-gid=*.txt) \
+     <(sort "$2"/stats-gid=*.txt) \
+   || exit $?
+
+# No synapse is stored, the conv2d synapses are generated (so are the one2one
+# synapses of GoL)
+exec grep -Fx "Total Synapses        = 7528 (stored 0, compact 0, generated 7528)" \
+    "$2"/doryta-params.txt
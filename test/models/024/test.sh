@@ -0,0 +1,11 @@
+#!/usr/bin/bash
+
+nps=$1
+doryta="$2"
+modelsdir="$3"
+
+# Testing Fully Connected Network for MNIST (weights stored as dense matrices)
+exec mpirun -np $1 "$doryta" --synch=3 --spike-driven --dense-all2all \
+    --load-model="$modelsdir"/mnist/snn-models/ffsnn-mnist.doryta.bin \
+    --load-spikes="$modelsdir"/mnist/spikes/spikified-mnist/spikified-images-20.bin \
+    --probe-stats --probe-firing --probe-firing-buffer=20000 --extramem=100000
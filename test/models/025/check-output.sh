@@ -0,0 +1,22 @@
+#!/usr/bin/bash
+
+# The spikes and stats are those of test 015
+expected="$(dirname "$1")/../015/expected_output"
+
+diff <(sort "$expected"/spikes-gid=*.txt) \
+     <(sort "$2"/spikes-gid=*.txt) \
+   || exit $?
+
+diff <(sort "$expected"/stats-gid=*.txt) \
+     <(sort "$2"/stats-gid=*.txt) \
+   || exit $?
+
+# The conv2d synapses are all in the compact store (the one2one synapses of GoL
+# are generated)
+grep -Fx "Total Synapses        = 7528 (stored 0, compact 6728, generated 800)" \
+    "$2"/doryta-params.txt \
+   || exit $?
+
+# and the store takes less memory than storing them one by one
+exec awk '/^Compact Store / { sub(/\(/, "", $6); smaller = $4 + 0 < $6 + 0 }
+          END { exit !smaller }' "$2"/doryta-params.txt
@@ -0,0 +1,20 @@
+#!/usr/bin/bash
+
+# The spikes and stats are those of test 015
+expected="$(dirname "$1")/../015/expected_output"
+
+diff <(sort "$expected"/spikes-gid=*.txt) \
+     <(sort "$2"/spikes-gid=*.txt) \
+   || exit $?
+
+diff <(sort "$expected"/stats-gid=*.txt) \
+     <(sort "$2"/stats-gid=*.txt) \
+   || exit $?
+
+diff <(sort "$expected"/spikes-gid=*.txt) \
+     <(sort "$2"/bands/spikes-gid=*.txt) \
+   || exit $?
+
+# Tiles have shorter borders than bands, so fewer synapses cross PEs
+grep -Fx "Remote Synapses       = 456" "$2"/doryta-params.txt || exit $?
+exec grep -Fx "Remote Synapses       = 696" "$2"/bands/doryta-params.txt
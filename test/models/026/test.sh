@@ -0,0 +1,24 @@
+#!/usr/bin/bash
+
+nps=$1
+doryta="$2"
+modelsdir="$3"
+
+grid_width=20
+
+# Testing GoL (with layers placed in tiles) with random spiking inputs. Four
+# PEs get a 2x2 grid of tiles, instead of four bands of rows. The second run
+# places neurons in bands (the default)
+mpirun -np 4 "$doryta" --synch=2 --spike-driven --tiled-placement \
+    --gol-model --gol-model-size=$grid_width --end=10.2 \
+    --random-spikes-time=0.6 \
+    --random-spikes-uplimit=$((grid_width * grid_width)) \
+    --probe-stats --probe-firing --probe-firing-buffer=20000 \
+    --extramem=100000 || exit $?
+
+exec mpirun -np 4 "$doryta" --synch=2 --spike-driven --output-dir=output/bands \
+    --gol-model --gol-model-size=$grid_width --end=10.2 \
+    --random-spikes-time=0.6 \
+    --random-spikes-uplimit=$((grid_width * grid_width)) \
+    --probe-firing --probe-firing-buffer=20000 \
+    --extramem=100000
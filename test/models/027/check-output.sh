@@ -0,0 +1,18 @@
+#!/usr/bin/bash
+
+# Same spikes and stats as without placing by load (test 015)
+expected="$(dirname "$1")/../015/expected_output"
+
+diff <(sort "$expected"/spikes-gid=*.txt) \
+     <(sort "$2"/spikes-gid=*.txt) \
+   || exit $?
+
+diff <(sort "$expected"/stats-gid=*.txt) \
+     <(sort "$2"/stats-gid=*.txt) \
+   || exit $?
+
+# Placing by number of neurons gives 600 neurons to each PE. By load, the PEs
+# get a different number of neurons but (about) the same load
+grep -Fx "Neurons in a PE       = min 555, max 645" "$2"/doryta-params.txt \
+   || exit $?
+exec grep -Fx "Load in a PE          = min 10958, max 10965" "$2"/doryta-params.txt
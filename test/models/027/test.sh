@@ -0,0 +1,19 @@
+#!/usr/bin/bash
+
+nps=$1
+doryta="$2"
+modelsdir="$3"
+testdir="$(dirname "$0")"
+
+grid_width=20
+
+# Testing GoL with random spiking inputs, placing neurons by the load they had
+# on the same run (the expected stats of test 015). Two PEs at least are needed
+# for the placement to change
+exec mpirun -np 2 "$doryta" --synch=2 --spike-driven \
+    --load-stats="$testdir/../015/expected_output" \
+    --gol-model --gol-model-size=$grid_width --end=10.2 \
+    --random-spikes-time=0.6 \
+    --random-spikes-uplimit=$((grid_width * grid_width)) \
+    --probe-stats --probe-firing --probe-firing-buffer=20000 \
+    --extramem=100000
@@ -0,0 +1,12 @@
+#!/usr/bin/bash
+
+# The load of each PE depends on the number of PEs, but the total load on each
+# window does not
+total_load() {
+    awk '{ load[$1] += $2 } END { for (w in load) { print w "\t" load[w] } }' \
+        "$1"/load-gid=*.txt | sort -n
+}
+
+diff <(total_load "$1") <(total_load "$2") || exit $?
+
+exec diff <(total_load "$1"/multicast) <(total_load "$2"/multicast)
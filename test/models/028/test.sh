@@ -0,0 +1,26 @@
+#!/usr/bin/bash
+
+nps=$1
+doryta="$2"
+modelsdir="$3"
+
+grid_width=20
+
+# Testing GoL with random spiking inputs, recording the load of each PE per
+# heartbeat
+mpirun -np $1 "$doryta" --synch=2 --spike-driven \
+    --gol-model --gol-model-size=$grid_width --end=10.2 \
+    --random-spikes-time=0.6 \
+    --random-spikes-uplimit=$((grid_width * grid_width)) \
+    --probe-load --probe-load-interval=1 \
+    --extramem=100000 || exit $?
+
+# The load includes the events of the SynapseLPs (multicast and accumulated
+# spikes). The number of PEs is fixed as the events depend on it
+exec mpirun -np 2 "$doryta" --synch=2 --spike-driven \
+    --spike-multicast --accumulate-spikes --output-dir=output/multicast \
+    --gol-model --gol-model-size=$grid_width --end=10.2 \
+    --random-spikes-time=0.6 \
+    --random-spikes-uplimit=$((grid_width * grid_width)) \
+    --probe-load --probe-load-interval=1 \
+    --extramem=100000
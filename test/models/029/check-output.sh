@@ -0,0 +1,23 @@
+#!/usr/bin/bash
+
+diff <(sort "$1"/spikes-gid=*.txt) \
+     <(sort "$2"/sparse-test/spikes-gid=*.txt) || exit $?
+
+diff <(sort "$2"/dense-test/spikes-gid=*.txt) \
+     <(sort "$2"/mapped-test/spikes-gid=*.txt) || exit $?
+
+diff <(sort "$2"/dense-test/spikes-gid=*.txt) \
+     <(sort "$2"/scattered-test/spikes-gid=*.txt) || exit $?
+
+diff <(sort "$2"/dense-test/spikes-gid=*.txt) \
+     <(sort "$2"/scattered-per-node-test/spikes-gid=*.txt) || exit $?
+
+diff <(sort "$2"/dense-test/spikes-gid=*.txt) \
+     <(sort "$2"/sharded-test/spikes-gid=*.txt) || exit $?
+
+diff <(sort "$2"/dense-test/spikes-gid=*.txt) \
+     <(sort "$2"/multicast-test/spikes-gid=*.txt) || exit $?
+
+# Spikes with zero weight change nothing
+exec diff <(sort "$2"/sparse-test/spikes-gid=*.txt) \
+          <(sort "$2"/dense-test/spikes-gid=*.txt)
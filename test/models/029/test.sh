@@ -0,0 +1,13 @@
+#!/usr/bin/bash
+
+# The same pruned network stored with all2all groups (zero weights included),
+# with sparse groups, with all2all groups mapped from the file, with all2all
+# groups read by a single PE, read by one PE per node, partitioned in shards
+# (one per PE), and delivering spikes by multicast and relays
+mpirun -np 2 "$2" --synch=3 --end=1 || exit $?
+mpirun -np 2 "$2" --synch=3 --end=1 --sparse || exit $?
+mpirun -np 3 "$2" --synch=3 --end=1 --mapped || exit $?
+mpirun -np 3 "$2" --synch=3 --end=1 --scattered || exit $?
+mpirun -np 3 "$2" --synch=3 --end=1 --scattered-per-node || exit $?
+mpirun -np 3 "$2" --synch=3 --end=1 --sharded || exit $?
+exec mpirun -np 3 "$2" --synch=3 --end=1 --multicast
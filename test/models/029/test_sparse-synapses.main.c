@@ -0,0 +1,515 @@
+#include <ross.h>
+#include <doryta_config.h>
+#include <pcg_basic.h>
+#include "driver/neuron.h"
+#include "driver/synapse.h"
+#include "layout/master.h"
+#include "message.h"
+#include "model-loaders/regular_io/load_neurons.h"
+#include "neurons/lif.h"
+#include "probes/firing.h"
+#include "storable_spikes.h"
+#include "utils/io.h"
+#include "utils/pcg32_random.h"
+
+
+/** Defining LP types.
+ * - These are the functions called by ROSS for each LP
+ * - Multiple sets can be defined (for multiple LP types)
+ */
+tw_lptype doryta_lps[] = {
+    { // Neuron LP - needy mode
+        .init     = (init_f)    driver_neuron_init,
+        .pre_run  = (pre_run_f) driver_neuron_pre_run_needy,
+        .event    = (event_f)   driver_neuron_event_needy,
+        .revent   = (revent_f)  driver_neuron_event_reverse_needy,
+        .commit   = (commit_f)  driver_neuron_event_commit,
+        .final    = (final_f)   driver_neuron_final,
+        .map      = (map_f)     NULL, // Set own mapping function. ROSS won't work without it! Use `set_mapping_on_all_lps` for that
+        .state_sz = sizeof(struct NeuronLP)},
+
+    { // SynapseLP - delivers spikes on behalf of neurons (multicast and relays)
+        .init     = (init_f)    driver_synapse_init,
+        .pre_run  = (pre_run_f) NULL,
+        .event    = (event_f)   driver_synapse_event,
+        .revent   = (revent_f)  driver_synapse_event_reverse,
+        .commit   = (commit_f)  driver_synapse_event_commit,
+        .final    = (final_f)   driver_synapse_final,
+        .map      = (map_f)     NULL,
+        .state_sz = sizeof(struct SynapseLP)},
+
+    {0},
+};
+
+/** Define command line arguments default values. */
+static bool is_sparse = false;
+static bool is_mapped = false;
+static bool is_scattered = false;
+static bool is_scattered_per_node = false;
+static bool is_sharded = false;
+static bool is_multicast = false;
+
+
+// The LP type is either a neuron (0) or a SynapseLP (1)
+static tw_lpid model_typemap(tw_lpid gid) {
+    return layout_master_gid_is_synapse_lp(gid) ? 1 : 0;
+}
+
+
+/**
+ * Helper function to make all LPs use the same (GID -> local ID) mapping
+ * function.
+ */
+static void set_mapping_on_all_lps(map_f map) {
+    for (size_t i = 0; doryta_lps[i].event != NULL; i++) {
+        doryta_lps[i].map = map;
+    }
+}
+
+
+/** Custom to doryta command line options. */
+static tw_optdef const model_opts[] = {
+    TWOPT_GROUP("Doryta options"),
+    TWOPT_FLAG("sparse", is_sparse,
+            "Store the pruned layers as sparse groups (model format 4) instead of "
+            "all2all groups with zero weights (model format 3)"),
+    TWOPT_FLAG("mapped", is_mapped,
+            "Store the weights of all2all groups as matrices (model format 8), "
+            "and use them in place (dense all2all groups)"),
+    TWOPT_FLAG("scattered", is_scattered,
+            "Store the network as all2all groups (model format 3), and only "
+            "read it from PE 0, which sends each PE its neurons (the shard of "
+            "each PE is saved too)"),
+    TWOPT_FLAG("scattered-per-node", is_scattered_per_node,
+            "Store the network as all2all groups (model format 3), and only "
+            "read it from one PE per node, which sends each PE in the node its "
+            "neurons"),
+    TWOPT_FLAG("sharded", is_sharded,
+            "Load the network from the shards saved with `--scattered`"),
+    TWOPT_FLAG("multicast", is_multicast,
+            "Store the network as all2all groups (model format 3), and deliver "
+            "its spikes by multicast and relays (for the input layer)"),
+    TWOPT_END(),
+};
+
+
+// Network: 40 input neurons, 20 hidden neurons and 10 output neurons. The
+// input connects to the hidden layer, and the hidden layer to the output
+// layer. Only a fraction of the synapses in both layers are non-zero
+// (pruned). The first half of the hidden layer is also fully connected to the
+// first half of the output layer
+#define NUM_INPUT  40
+#define NUM_HIDDEN 20
+#define NUM_OUTPUT 10
+#define HIDDEN_START NUM_INPUT
+#define OUTPUT_START (NUM_INPUT + NUM_HIDDEN)
+#define TOTAL_NEURONS (NUM_INPUT + NUM_HIDDEN + NUM_OUTPUT)
+
+struct Pruned {
+    int32_t from_start;
+    int32_t from_end;
+    int32_t to_start;
+    int32_t to_end;
+    uint16_t delay;
+    float density;
+};
+
+static struct Pruned const pruned[2] = {
+    {0, NUM_INPUT - 1, HIDDEN_START, OUTPUT_START - 1, 1, .25},
+    {HIDDEN_START, OUTPUT_START - 1, OUTPUT_START + NUM_OUTPUT / 2, TOTAL_NEURONS - 1, 2, .4},
+};
+static struct Pruned const fully =
+    {HIDDEN_START, HIDDEN_START + NUM_HIDDEN / 2 - 1, OUTPUT_START, OUTPUT_START + NUM_OUTPUT / 2 - 1, 1, 1};
+
+
+// Weight of a synapse. It is zero for the synapses that have been pruned
+static float weight_of(int32_t neuron_from, int32_t neuron_to, float density) {
+    pcg32_random_t rng;
+    uint32_t const initstate = (neuron_from + 1) + (neuron_to + 1) * 65537u + 65536u; // 2^16
+    uint32_t const initseq = (neuron_from + 1) * (neuron_to + 1) + 2147483648; // 2^31
+    pcg32_srandom_r(&rng, initstate, initseq);
+
+    if (pcg32_float_r(&rng) >= density) {
+        return 0;
+    }
+    return 0.2 + pcg32_float_r(&rng) * 0.4;
+}
+
+
+// ==================== Writing model to file (big endian) ====================
+static void write_uint8(FILE * fp, uint8_t val) {
+    fputc(val, fp);
+}
+static void write_uint16(FILE * fp, uint16_t val) {
+    val = htons(val);
+    fwrite(&val, sizeof(val), 1, fp);
+}
+static void write_int32(FILE * fp, int32_t val) {
+    uint32_t const res = htonl(val);
+    fwrite(&res, sizeof(res), 1, fp);
+}
+static void write_float(FILE * fp, float val) {
+    union {
+        uint32_t ui32;
+        float flt;
+    } res = {.flt = val};
+    res.ui32 = htonl(res.ui32);
+    fwrite(&res.ui32, sizeof(res.ui32), 1, fp);
+}
+
+static void write_group_header(FILE * fp, uint8_t conn_type, struct Pruned const * group) {
+    write_uint8(fp, conn_type);
+    write_int32(fp, group->from_start);
+    write_int32(fp, group->from_end);
+    write_int32(fp, group->to_start);
+    write_int32(fp, group->to_end);
+    write_uint16(fp, group->delay);
+}
+
+static void write_sparse_group(FILE * fp, struct Pruned const * group) {
+    write_group_header(fp, 0x3, group);
+
+    int32_t num_synapses = 0;
+    for (int32_t i = group->from_start; i <= group->from_end; i++) {
+        for (int32_t j = group->to_start; j <= group->to_end; j++) {
+            num_synapses += weight_of(i, j, group->density) != 0;
+        }
+    }
+    write_int32(fp, num_synapses);
+
+    // Rows
+    int32_t row_start = 0;
+    write_int32(fp, row_start);
+    for (int32_t i = group->from_start; i <= group->from_end; i++) {
+        for (int32_t j = group->to_start; j <= group->to_end; j++) {
+            row_start += weight_of(i, j, group->density) != 0;
+        }
+        write_int32(fp, row_start);
+    }
+    // Columns
+    for (int32_t i = group->from_start; i <= group->from_end; i++) {
+        for (int32_t j = group->to_start; j <= group->to_end; j++) {
+            if (weight_of(i, j, group->density) != 0) {
+                write_int32(fp, j - group->to_start);
+            }
+        }
+    }
+    // Weights
+    for (int32_t i = group->from_start; i <= group->from_end; i++) {
+        for (int32_t j = group->to_start; j <= group->to_end; j++) {
+            float const weight = weight_of(i, j, group->density);
+            if (weight != 0) {
+                write_float(fp, weight);
+            }
+        }
+    }
+}
+
+static void write_fully_weights(FILE * fp, int32_t neuron, struct Pruned const * group) {
+    write_int32(fp, group->to_start);
+    write_int32(fp, group->to_end);
+    for (int32_t j = group->to_start; j <= group->to_end; j++) {
+        write_float(fp, weight_of(neuron, j, group->density));
+    }
+}
+
+// Little-endian (format 8 matrices)
+static void write_float_le(FILE * fp, float val) {
+    union {
+        uint32_t ui32;
+        float flt;
+    } res = {.flt = val};
+    for (int i = 0; i < 4; i++) {
+        fputc((res.ui32 >> (8 * i)) & 0xFF, fp);
+    }
+}
+
+static void write_uint64(FILE * fp, uint64_t val) {
+    write_int32(fp, val >> 32);
+    write_int32(fp, val & 0xFFFFFFFF);
+}
+
+// Format 8: all2all groups point to their matrix of weights (stored after the
+// neurons), and neurons are found through a table of offsets (one per neuron)
+static void write_mapped_model(char const filename[]) {
+    FILE * fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        tw_error(TW_LOC, "Unable to write model to `%s`", filename);
+    }
+
+    uint32_t const magic = htonl(0x23432BC4);
+    fwrite(&magic, sizeof(magic), 1, fp);
+    write_uint16(fp, 0x8);
+    write_int32(fp, TOTAL_NEURONS);
+    write_uint16(fp, 3); // neuron groups
+    write_uint16(fp, 3); // synapse groups
+    write_float(fp, 1.0/256); // beat
+    write_int32(fp, NUM_INPUT);
+    write_int32(fp, NUM_HIDDEN);
+    write_int32(fp, NUM_OUTPUT);
+
+    // Synapse groups. Their matrices are written (and their positions filled
+    // in) at the end
+    struct Pruned const * const groups[3] = {&pruned[0], &pruned[1], &fully};
+    long group_offsets[3];
+    for (int i = 0; i < 3; i++) {
+        write_group_header(fp, 0x1, groups[i]);
+        group_offsets[i] = ftell(fp);
+        write_uint64(fp, 0);
+    }
+
+    // Table of offsets (a block per neuron)
+    write_int32(fp, 1);
+    long const table = ftell(fp);
+    for (int32_t i = 0; i < TOTAL_NEURONS; i++) {
+        write_uint64(fp, 0);
+    }
+
+    uint64_t neuron_offsets[TOTAL_NEURONS];
+    for (int32_t i = 0; i < TOTAL_NEURONS; i++) {
+        neuron_offsets[i] = ftell(fp);
+        write_float(fp, 0);     // potential
+        write_float(fp, 0);     // current
+        write_float(fp, 0);     // resting_potential
+        write_float(fp, 0);     // reset_potential
+        write_float(fp, i < NUM_INPUT ? 0.5 : 0.8); // threshold
+        write_float(fp, 0.2);   // tau_m
+        write_float(fp, 30);    // resistance
+        write_uint16(fp, 0);
+    }
+
+    uint64_t matrix_offsets[3];
+    for (int i = 0; i < 3; i++) {
+        while (ftell(fp) % 64 != 0) {
+            fputc(0, fp);
+        }
+        matrix_offsets[i] = ftell(fp);
+        for (int32_t from = groups[i]->from_start; from <= groups[i]->from_end; from++) {
+            for (int32_t to = groups[i]->to_start; to <= groups[i]->to_end; to++) {
+                write_float_le(fp, weight_of(from, to, groups[i]->density));
+            }
+        }
+    }
+
+    for (int i = 0; i < 3; i++) {
+        fseek(fp, group_offsets[i], SEEK_SET);
+        write_uint64(fp, matrix_offsets[i]);
+    }
+    fseek(fp, table, SEEK_SET);
+    for (int32_t i = 0; i < TOTAL_NEURONS; i++) {
+        write_uint64(fp, neuron_offsets[i]);
+    }
+
+    fclose(fp);
+}
+
+static void write_model(char const filename[]) {
+    if (is_mapped) {
+        write_mapped_model(filename);
+        return;
+    }
+
+    FILE * fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        tw_error(TW_LOC, "Unable to write model to `%s`", filename);
+    }
+
+    uint32_t const magic = htonl(0x23432BC4);
+    fwrite(&magic, sizeof(magic), 1, fp);
+    write_uint16(fp, is_sparse ? 0x4 : 0x3);
+    write_int32(fp, TOTAL_NEURONS);
+    write_uint16(fp, 3); // neuron groups
+    write_uint16(fp, 3); // synapse groups
+    write_float(fp, 1.0/256); // beat
+    write_int32(fp, NUM_INPUT);
+    write_int32(fp, NUM_HIDDEN);
+    write_int32(fp, NUM_OUTPUT);
+
+    // Synapse groups
+    for (int i = 0; i < 2; i++) {
+        if (is_sparse) {
+            write_sparse_group(fp, &pruned[i]);
+        } else {
+            write_group_header(fp, 0x1, &pruned[i]);
+        }
+    }
+    write_group_header(fp, 0x1, &fully);
+
+    // Neurons and the weights of their fully groups (in order of definition)
+    for (int32_t i = 0; i < TOTAL_NEURONS; i++) {
+        write_float(fp, 0);     // potential
+        write_float(fp, 0);     // current
+        write_float(fp, 0);     // resting_potential
+        write_float(fp, 0);     // reset_potential
+        write_float(fp, i < NUM_INPUT ? 0.5 : 0.8); // threshold
+        write_float(fp, 0.2);   // tau_m
+        write_float(fp, 30);    // resistance
+
+        struct Pruned const * groups[3];
+        uint16_t num_groups = 0;
+        if (!is_sparse) {
+            for (int k = 0; k < 2; k++) {
+                if (pruned[k].from_start <= i && i <= pruned[k].from_end) {
+                    groups[num_groups++] = &pruned[k];
+                }
+            }
+        }
+        if (fully.from_start <= i && i <= fully.from_end) {
+            groups[num_groups++] = &fully;
+        }
+        write_uint16(fp, num_groups);
+        for (uint16_t k = 0; k < num_groups; k++) {
+            write_fully_weights(fp, i, groups[k]);
+        }
+    }
+
+    fclose(fp);
+}
+
+
+// Input neurons receive a few spikes spread over time
+#define MAX_SPIKES_PER_NEURON 16
+
+static void generate_spikes(struct SettingsNeuronLP * settings_neuron_lp,
+        struct StorableSpike ** spikes, struct StorableSpike * naked_spikes) {
+    for (int32_t i = 0; i < settings_neuron_lp->num_neurons_pe; i++) {
+        int32_t const doryta_id = layout_master_local_id_to_doryta_id(i);
+        if (doryta_id >= NUM_INPUT) {
+            continue;
+        }
+        pcg32_random_t rng;
+        pcg32_srandom_r(&rng, doryta_id + 42u, doryta_id + 54u);
+
+        struct StorableSpike * const spikes_neuron =
+            &naked_spikes[i * (MAX_SPIKES_PER_NEURON + 1)];
+        int n = 0;
+        for (int k = 0; k < MAX_SPIKES_PER_NEURON; k++) {
+            if (pcg32_float_r(&rng) < .3) {
+                spikes_neuron[n] = (struct StorableSpike) {
+                    .neuron = doryta_id,
+                    .time = 0.05 * (k + 1) + 0.001,
+                    .intensity = 1,
+                };
+                n++;
+            }
+        }
+        spikes[i] = spikes_neuron;
+    }
+    settings_neuron_lp->spikes = spikes;
+}
+
+
+int main(int argc, char *argv[]) {
+    tw_opt_add(model_opts);
+    tw_init(&argc, &argv);
+
+    char const * const output_path = is_mapped ? "output/mapped-test"
+        : (is_scattered ? "output/scattered-test"
+        : (is_scattered_per_node ? "output/scattered-per-node-test"
+        : (is_sharded ? "output/sharded-test"
+        : (is_multicast ? "output/multicast-test"
+        : (is_sparse ? "output/sparse-test" : "output/dense-test")))));
+    char const * const model_path = is_mapped ? "output/mapped.doryta.bin"
+        : (is_scattered ? "output/scattered.doryta.bin"
+        : (is_scattered_per_node ? "output/scattered-per-node.doryta.bin"
+        : (is_multicast ? "output/multicast.doryta.bin"
+        : (is_sparse ? "output/sparse.doryta.bin" : "output/dense.doryta.bin"))));
+
+    if (g_tw_mynode == 0) {
+      check_folder("output");
+      check_folder(output_path);
+      if (!is_sharded) {
+          write_model(model_path);
+      }
+    }
+    // The model has to be written before any PE reads it
+    MPI_Barrier(MPI_COMM_ROSS);
+
+    // The weights of the mapped model are used in place
+    if (is_mapped) {
+        layout_master_set_options(&(struct LayoutMasterOptions) {
+            .dense_all2all = true,
+        });
+    }
+    // The input neurons (20 synapses) get a relay, the hidden ones do not.
+    // Weights are loaded once the layout is initialized, and only then
+    // multicast and relays take the synapses over
+    if (is_multicast) {
+        layout_master_set_options(&(struct LayoutMasterOptions) {
+            .multicast = true,
+            .relay_fanout = 16,
+        });
+    }
+
+    struct SettingsNeuronLP settings_neuron_lp;
+    struct ModelParams params;
+    if (is_scattered) {
+        params = model_load_neurons_partition(&settings_neuron_lp, model_path, "output/shard");
+    } else if (is_scattered_per_node) {
+        params = model_load_neurons_init_scattered_per_node(&settings_neuron_lp, model_path);
+    } else if (is_sharded) {
+        params = model_load_neurons_init_shard(&settings_neuron_lp, "output/shard");
+    } else {
+        params = model_load_neurons_init(&settings_neuron_lp, model_path);
+    }
+
+    // Spikes
+    struct StorableSpike ** spikes =
+        calloc(settings_neuron_lp.num_neurons_pe, sizeof(struct StorableSpike*));
+    struct StorableSpike * naked_spikes = calloc(
+            settings_neuron_lp.num_neurons_pe * (MAX_SPIKES_PER_NEURON + 1),
+            sizeof(struct StorableSpike));
+    if (spikes == NULL || naked_spikes == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space for spikes");
+    }
+    generate_spikes(&settings_neuron_lp, spikes, naked_spikes);
+
+    probe_event_f probe_events[2] = {probes_firing_record, NULL};
+    settings_neuron_lp.probe_events = probe_events;
+
+    driver_neuron_config(&settings_neuron_lp);
+    set_mapping_on_all_lps(params.gid_to_pe);
+
+    struct SettingsSynapseLP settings_synapse_lp = {
+        .beat = settings_neuron_lp.beat,
+    };
+    layout_master_configure_synapse_lps(&settings_synapse_lp);
+    driver_synapse_config(&settings_synapse_lp);
+
+    // The lookahead is determined by the delays (and heartbeats)
+    if (g_tw_synchronization_protocol == CONSERVATIVE) {
+        double const lookahead_pe = fmin(driver_neuron_lookahead(false),
+                driver_synapse_lookahead());
+        double lookahead;
+        MPI_Allreduce(&lookahead_pe, &lookahead, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_ROSS);
+        // Offsets are computed from timestamps, so they might be rounded
+        // slightly below the lookahead
+        g_tw_lookahead = lookahead * (1 - 1e-6);
+    }
+
+    // Setting up ROSS variables
+    tw_define_lps(params.lps_in_pe, size_of_Message(settings_neuron_lp.sizeof_storage));
+    // to determine the type of LP
+    g_tw_lp_typemap = model_typemap;
+    // set the global variable and initialize each LP's type
+    g_tw_lp_types = doryta_lps;
+    tw_lp_setup_types();
+
+    // Allocating memory for probes
+    probes_firing_init(5000, output_path, false);
+
+    // Running simulation
+    tw_run();
+    // Simulation ends when the function exits
+
+    // Deallocating/deinitializing everything
+    probes_firing_deinit();
+
+    model_load_neurons_deinit();
+    free(naked_spikes);
+    free(spikes);
+
+    tw_end();
+
+    return 0;
+}
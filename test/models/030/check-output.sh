@@ -0,0 +1,20 @@
+#!/usr/bin/bash
+
+# Pruning doesn't change the spikes (test 015)
+diff <(sort "$(dirname "$1")"/../015/expected_output/spikes-gid=*.txt) \
+     <(sort "$2"/spikes-gid=*.txt) \
+   || exit $?
+
+# but neurons integrate fewer spikes
+diff <(sort "$1"/stats-gid=*.txt) \
+     <(sort "$2"/stats-gid=*.txt) \
+   || exit $?
+
+# The 400 synapses of a cell to itself (with zero weight) are gone, out of 7528
+grep -E "^Pruned Synapses       = 400 \(at most [0-9]+ in a PE\)$" \
+    "$2"/doryta-params.txt \
+   || exit $?
+grep -Fx "Total Synapses        = 7128 (stored 6328, compact 0, generated 800)" \
+    "$2"/doryta-params.txt \
+   || exit $?
+exec awk '{ synapses += $2 } END { exit synapses != 7128 }' "$2"/stats-gid=*.txt
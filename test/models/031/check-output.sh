@@ -0,0 +1,10 @@
+#!/usr/bin/bash
+
+diff <(sort "$1"/spikes-gid=*.txt) \
+     <(sort "$2"/channels-test/spikes-gid=*.txt) || exit $?
+
+diff <(sort "$2"/channels-test/spikes-gid=*.txt) \
+     <(sort "$2"/offsets-test/spikes-gid=*.txt) || exit $?
+
+exec diff <(sort "$2"/channels-test/spikes-gid=*.txt) \
+          <(sort "$2"/pairs-test/spikes-gid=*.txt)
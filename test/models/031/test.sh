@@ -0,0 +1,7 @@
+#!/usr/bin/bash
+
+# The same conv2d network stored with one group per pair of channels, with a
+# group per layer, and with a group per layer and the offsets of the neurons
+mpirun -np 2 "$2" --synch=3 --end=1 || exit $?
+mpirun -np 2 "$2" --synch=3 --end=1 --channels || exit $?
+exec mpirun -np 3 "$2" --synch=3 --end=1 --offsets
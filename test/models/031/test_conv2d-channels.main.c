@@ -0,0 +1,348 @@
+#include <ross.h>
+#include <doryta_config.h>
+#include <pcg_basic.h>
+#include "driver/neuron.h"
+#include "layout/master.h"
+#include "message.h"
+#include "model-loaders/regular_io/load_neurons.h"
+#include "neurons/lif.h"
+#include "probes/firing.h"
+#include "storable_spikes.h"
+#include "utils/io.h"
+#include "utils/pcg32_random.h"
+
+
+/** Defining LP types.
+ * - These are the functions called by ROSS for each LP
+ * - Multiple sets can be defined (for multiple LP types)
+ */
+tw_lptype doryta_lps[] = {
+    { // Neuron LP - needy mode
+        .init     = (init_f)    driver_neuron_init,
+        .pre_run  = (pre_run_f) driver_neuron_pre_run_needy,
+        .event    = (event_f)   driver_neuron_event_needy,
+        .revent   = (revent_f)  driver_neuron_event_reverse_needy,
+        .commit   = (commit_f)  driver_neuron_event_commit,
+        .final    = (final_f)   driver_neuron_final,
+        .map      = (map_f)     NULL, // Set own mapping function. ROSS won't work without it! Use `set_mapping_on_all_lps` for that
+        .state_sz = sizeof(struct NeuronLP)},
+
+    {0},
+};
+
+/** Define command line arguments default values. */
+static bool with_channels = false;
+static bool with_offsets = false;
+
+
+/**
+ * Helper function to make all LPs use the same (GID -> local ID) mapping
+ * function.
+ */
+static void set_mapping_on_all_lps(map_f map) {
+    for (size_t i = 0; doryta_lps[i].event != NULL; i++) {
+        doryta_lps[i].map = map;
+    }
+}
+
+
+/** Custom to doryta command line options. */
+static tw_optdef const model_opts[] = {
+    TWOPT_GROUP("Doryta options"),
+    TWOPT_FLAG("channels", with_channels,
+            "Store each conv2d layer as a single group with several channels "
+            "(model format 6) instead of one group per pair of channels (model "
+            "format 3)"),
+    TWOPT_FLAG("offsets", with_offsets,
+            "Store each conv2d layer as a single group, and the position of "
+            "the neurons in the file (model format 7)"),
+    TWOPT_END(),
+};
+
+
+// Network: an input layer of 2 channels (8x8 maps each), followed by two
+// conv2d layers. The first one has 3 channels (8x8, 3x3 kernel with padding
+// 1), and the second one has 4 channels (3x3, 3x3 kernel with stride 2)
+#define NUM_INPUT  (2 * 8 * 8)
+#define NUM_HIDDEN (3 * 8 * 8)
+#define NUM_OUTPUT (4 * 3 * 3)
+#define HIDDEN_START NUM_INPUT
+#define OUTPUT_START (NUM_INPUT + NUM_HIDDEN)
+#define TOTAL_NEURONS (NUM_INPUT + NUM_HIDDEN + NUM_OUTPUT)
+// Neurons per block in the table of offsets (model format 7)
+#define BLOCK_SIZE 50
+#define NUM_BLOCKS ((TOTAL_NEURONS + BLOCK_SIZE - 1) / BLOCK_SIZE)
+
+struct ConvLayer {
+    int32_t from_start;
+    int32_t to_start;
+    int32_t in_channels;
+    int32_t out_channels;
+    int32_t input_width;  // Maps are square
+    int32_t output_width;
+    int32_t kernel_width; // Kernels are square
+    int32_t padding;
+    int32_t stride;
+    uint16_t delay;
+};
+
+static struct ConvLayer const layers[2] = {
+    {0,            HIDDEN_START, 2, 3, 8, 8, 3, 1, 1, 1},
+    {HIDDEN_START, OUTPUT_START, 3, 4, 8, 3, 3, 0, 2, 2},
+};
+
+
+// Weight of the element `k` of the kernel connecting channel `in` to channel
+// `out` of a layer
+static float weight_of(int layer, int32_t in, int32_t out, int32_t k) {
+    pcg32_random_t rng;
+    uint32_t const initstate = (layer + 1) + (in + 1) * 257u + (out + 1) * 65537u;
+    uint32_t const initseq = (k + 1) * 2654435761u;
+    pcg32_srandom_r(&rng, initstate, initseq);
+
+    return -0.2 + pcg32_float_r(&rng) * 0.6;
+}
+
+
+// ==================== Writing model to file (big endian) ====================
+static void write_uint8(FILE * fp, uint8_t val) {
+    fputc(val, fp);
+}
+static void write_uint16(FILE * fp, uint16_t val) {
+    val = htons(val);
+    fwrite(&val, sizeof(val), 1, fp);
+}
+static void write_int32(FILE * fp, int32_t val) {
+    uint32_t const res = htonl(val);
+    fwrite(&res, sizeof(res), 1, fp);
+}
+static void write_float(FILE * fp, float val) {
+    union {
+        uint32_t ui32;
+        float flt;
+    } res = {.flt = val};
+    res.ui32 = htonl(res.ui32);
+    fwrite(&res.ui32, sizeof(res.ui32), 1, fp);
+}
+
+// Writes the group connecting the channels `in_first` to `in_last` of a
+// layer to its channels `out_first` to `out_last`
+static void write_conv_group(FILE * fp, int layer,
+        int32_t in_first, int32_t in_last, int32_t out_first, int32_t out_last) {
+    struct ConvLayer const * const conv = &layers[layer];
+    int32_t const input_map = conv->input_width * conv->input_width;
+    int32_t const output_map = conv->output_width * conv->output_width;
+    bool const channels = in_first != in_last || out_first != out_last;
+
+    write_uint8(fp, channels ? 0x5 : 0x2);
+    write_int32(fp, conv->from_start + in_first * input_map);
+    write_int32(fp, conv->from_start + (in_last + 1) * input_map - 1);
+    write_int32(fp, conv->to_start + out_first * output_map);
+    write_int32(fp, conv->to_start + (out_last + 1) * output_map - 1);
+    write_uint16(fp, conv->delay);
+    if (channels) {
+        write_int32(fp, in_last - in_first + 1);
+        write_int32(fp, out_last - out_first + 1);
+    }
+    write_int32(fp, conv->input_width);   // input height
+    write_int32(fp, conv->input_width);
+    write_int32(fp, conv->output_width);  // output height
+    write_int32(fp, conv->output_width);
+    write_int32(fp, conv->padding);       // padding height
+    write_int32(fp, conv->padding);
+    write_int32(fp, conv->stride);        // stride height
+    write_int32(fp, conv->stride);
+    write_int32(fp, conv->kernel_width);  // kernel height
+    write_int32(fp, conv->kernel_width);
+
+    int32_t const kernel_size = conv->kernel_width * conv->kernel_width;
+    for (int32_t in = in_first; in <= in_last; in++) {
+        for (int32_t out = out_first; out <= out_last; out++) {
+            for (int32_t k = 0; k < kernel_size; k++) {
+                write_float(fp, weight_of(layer, in, out, k));
+            }
+        }
+    }
+}
+
+static void write_model(char const filename[]) {
+    FILE * fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        tw_error(TW_LOC, "Unable to write model to `%s`", filename);
+    }
+
+    bool const channels = with_channels || with_offsets;
+    uint16_t num_synapse_groups = 0;
+    for (int i = 0; i < 2; i++) {
+        num_synapse_groups += channels ? 1 : layers[i].in_channels * layers[i].out_channels;
+    }
+
+    uint32_t const magic = htonl(0x23432BC4);
+    fwrite(&magic, sizeof(magic), 1, fp);
+    write_uint16(fp, with_offsets ? 0x7 : (channels ? 0x6 : 0x3));
+    write_int32(fp, TOTAL_NEURONS);
+    write_uint16(fp, 3); // neuron groups
+    write_uint16(fp, num_synapse_groups);
+    write_float(fp, 1.0/256); // beat
+    write_int32(fp, NUM_INPUT);
+    write_int32(fp, NUM_HIDDEN);
+    write_int32(fp, NUM_OUTPUT);
+
+    // Synapse groups
+    for (int i = 0; i < 2; i++) {
+        int32_t const in_channels = layers[i].in_channels;
+        int32_t const out_channels = layers[i].out_channels;
+        if (channels) {
+            write_conv_group(fp, i, 0, in_channels - 1, 0, out_channels - 1);
+        } else {
+            for (int32_t in = 0; in < in_channels; in++) {
+                for (int32_t out = 0; out < out_channels; out++) {
+                    write_conv_group(fp, i, in, in, out, out);
+                }
+            }
+        }
+    }
+
+    // Offsets of the blocks of neurons, filled in once the neurons are written
+    long offsets_table = 0;
+    if (with_offsets) {
+        write_int32(fp, BLOCK_SIZE);
+        offsets_table = ftell(fp);
+        for (int32_t k = 0; k < NUM_BLOCKS; k++) {
+            write_int32(fp, 0);
+            write_int32(fp, 0);
+        }
+    }
+    uint64_t offsets[NUM_BLOCKS];
+
+    // Neurons (they have no fully groups)
+    for (int32_t i = 0; i < TOTAL_NEURONS; i++) {
+        if (i % BLOCK_SIZE == 0) {
+            offsets[i / BLOCK_SIZE] = ftell(fp);
+        }
+        write_float(fp, 0);     // potential
+        write_float(fp, 0);     // current
+        write_float(fp, 0);     // resting_potential
+        write_float(fp, 0);     // reset_potential
+        write_float(fp, i < NUM_INPUT ? 0.5 : 0.8); // threshold
+        write_float(fp, 0.2);   // tau_m
+        write_float(fp, 30);    // resistance
+        write_uint16(fp, 0);
+    }
+
+    if (with_offsets) {
+        fseek(fp, offsets_table, SEEK_SET);
+        for (int32_t k = 0; k < NUM_BLOCKS; k++) {
+            write_int32(fp, offsets[k] >> 32);
+            write_int32(fp, offsets[k] & 0xFFFFFFFF);
+        }
+    }
+
+    fclose(fp);
+}
+
+
+// Input neurons receive a few spikes spread over time
+#define MAX_SPIKES_PER_NEURON 16
+
+static void generate_spikes(struct SettingsNeuronLP * settings_neuron_lp,
+        struct StorableSpike ** spikes, struct StorableSpike * naked_spikes) {
+    for (int32_t i = 0; i < settings_neuron_lp->num_neurons_pe; i++) {
+        int32_t const doryta_id = layout_master_local_id_to_doryta_id(i);
+        if (doryta_id >= NUM_INPUT) {
+            continue;
+        }
+        pcg32_random_t rng;
+        pcg32_srandom_r(&rng, doryta_id + 42u, doryta_id + 54u);
+
+        struct StorableSpike * const spikes_neuron =
+            &naked_spikes[i * (MAX_SPIKES_PER_NEURON + 1)];
+        int n = 0;
+        for (int k = 0; k < MAX_SPIKES_PER_NEURON; k++) {
+            if (pcg32_float_r(&rng) < .3) {
+                spikes_neuron[n] = (struct StorableSpike) {
+                    .neuron = doryta_id,
+                    .time = 0.05 * (k + 1) + 0.001,
+                    .intensity = 1,
+                };
+                n++;
+            }
+        }
+        spikes[i] = spikes_neuron;
+    }
+    settings_neuron_lp->spikes = spikes;
+}
+
+
+int main(int argc, char *argv[]) {
+    tw_opt_add(model_opts);
+    tw_init(&argc, &argv);
+
+    char const * const output_path = with_offsets ? "output/offsets-test"
+        : (with_channels ? "output/channels-test" : "output/pairs-test");
+    char const * const model_path = with_offsets ? "output/offsets.doryta.bin"
+        : (with_channels ? "output/channels.doryta.bin" : "output/pairs.doryta.bin");
+
+    if (g_tw_mynode == 0) {
+      check_folder("output");
+      check_folder(output_path);
+      write_model(model_path);
+    }
+    // The model has to be written before any PE reads it
+    MPI_Barrier(MPI_COMM_ROSS);
+
+    struct SettingsNeuronLP settings_neuron_lp;
+    struct ModelParams const params =
+        model_load_neurons_init(&settings_neuron_lp, model_path);
+
+    // Spikes
+    struct StorableSpike ** spikes =
+        calloc(settings_neuron_lp.num_neurons_pe, sizeof(struct StorableSpike*));
+    struct StorableSpike * naked_spikes = calloc(
+            settings_neuron_lp.num_neurons_pe * (MAX_SPIKES_PER_NEURON + 1),
+            sizeof(struct StorableSpike));
+    if (spikes == NULL || naked_spikes == NULL) {
+        tw_error(TW_LOC, "Not able to allocate space for spikes");
+    }
+    generate_spikes(&settings_neuron_lp, spikes, naked_spikes);
+
+    probe_event_f probe_events[2] = {probes_firing_record, NULL};
+    settings_neuron_lp.probe_events = probe_events;
+
+    driver_neuron_config(&settings_neuron_lp);
+    set_mapping_on_all_lps(params.gid_to_pe);
+
+    // The lookahead is determined by the delays (and heartbeats)
+    if (g_tw_synchronization_protocol == CONSERVATIVE) {
+        double const lookahead_pe = driver_neuron_lookahead(false);
+        double lookahead;
+        MPI_Allreduce(&lookahead_pe, &lookahead, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_ROSS);
+        // Offsets are computed from timestamps, so they might be rounded
+        // slightly below the lookahead
+        g_tw_lookahead = lookahead * (1 - 1e-6);
+    }
+
+    // Setting up ROSS variables
+    tw_define_lps(params.lps_in_pe, size_of_Message(settings_neuron_lp.sizeof_storage));
+    // set the global variable and initialize each LP's type
+    g_tw_lp_types = doryta_lps;
+    tw_lp_setup_types();
+
+    // Allocating memory for probes
+    probes_firing_init(5000, output_path, false);
+
+    // Running simulation
+    tw_run();
+    // Simulation ends when the function exits
+
+    // Deallocating/deinitializing everything
+    probes_firing_deinit();
+
+    model_load_neurons_deinit();
+    free(naked_spikes);
+    free(spikes);
+
+    tw_end();
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+"""
+Compares the wall-clock time of the event handlers specialized for a neuron type against
+the generic (pointer-based) handlers. The same binary is run several times with and
+without the flag that selects the generic handlers, alternating between both.
+
+By default, it runs the 10000-neuron network from `test/models/004`, eg:
+
+    python tools/general/benchmark_handlers.py build/test/models/004_two-layers-spike-driven-10000
+
+To benchmark the doryta binary, pass the flag and the model, eg:
+
+    python tools/general/benchmark_handlers.py build/src/doryta \\
+        --generic-flag=--generic-handlers -- --spike-driven --gol-model --end=100
+"""
+
+from __future__ import annotations
+
+import argparse
+import os
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+from typing import List, Optional, Tuple
+
+
+def run_once(command: List[str], cwd: str) -> Tuple[float, Optional[float]]:
+    """Returns the wall-clock time of the execution and the running time reported by
+    ROSS (if it was found in the output)."""
+    start = time.perf_counter()
+    result = subprocess.run(command, cwd=cwd, stdout=subprocess.PIPE,
+                            stderr=subprocess.STDOUT, text=True)
+    wall_clock = time.perf_counter() - start
+    if result.returncode != 0:
+        print(result.stdout, file=sys.stderr)
+        print(f"Command `{' '.join(command)}` failed", file=sys.stderr)
+        exit(1)
+
+    match = re.search(r"Running Time\s*=\s*([0-9.]+)", result.stdout)
+    return wall_clock, float(match.group(1)) if match else None
+
+
+def summary(name: str, times: List[float]) -> str:
+    return (f"{name:12} median = {statistics.median(times):.4f} s  "
+            f"min = {min(times):.4f} s  max = {max(times):.4f} s")
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('binary', help='Binary to benchmark')
+    parser.add_argument('args', nargs='*',
+                        help='Arguments to pass to the binary (after `--`)')
+    parser.add_argument('--runs', type=int, default=10,
+                        help='Number of executions with each set of handlers')
+    parser.add_argument('--np', type=int, default=2, help='Number of MPI ranks')
+    parser.add_argument('--generic-flag', default='--generic',
+                        help='Flag that selects the generic handlers')
+    parser.add_argument('--mpirun', default='mpirun', help='MPI launcher')
+    args = parser.parse_args()
+
+    binary_args = args.args or ['--gvt-interval=32', '--extramem=16384', '--synch=3',
+                                '--end=1', '--batch=2']
+    command = [args.mpirun, '-np', str(args.np), os.path.abspath(args.binary),
+               *binary_args]
+
+    wall_clock: dict[str, List[float]] = {'specialized': [], 'generic': []}
+    ross_time: dict[str, List[float]] = {'specialized': [], 'generic': []}
+
+    # Runs are interleaved, so that any change in the load of the machine affects both
+    with tempfile.TemporaryDirectory() as workdir:
+        for path in ['output', 'output/generic']:
+            os.makedirs(os.path.join(workdir, path), exist_ok=True)
+        for _ in range(args.runs):
+            for name, extra in [('specialized', []), ('generic', [args.generic_flag])]:
+                wall, ross = run_once(command + extra, workdir)
+                wall_clock[name].append(wall)
+                if ross is not None:
+                    ross_time[name].append(ross)
+
+    print(f"Wall-clock time ({args.runs} runs, {args.np} ranks)")
+    for name, times in wall_clock.items():
+        print(summary(name, times))
+    if ross_time['specialized'] and ross_time['generic']:
+        print("Running time reported by ROSS")
+        for name, times in ross_time.items():
+            print(summary(name, times))
+
+    speedup = statistics.median(wall_clock['generic']) \
+        / statistics.median(wall_clock['specialized'])
+    print(f"Speedup of the specialized handlers (wall-clock medians): {speedup:.3f}x")
@@ -0,0 +1,79 @@
+"""
+Given the load recorded per PE (`--probe-load`), this script computes how unbalanced the
+PEs were on each window of time. In a window, every PE has to wait for the busiest PE, so
+the time lost to imbalance is proportional to the difference between the maximum and the
+average load.
+"""
+
+from __future__ import annotations
+
+import numpy as np
+import glob
+import argparse
+import sys
+import pathlib
+import re
+
+from typing import Tuple
+
+
+def load_per_pe(path: pathlib.Path) -> Tuple[np.ndarray, np.ndarray]:
+    """
+    Returns the start of each window and a matrix (PE x window) with the load of each PE.
+    """
+    escaped_path = pathlib.Path(glob.escape(path))  # type: ignore
+    load_files = glob.glob(str(escaped_path / "load-gid=*.txt"))
+    if not load_files:
+        print(f"No valid load files have been found in path {path}", file=sys.stderr)
+        exit(1)
+
+    per_pe = {}
+    for filename in load_files:
+        match = re.search(r'load-gid=([0-9]+)\.txt$', filename)
+        assert match is not None
+        data = np.loadtxt(filename, ndmin=2)  # type: ignore
+        per_pe[int(match.group(1))] = data
+
+    num_pes = max(per_pe) + 1
+    # All PEs record windows of the same length, but a PE stops recording at its last
+    # event
+    longest = max(per_pe.values(), key=lambda d: d.shape[0])
+    windows = longest[:, 0] if longest.shape[0] > 0 else np.zeros(0)
+    loads = np.zeros((num_pes, windows.shape[0]), dtype=int)
+    for pe, data in per_pe.items():
+        if data.shape[0] > 0:
+            loads[pe, :data.shape[0]] = data[:, 1]
+
+    return windows, loads
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--path', type=pathlib.Path, help='Output directory of doryta execution',
+                        required=True)
+    parser.add_argument('--per-window', action='store_true',
+                        help='Print the load of the busiest PE in each window')
+    args = parser.parse_args()
+
+    windows, loads = load_per_pe(args.path)
+    num_pes = loads.shape[0]
+    max_load = loads.max(axis=0)
+    mean_load = loads.mean(axis=0)
+
+    if args.per_window:
+        print("window-start\tbusiest-pe\tmax\tmean\tmax/mean")
+        for i, start in enumerate(windows):
+            ratio = max_load[i] / mean_load[i] if mean_load[i] > 0 else 1.0
+            print(f"{start}\t{loads[:, i].argmax()}\t{max_load[i]}\t{mean_load[i]:.1f}"
+                  f"\t{ratio:.3f}")
+        print()
+
+    total = loads.sum()
+    print("PEs =", num_pes)
+    print("windows =", windows.shape[0])
+    print("total load =", total)
+    print("load per PE =", loads.sum(axis=1).tolist())
+    # Time is bound by the busiest PE on each window, not by the busiest PE overall
+    if total > 0:
+        print("max/mean (whole run) =", loads.sum(axis=1).max() / loads.sum(axis=1).mean())
+        print("max/mean (per window) =", max_load.sum() / mean_load.sum())